@@ -4,6 +4,9 @@
 
 #include "appscene.h"
 
+#include "appwindow.h"
+
+#include "qmlgl/scenerendercache.h"
 #include "qmlgl/viewport.h"
 #include "qmlgl/window.h"
 
@@ -17,45 +20,97 @@ AppOpenGLScene::~AppOpenGLScene()
 
 }
 
+/**
+ * @brief synchronizes the window and viewports data
+ *
+ * If the window is an AppWindow, the data are published by the window
+ * in the main thread and picked up in render(); there is nothing to copy here.
+ * The window is only asked to publish the data if it has not done so since
+ * the last frame.
+ *
+ * Otherwise, the data are copied from the window.
+ */
 void AppOpenGLScene::synchronize(Window* window)
 {
-  m_render_data.window_size = window->size();
-  m_render_data.clear_color = window->clearColor();
+  // resources created by the render tasks may change the rendering of the viewports
+  if (window->hasPendingRenderTasks())
+  {
+    incrementSceneRevision();
+  }
+
+  if (auto* appwindow = dynamic_cast<AppWindow*>(window))
+  {
+    m_render_data_buffer = &appwindow->renderDataBuffer();
 
-  m_render_data.viewports.clear();
+    if (!m_render_data_buffer->hasNewSnapshot())
+    {
+      appwindow->publishRenderData();
+    }
+
+    return;
+  }
+
+  m_render_data_buffer = nullptr;
+  m_render_data = &m_local_render_data;
+
+  m_local_render_data.window_size = window->size();
+  m_local_render_data.clear_color = window->clearColor();
+
+  m_local_render_data.viewports.clear();
 
   for (Viewport* vp : window->viewports())
   {
     if (!vp->camera())
       continue;
 
-    m_render_data.viewports.push_back(AppViewportRenderData(vp));
+    m_local_render_data.viewports.push_back(AppViewportRenderData(vp));
   }
+
+  std::stable_sort(m_local_render_data.viewports.begin(), m_local_render_data.viewports.end(),
+    [](const ViewportRenderData& lhs, const ViewportRenderData& rhs) { return lhs.z < rhs.z; });
 }
 
 void AppOpenGLScene::render(Window* window)
 {
-  QSize wsize = m_render_data.window_size;
-  qreal pixel_ratio = window->devicePixelRatio();
+  acquireRenderData();
+
+  const WindowRenderData& render_data = *m_render_data;
+
+  // the viewports are positioned in device-independent pixels, but the scene
+  // may be rendered at a different resolution (high-DPI, dynamic resolution)
+  const QSize wsize = render_data.window_size;
+  const QSize fbsize = window->sceneFramebufferSize();
+  m_pixel_scale = QSizeF(qreal(fbsize.width()) / std::max(wsize.width(), 1), qreal(fbsize.height()) / std::max(wsize.height(), 1));
+
+  m_render_target_size = fbsize;
 
   QOpenGLFunctions* gl = window->openglContext()->functions();
-  gl->glViewport(0, 0, wsize.width() * pixel_ratio, wsize.height() * pixel_ratio);
+  gl->glViewport(0, 0, fbsize.width(), fbsize.height());
 
-  if (m_render_data.clear_color.alpha() > 0)
+  if (render_data.clear_color.alpha() > 0)
   {
-    QColor cc = m_render_data.clear_color;
+    QColor cc = render_data.clear_color;
     gl->glClearColor(cc.redF(), cc.greenF(), cc.blueF(), 1.0f);
     gl->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   }
 
   gl->glEnable(GL_DEPTH_TEST);
 
-  std::sort(m_render_data.viewports.begin(), m_render_data.viewports.end(),
-    [](const ViewportRenderData& lhs, const ViewportRenderData& rhs) { return lhs.z < rhs.z; });
-
-  for (const AppViewportRenderData& v : m_render_data.viewports)
+  for (const AppViewportRenderData& vp : render_data.viewports)
   {
-    if (v.visible)
+    if (!vp.visible)
+    {
+      continue;
+    }
+
+    AppViewportRenderData v = vp;
+    v.rect = toFramebufferRect(vp.rect);
+
+    if (v.cached)
+    {
+      renderViewportCached(window, gl, v);
+    }
+    else
     {
       QColor c = v.clear_color;
 
@@ -64,7 +119,7 @@ void AppOpenGLScene::render(Window* window)
         // https://stackoverflow.com/questions/18830589/shouldnt-glclearcolor-obey-the-drawing-area-set-by-glviewport
 
         gl->glEnable(GL_SCISSOR_TEST);
-        gl->glScissor(v.rect.x(), wsize.height() - v.rect.height() - v.rect.y(), v.rect.width(), v.rect.height());
+        gl->glScissor(v.rect.x(), fbsize.height() - v.rect.height() - v.rect.y(), v.rect.width(), v.rect.height());
 
         gl->glClearColor(c.redF(), c.greenF(), c.blueF(), c.alphaF());
         gl->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -78,11 +133,141 @@ void AppOpenGLScene::render(Window* window)
     }
   }
 
+  releaseUnusedViewportCaches();
+
   window->resetOpenGLState();
 }
 
+/**
+ * @brief picks up the most recent data published by the window
+ */
+void AppOpenGLScene::acquireRenderData()
+{
+  if (m_render_data_buffer)
+  {
+    m_render_data_buffer->update();
+    m_render_data = &m_render_data_buffer->readBuffer();
+  }
+
+  if (m_clear_color != m_render_data->clear_color)
+  {
+    // the window clear color is visible through the viewports
+    // that have a transparent clear color
+    m_clear_color = m_render_data->clear_color;
+    incrementSceneRevision();
+  }
+}
+
+/**
+ * @brief converts a rectangle in device-independent pixels to framebuffer pixels
+ */
+QRect AppOpenGLScene::toFramebufferRect(const QRect& rect) const
+{
+  // the edges are rounded rather than the size so that adjacent
+  // viewports remain adjacent
+  const int left = qRound(rect.x() * m_pixel_scale.width());
+  const int top = qRound(rect.y() * m_pixel_scale.height());
+  const int right = qRound((rect.x() + rect.width()) * m_pixel_scale.width());
+  const int bottom = qRound((rect.y() + rect.height()) * m_pixel_scale.height());
+  return QRect(left, top, right - left, bottom - top);
+}
+
 void AppOpenGLScene::glViewport(QOpenGLFunctions* gl, const QRect& rect)
 {
-  GLint gl_y = m_render_data.window_size.height() - rect.height() - rect.y();
+  GLint gl_y = renderTargetSize().height() - rect.height() - rect.y();
   gl->glViewport(rect.x(), gl_y, rect.width(), rect.height());
 }
+
+/**
+ * @brief notifies that the content of the scene changed
+ *
+ * This invalidates the cache of all viewports.
+ * Derived classes should call this function from synchronize() whenever
+ * something that is rendered by renderViewport() has changed.
+ */
+void AppOpenGLScene::incrementSceneRevision()
+{
+  ++m_scene_revision;
+}
+
+/**
+ * @brief renders a viewport using its cache
+ *
+ * The viewport is rendered into its framebuffer only if its camera,
+ * size, options or the scene revision changed since the last time;
+ * the content of the framebuffer is then drawn in the viewport.
+ */
+void AppOpenGLScene::renderViewportCached(Window* window, QOpenGLFunctions* gl, const AppViewportRenderData& view)
+{
+  ViewportCache& cache = m_viewport_caches[view.viewport];
+
+  if (!cache.framebuffer)
+  {
+    cache.framebuffer = std::make_unique<SceneRenderCache>();
+  }
+
+  const bool up_to_date = cache.framebuffer->hasContent(view.rect.size())
+    && cache.scene_revision == m_scene_revision
+    && cache.view_matrix == view.view_matrix
+    && cache.projection_matrix == view.projection_matrix
+    && cache.clear_color == view.clear_color
+    && cache.draw_world_frame == view.draw_world_frame
+    && cache.draw_camera_orienation_axes == view.draw_camera_orienation_axes;
+
+  if (!up_to_date)
+  {
+    const QSize target_size = m_render_target_size;
+
+    GLint target_fbo = 0;
+    gl->glGetIntegerv(GL_FRAMEBUFFER_BINDING, &target_fbo);
+
+    cache.framebuffer->bind(view.rect.size(), window->format().samples());
+
+    // the viewport is rendered as if it was covering the whole window
+    AppViewportRenderData cached_view = view;
+    cached_view.rect = QRect(QPoint(0, 0), view.rect.size());
+    m_render_target_size = view.rect.size();
+
+    QColor c = view.clear_color.alpha() > 0 ? view.clear_color : m_render_data->clear_color;
+    gl->glClearColor(c.redF(), c.greenF(), c.blueF(), 1.0f);
+    gl->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    gl->glEnable(GL_DEPTH_TEST);
+
+    glViewport(gl, cached_view.rect);
+    renderViewport(window, cached_view);
+
+    cache.framebuffer->resolve();
+    cache.scene_revision = m_scene_revision;
+    cache.view_matrix = view.view_matrix;
+    cache.projection_matrix = view.projection_matrix;
+    cache.clear_color = view.clear_color;
+    cache.draw_world_frame = view.draw_world_frame;
+    cache.draw_camera_orienation_axes = view.draw_camera_orienation_axes;
+
+    m_render_target_size = target_size;
+    gl->glBindFramebuffer(GL_FRAMEBUFFER, target_fbo);
+  }
+
+  GLint gl_y = renderTargetSize().height() - view.rect.height() - view.rect.y();
+  cache.framebuffer->draw(window->openglContext(), QRect(view.rect.x(), gl_y, view.rect.width(), view.rect.height()));
+
+  gl->glEnable(GL_DEPTH_TEST);
+}
+
+/**
+ * @brief destroys the caches of the viewports that are no longer cached
+ */
+void AppOpenGLScene::releaseUnusedViewportCaches()
+{
+  for (auto it = m_viewport_caches.begin(); it != m_viewport_caches.end(); )
+  {
+    auto is_cached = [&it](const AppViewportRenderData& v) {
+      return v.viewport == it->first && v.cached;
+    };
+
+    if (std::none_of(m_render_data->viewports.begin(), m_render_data->viewports.end(), is_cached))
+      it = m_viewport_caches.erase(it);
+    else
+      ++it;
+  }
+}
@@ -6,13 +6,21 @@
 #define APPSCENE_H
 
 #include "qmlgl/scene.h"
+#include "qmlgl/triplebuffer.h"
 
 #include "appviewport.h"
 
+#include <QMatrix4x4>
+#include <QSizeF>
+
+#include <map>
+#include <memory>
 #include <vector>
 
 class QOpenGLFunctions;
 
+class SceneRenderCache;
+
 struct WindowRenderData
 {
   QSize window_size;
@@ -30,18 +38,76 @@ public:
 
   virtual void renderViewport(Window* window, const AppViewportRenderData& view) = 0;
 
+  int sceneRevision() const;
+
 protected:
   void glViewport(QOpenGLFunctions* gl, const QRect& rect);
+  QRect toFramebufferRect(const QRect& rect) const;
 
   const WindowRenderData& windowData() const;
+  const QSize& renderTargetSize() const;
+
+  void incrementSceneRevision();
 
 private:
-  WindowRenderData m_render_data;
+  void acquireRenderData();
+  void renderViewportCached(Window* window, QOpenGLFunctions* gl, const AppViewportRenderData& view);
+  void releaseUnusedViewportCaches();
+
+private:
+  const WindowRenderData* m_render_data = &m_local_render_data;
+  WindowRenderData m_local_render_data;
+  TripleBuffer<WindowRenderData>* m_render_data_buffer = nullptr;
+  QColor m_clear_color;
+  QSize m_render_target_size;
+  QSizeF m_pixel_scale = QSizeF(1, 1);
+  int m_scene_revision = 0;
+
+  /**
+   * @brief the cached rendering of a viewport and the state it was rendered with
+   */
+  struct ViewportCache
+  {
+    std::unique_ptr<SceneRenderCache> framebuffer;
+    QMatrix4x4 view_matrix;
+    QMatrix4x4 projection_matrix;
+    QColor clear_color;
+    bool draw_world_frame = false;
+    bool draw_camera_orienation_axes = false;
+    int scene_revision = -1;
+  };
+
+  std::map<const Viewport*, ViewportCache> m_viewport_caches;
 };
 
 inline const WindowRenderData& AppOpenGLScene::windowData() const
 {
-  return m_render_data;
+  return *m_render_data;
+}
+
+/**
+ * @brief returns the size, in pixels, of the surface in which the viewports are being rendered
+ *
+ * This is the size of the framebuffer of the window (see Window::sceneFramebufferSize()),
+ * unless the viewport is being rendered into its cache in which case this is
+ * the size of the viewport.
+ * This must be used instead of the size of the window when computing
+ * OpenGL viewports in renderViewport(); the rect of the viewports passed
+ * to renderViewport() is also expressed in pixels of this surface.
+ */
+inline const QSize& AppOpenGLScene::renderTargetSize() const
+{
+  return m_render_target_size;
+}
+
+/**
+ * @brief returns the revision of the scene
+ *
+ * Cached viewports are rendered again whenever the revision changes.
+ */
+inline int AppOpenGLScene::sceneRevision() const
+{
+  return m_scene_revision;
 }
 
 #endif // APPSCENE_H
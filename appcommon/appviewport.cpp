@@ -13,6 +13,7 @@ AppViewportRenderData::AppViewportRenderData(Viewport* v)
   else
   {
     static_cast<ViewportRenderData&>(*this) = v->renderData();
+    viewport = v;
   }
 }
 
@@ -54,12 +55,44 @@ void AppViewport::setDrawCameraOrientationAxes(bool on)
   }
 }
 
+/**
+ * @brief returns whether the rendering of the viewport is cached
+ */
+bool AppViewport::cached() const
+{
+  return m_cached;
+}
+
+/**
+ * @brief sets whether the rendering of the viewport is cached
+ * @param on
+ *
+ * When enabled, the viewport is rendered into a framebuffer object
+ * which is reused for the next frames as long as the camera, the size
+ * of the viewport and the scene do not change.
+ *
+ * This is mostly useful for secondary viewports whose camera rarely changes.
+ *
+ * @sa AppOpenGLScene::incrementSceneRevision().
+ */
+void AppViewport::setCached(bool on)
+{
+  if (m_cached != on)
+  {
+    m_cached = on;
+    Q_EMIT cachedChanged();
+
+    update();
+  }
+}
 
 AppViewportRenderData AppViewport::renderData() const
 {
   AppViewportRenderData r;
   static_cast<ViewportRenderData&>(r) = Viewport::renderData();
   r.draw_camera_orienation_axes = drawCameraOrientationAxes();
+  r.viewport = this;
   r.draw_world_frame = drawWorldFrame();
+  r.cached = cached();
   return r;
 }
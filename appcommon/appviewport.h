@@ -8,8 +8,10 @@
 
 struct AppViewportRenderData : ViewportRenderData
 {
+  const Viewport* viewport = nullptr;
   bool draw_world_frame = false;
   bool draw_camera_orienation_axes = false;
+  bool cached = false;
 
   AppViewportRenderData() = default;
   explicit AppViewportRenderData(Viewport* v);
@@ -20,6 +22,7 @@ class AppViewport : public Viewport
   Q_OBJECT
   Q_PROPERTY(bool drawWorldFrame READ drawWorldFrame WRITE setDrawWorldFrame NOTIFY drawWorldFrameChanged)
   Q_PROPERTY(bool drawCameraOrientationAxes READ drawCameraOrientationAxes WRITE setDrawCameraOrientationAxes NOTIFY drawCameraOrientationAxesChanged)
+  Q_PROPERTY(bool cached READ cached WRITE setCached NOTIFY cachedChanged)
 public:
   explicit AppViewport(QQuickItem* parent = nullptr);
 
@@ -29,13 +32,18 @@ public:
   bool drawCameraOrientationAxes() const;
   void setDrawCameraOrientationAxes(bool on = true);
 
+  bool cached() const;
+  void setCached(bool on = true);
+
   AppViewportRenderData renderData() const;
 
 Q_SIGNALS:
   void drawWorldFrameChanged();
   void drawCameraOrientationAxesChanged();
+  void cachedChanged();
   
 private:
   bool m_draw_world_frame = true;
   bool m_draw_camera_orienation_axes = true;
+  bool m_cached = false;
 };
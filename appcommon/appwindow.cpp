@@ -10,6 +10,8 @@
 
 #include <QQmlContext>
 
+#include <algorithm>
+
 void init_qmlgl_appcommon_resources()
 {
   Q_INIT_RESOURCE(qmlglappcommon);
@@ -23,10 +25,11 @@ OpenGLSceneFactory::~OpenGLSceneFactory()
 /**
  * @brief constructs a window
  * @param factory  pointer used to construct the GL scene
+ * @param mode     whether the window is rendered on screen or offscreen
  *
  * The scene is constructed when the OpenGLContext becomes available.
  */
-AppWindow::AppWindow(std::unique_ptr<OpenGLSceneFactory> factory) : Window(),
+AppWindow::AppWindow(std::unique_ptr<OpenGLSceneFactory> factory, RenderMode mode) : Window(mode),
   m_factory(std::move(factory))
 {
   init_qmlgl_appcommon_resources();
@@ -72,6 +75,51 @@ void AppWindow::exposeQObjectToQml(QObject* obj, const QString& name)
   rootContext()->setContextProperty(name, obj);
 }
 
+/**
+ * @brief publishes a snapshot of the window and viewports for the render thread
+ *
+ * The snapshot is built in the main thread, in a buffer that is not being
+ * read by the render thread, so that the scene only has to pick it up
+ * with a pointer swap.
+ * The viewports are sorted by z-order in the snapshot.
+ *
+ * @sa renderDataBuffer().
+ */
+void AppWindow::publishRenderData()
+{
+  WindowRenderData& data = m_render_data_buffer.writeBuffer();
+
+  data.window_size = size();
+  data.clear_color = clearColor();
+
+  // clear() keeps the capacity of the vector, so no allocation is
+  // performed once the buffers have been used once
+  data.viewports.clear();
+
+  for (Viewport* vp : viewports())
+  {
+    if (!vp->camera())
+      continue;
+
+    data.viewports.push_back(AppViewportRenderData(vp));
+  }
+
+  std::stable_sort(data.viewports.begin(), data.viewports.end(),
+    [](const ViewportRenderData& lhs, const ViewportRenderData& rhs) { return lhs.z < rhs.z; });
+
+  m_render_data_buffer.publish();
+}
+
+/**
+ * @brief returns the buffer through which the render data are published
+ *
+ * The render thread is the consumer of this buffer.
+ */
+TripleBuffer<WindowRenderData>& AppWindow::renderDataBuffer()
+{
+  return m_render_data_buffer;
+}
+
 std::unique_ptr<OpenGLScene> AppWindow::createOpenGLScene()
 {
   return m_factory->create(openglContext());
@@ -2,6 +2,11 @@
 // This file is part of the 'qmlgl' project
 // For conditions of distribution and use, see copyright notice in LICENSE
 
+#pragma once
+
+#include "appscene.h"
+
+#include "qmlgl/triplebuffer.h"
 #include "qmlgl/window.h"
 
 #include <memory>
@@ -84,7 +89,7 @@ inline std::unique_ptr<OpenGLSceneFactory> OpenGLSceneFactory::makeFactory(F&& f
 class AppWindow : public Window
 {
 public:
-  explicit AppWindow(std::unique_ptr<OpenGLSceneFactory> factory);
+  explicit AppWindow(std::unique_ptr<OpenGLSceneFactory> factory, RenderMode mode = OnScreen);
 
   /**
    * @brief specifies the behavior of exposeQObjectToQml()
@@ -98,9 +103,13 @@ public:
   void exposeQObjectToQml(QObject* obj, ExposeOptions opts = ExposeObjectOnly);
   void exposeQObjectToQml(QObject* obj, const QString& name);
 
+  void publishRenderData() override;
+  TripleBuffer<WindowRenderData>& renderDataBuffer();
+
 protected:
   std::unique_ptr<OpenGLScene> createOpenGLScene() override;
 
 private:
   std::unique_ptr<OpenGLSceneFactory> m_factory;
+  TripleBuffer<WindowRenderData> m_render_data_buffer;
 };
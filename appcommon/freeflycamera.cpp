@@ -143,9 +143,9 @@ void FreeflyCameraController::mouseMoveEvent(QMouseEvent* ev)
 {
   if (m_previous_move_pos.has_value() && ev->buttons() == Qt::RightButton)
   {
-    QPoint mouse_delta = ev->pos() - m_previous_move_pos.value();
-    rotateCamera(0.1f * mouse_delta.x(), 0.1f * mouse_delta.y());
+    m_pending_mouse_delta += ev->pos() - m_previous_move_pos.value();
     m_previous_move_pos = ev->pos();
+    scheduleInput();
     ev->accept();
   }
 }
@@ -214,10 +214,24 @@ void FreeflyCameraController::keyReleaseEvent(QKeyEvent* ev)
 
 void FreeflyCameraController::wheelEvent(QWheelEvent* ev)
 {
-  int wheel_angle = ev->angleDelta().y();
-
-  constexpr bool move_view_center = true;
-  translate(*camera(), QVector3D(0.f, wheel_angle / 120.f, 0.f), move_view_center);
+  m_pending_wheel_angle += ev->angleDelta().y();
+  scheduleInput();
 
   ev->accept();
 }
+
+void FreeflyCameraController::processPendingInput()
+{
+  if (!m_pending_mouse_delta.isNull())
+  {
+    rotateCamera(0.1f * m_pending_mouse_delta.x(), 0.1f * m_pending_mouse_delta.y());
+    m_pending_mouse_delta = QPoint();
+  }
+
+  if (m_pending_wheel_angle != 0)
+  {
+    constexpr bool move_view_center = true;
+    translate(*camera(), QVector3D(0.f, m_pending_wheel_angle / 120.f, 0.f), move_view_center);
+    m_pending_wheel_angle = 0;
+  }
+}
@@ -40,12 +40,16 @@ protected:
 
   void wheelEvent(QWheelEvent* ev) override;
 
+  void processPendingInput() override;
+
   void rotateCamera(float yaw, float pitch);
 
 private:
   float m_translation_speed = 20.f;
   float m_rotation_speed = 6.f;
   std::optional<QPoint> m_previous_move_pos;
+  QPoint m_pending_mouse_delta;
+  int m_pending_wheel_angle = 0;
 
   enum MovementFlag
   {
@@ -0,0 +1,126 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "offscreen.h"
+
+#include "qmlgl/framestatistics.h"
+#include "qmlgl/window.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QImage>
+
+#include <QDebug>
+
+#include <algorithm>
+
+/**
+ * @brief adds the options controlling offscreen rendering to a command line parser
+ *
+ * The following options are added:
+ * - "offscreen-frames <n>": renders n frames offscreen and exits
+ * - "offscreen-size <WxH>": size of the offscreen window (default 1024x768)
+ * - "offscreen-output <file>": saves the last frame in the given image file
+ */
+void add_offscreen_options(QCommandLineParser& parser)
+{
+  parser.addOption(QCommandLineOption("offscreen-frames", "Renders <n> frames offscreen and exits.", "n"));
+  parser.addOption(QCommandLineOption("offscreen-size", "Size of the offscreen window.", "WxH", "1024x768"));
+  parser.addOption(QCommandLineOption("offscreen-output", "Saves the last offscreen frame to <file>.", "file"));
+}
+
+/**
+ * @brief reads the offscreen options from a command line parser
+ *
+ * Offscreen rendering is enabled if the "offscreen-frames" option is set.
+ */
+OffscreenOptions offscreen_options(const QCommandLineParser& parser)
+{
+  OffscreenOptions result;
+
+  if (parser.isSet("offscreen-frames"))
+  {
+    result.enabled = true;
+    result.frames = std::max(parser.value("offscreen-frames").toInt(), 1);
+  }
+
+  const QStringList size = parser.value("offscreen-size").split('x');
+
+  if (size.size() == 2 && size.front().toInt() > 0 && size.back().toInt() > 0)
+  {
+    result.size = QSize(size.front().toInt(), size.back().toInt());
+  }
+
+  result.output = parser.value("offscreen-output");
+
+  return result;
+}
+
+static void print_stage(const char* name, const FrameStageStatistics& stats)
+{
+  qInfo().noquote() << QString("  %1  p50: %2 ms  p95: %3 ms  p99: %4 ms")
+    .arg(name, -6)
+    .arg(stats.p50, 0, 'f', 3)
+    .arg(stats.p95, 0, 'f', 3)
+    .arg(stats.p99, 0, 'f', 3);
+}
+
+/**
+ * @brief renders a window offscreen and prints the frame statistics
+ * @param window   a window constructed in Window::Offscreen mode
+ * @param options  the offscreen options
+ * @return the exit code of the application
+ */
+int run_offscreen(Window& window, const OffscreenOptions& options)
+{
+  window.resize(options.size);
+
+  // publish the statistics for every frame, the last snapshot
+  // will then cover all the rendered frames
+  window.frameStatistics()->setUpdateInterval(0);
+
+  QElapsedTimer timer;
+  timer.start();
+
+  if (!window.renderOffscreenFrames(options.frames))
+  {
+    qCritical() << "offscreen rendering failed";
+    return 1;
+  }
+
+  const qint64 elapsed = timer.elapsed();
+
+  // the statistics are delivered with queued invocations
+  QCoreApplication::processEvents();
+
+  const FrameStatistics& stats = *window.frameStatistics();
+
+  qInfo().noquote() << QString("%1 frames rendered in %2 ms (%3 fps)")
+    .arg(options.frames)
+    .arg(elapsed)
+    .arg(stats.fps(), 0, 'f', 1);
+  print_stage("sync", stats.sync());
+  print_stage("render", stats.render());
+
+  if (stats.gpuTimingAvailable())
+  {
+    print_stage("gpu", stats.gpu());
+  }
+
+  print_stage("frame", stats.frame());
+
+  if (!options.output.isEmpty())
+  {
+    QImage image = window.grabOffscreenFrame();
+
+    if (image.isNull() || !image.save(options.output))
+    {
+      qCritical() << "could not save offscreen frame to" << options.output;
+      return 1;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,32 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include <QSize>
+#include <QString>
+
+class QCommandLineParser;
+
+class Window;
+
+/**
+ * @brief options for running an application headless
+ *
+ * When enabled, the window is rendered offscreen for a given number
+ * of frames, the frame statistics are printed and the last frame can be saved
+ * as an image.
+ */
+struct OffscreenOptions
+{
+  bool enabled = false;
+  int frames = 1;
+  QSize size = QSize(1024, 768);
+  QString output;
+};
+
+void add_offscreen_options(QCommandLineParser& parser);
+OffscreenOptions offscreen_options(const QCommandLineParser& parser);
+
+int run_offscreen(Window& window, const OffscreenOptions& options);
@@ -12,6 +12,8 @@
 #include <QOpenGLFunctions>
 #include <QOpenGLBuffer>
 
+#include <cassert>
+#include <cstdint>
 #include <memory>
 #include <vector>
 
@@ -64,6 +66,58 @@ public:
   operator BufferSpecs() const { return specs; }
 };
 
+/**
+ * @brief returns the size in bytes of an OpenGL data type
+ * @param type  the type (e.g. GL_FLOAT)
+ */
+inline GLsizei gl_type_size(GLenum type)
+{
+  switch (type)
+  {
+  case GL_BYTE:
+  case GL_UNSIGNED_BYTE:
+    return 1;
+  case GL_SHORT:
+  case GL_UNSIGNED_SHORT:
+  case GL_HALF_FLOAT:
+    return 2;
+  case GL_INT:
+  case GL_UNSIGNED_INT:
+  case GL_FLOAT:
+    return 4;
+  default:
+    assert(false);
+    return 4;
+  }
+}
+
+/**
+ * @brief computes the stride and offsets of attributes interleaved in a single buffer
+ * @param attributes  the attributes, in the order in which they appear in a vertex
+ * @return the size of a vertex, in bytes
+ *
+ * The stride and offset of each attribute are overwritten.
+ * Each attribute is aligned on 4 bytes, as recommended for vertex fetching.
+ */
+inline GLsizei interleave_buffer_specs(std::vector<BufferSpecs>& attributes)
+{
+  GLsizei offset = 0;
+
+  for (BufferSpecs& specs : attributes)
+  {
+    specs.offset = reinterpret_cast<const GLvoid*>(static_cast<uintptr_t>(offset));
+    offset += specs.tuplesize * gl_type_size(specs.type);
+    offset = (offset + 3) & ~3;
+  }
+
+  for (BufferSpecs& specs : attributes)
+  {
+    specs.stride = offset;
+  }
+
+  return offset;
+}
+
 /**
  * @brief builds a BufferData struct from the whole content of a vector
  * @param v  the vector
@@ -114,6 +168,43 @@ inline void setup_buffer(std::unique_ptr<QOpenGLBuffer>& ptr,
   gl->glEnableVertexAttribArray(specs.index);
 }
 
+/**
+ * @brief setup a GL buffer holding several interleaved attributes
+ * @param ptr         unique pointer that will take ownership of the QOpenGLBuffer
+ * @param gl          pointer to the OpenGL functions
+ * @param data        the buffer data
+ * @param attributes  specifications of the attributes in the buffer
+ *
+ * The @a attributes are all bound to the currently bound VAO; their usage pattern
+ * must be the same.
+ *
+ * @sa interleave_buffer_specs().
+ */
+inline void setup_interleaved_buffer(std::unique_ptr<QOpenGLBuffer>& ptr,
+                                     QOpenGLFunctions* gl,
+                                     BufferData data,
+                                     const std::vector<BufferSpecs>& attributes)
+{
+  ptr = std::make_unique<QOpenGLBuffer>(QOpenGLBuffer::VertexBuffer);
+  auto* vbo = ptr.get();
+
+  vbo->create();
+  assert(vbo->isCreated());
+
+  vbo->bind();
+  vbo->setUsagePattern(attributes.empty() ? QOpenGLBuffer::StaticDraw : attributes.front().usage);
+  vbo->allocate(data.ptr, data.size);
+
+  for (const BufferSpecs& specs : attributes)
+  {
+    gl->glVertexAttribPointer(
+      specs.index, specs.tuplesize, specs.type, specs.normalized, specs.stride, specs.offset);
+    gl->glEnableVertexAttribArray(specs.index);
+  }
+
+  vbo->release();
+}
+
 inline void setup_index_buffer(std::unique_ptr<QOpenGLBuffer>& ptr,
                                QOpenGLFunctions* gl,
                                BufferData data,
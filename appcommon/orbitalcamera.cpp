@@ -163,9 +163,9 @@ void OrbitalCameraController::mouseMoveEvent(QMouseEvent* ev)
 {
   if (m_previous_move_pos.has_value() && ev->buttons() == Qt::RightButton)
   {
-    QPoint mouse_delta = ev->pos() - m_previous_move_pos.value();
-    rotateCamera(mouse_delta);
+    m_pending_mouse_delta += ev->pos() - m_previous_move_pos.value();
     m_previous_move_pos = ev->pos();
+    scheduleInput();
   }
 }
 
@@ -221,7 +221,21 @@ void OrbitalCameraController::keyReleaseEvent(QKeyEvent* ev)
 
 void OrbitalCameraController::wheelEvent(QWheelEvent* event)
 {
-  int wheel_angle = event->angleDelta().y();
+  m_pending_wheel_angle += event->angleDelta().y();
+  scheduleInput();
+}
 
-  wheelZoom(-wheel_angle / 120.f);
+void OrbitalCameraController::processPendingInput()
+{
+  if (!m_pending_mouse_delta.isNull())
+  {
+    rotateCamera(m_pending_mouse_delta);
+    m_pending_mouse_delta = QPoint();
+  }
+
+  if (m_pending_wheel_angle != 0)
+  {
+    wheelZoom(-m_pending_wheel_angle / 120.f);
+    m_pending_wheel_angle = 0;
+  }
 }
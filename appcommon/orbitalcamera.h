@@ -55,6 +55,8 @@ protected:
 
   void wheelEvent(QWheelEvent* ev) override;
 
+  void processPendingInput() override;
+
   void rotateCamera(const QPoint& mouse_delta);
   void rotateCamera(float yaw, float pitch);
 
@@ -69,6 +71,8 @@ private:
   QVector3D m_target_pos;
 
   std::optional<QPoint> m_previous_move_pos;
+  QPoint m_pending_mouse_delta;
+  int m_pending_wheel_angle = 0;
 
   enum MovementFlag
   {
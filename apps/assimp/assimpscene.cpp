@@ -8,6 +8,11 @@
 
 #include "appcommon/appwindow.h"
 
+#include <QLoggingCategory>
+
+// enable with QT_LOGGING_RULES="qmlgl.assimp.renderer.debug=true"
+Q_LOGGING_CATEGORY(lcModelRenderer, "qmlgl.assimp.renderer", QtWarningMsg)
+
 AssimpScene::AssimpScene(QOpenGLContext* context) : QOpenGLFunctions(context)
 {
 
@@ -17,11 +22,55 @@ void AssimpScene::synchronize(Window* window)
 {
   AppOpenGLScene::synchronize(window);
 
+  m_model_renderer.setTaskQueue(window->renderTaskQueue());
+  m_model_renderer.setResourceManager(window->gpuResourceManager());
+
   Q3dModel* model = window->findChild<Q3dModel*>();
+  m_q3dmodel = model;
+
+  if (model)
+  {
+    m_model_renderer.setVertexLayout(model->options().vertex_layout);
+    m_model_renderer.setDrawMode(model->options().draw_mode);
+    m_model_renderer.setSortDraws(model->options().sort_draws);
+  }
 
   if (model && model->model() != m_model_renderer.model())
   {
-    m_model_renderer.setModel(model->model());
+    // the previous model is destroyed here, once the renderer no longer uses it
+    std::shared_ptr<Model> previous = std::move(m_model);
+    m_model = model->sharedModel();
+    m_model_renderer.setModel(m_model.get());
+    incrementSceneRevision();
+  }
+}
+
+void AssimpScene::render(Window* window)
+{
+  m_model_renderer.resetStatistics();
+
+  AppOpenGLScene::render(window);
+
+  const ModelRenderStatistics& stats = m_model_renderer.statistics();
+
+  if (m_q3dmodel)
+  {
+    // the model lives in the main thread
+    QMetaObject::invokeMethod(
+      m_q3dmodel, [model = m_q3dmodel.data(), stats]() { model->setRenderStatistics(stats); }, Qt::QueuedConnection);
+  }
+
+  if (stats.drawn_meshes + stats.culled_meshes > 0)
+  {
+    qCDebug(lcModelRenderer).nospace() << "drawn meshes: " << stats.drawn_meshes
+      << ", culled meshes: " << stats.culled_meshes
+      << ", triangles: " << stats.drawn_triangles
+      << ", draw calls: " << stats.draw_calls
+      << " (instanced: " << stats.instanced_draw_calls << ")"
+      << ", program changes: " << stats.program_changes
+      << ", texture changes: " << stats.texture_changes
+      << " (placeholders: " << stats.placeholder_textures << ")"
+      << ", vao changes: " << stats.vao_changes;
   }
 }
 
@@ -32,10 +81,10 @@ void AssimpScene::renderViewport(Window* window, const AppViewportRenderData& vi
     m_frameaxes.drawWorldFrameAxes(this, view.projection_matrix, view.view_matrix);
   }
 
-  m_model_renderer.draw(this, view.projection_matrix, view.view_matrix);
+  m_model_renderer.draw(this, view);
 
   if (view.draw_camera_orienation_axes)
   {
-    m_frameaxes.drawCameraOrientationAxes(this, view.rect, windowData().window_size, view.view_matrix);
+    m_frameaxes.drawCameraOrientationAxes(this, view.rect, renderTargetSize(), view.view_matrix);
   }
 }
@@ -10,6 +10,9 @@
 #include <appcommon/frameaxes.h>
 
 #include <QOpenGLFunctions>
+#include <QPointer>
+
+class Q3dModel;
 
 class AssimpScene : public AppOpenGLScene, public QOpenGLFunctions
 {
@@ -18,9 +21,14 @@ public:
 
 protected:
   void synchronize(Window* window) override;
+  void render(Window* window) override;
   void renderViewport(Window* window, const AppViewportRenderData& view) override;
 
 private:
   FrameAxes m_frameaxes;
+  // the model whose render statistics are published, found during synchronize()
+  QPointer<Q3dModel> m_q3dmodel;
+  // keeps the drawn model alive until the renderer has switched to another one
+  std::shared_ptr<Model> m_model;
   ModelRenderer m_model_renderer;
 };
@@ -0,0 +1,144 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "attributeconversion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define QMLGL_CONVERSION_SSE
+#endif
+
+static_assert(sizeof(QVector3D) == 3 * sizeof(float), "QVector3D must be made of 3 packed floats");
+static_assert(sizeof(QVector2D) == 2 * sizeof(float), "QVector2D must be made of 2 packed floats");
+static_assert(sizeof(RgbColor) == 3, "RgbColor must be made of 3 packed bytes");
+
+/**
+ * @brief copies an array of 3d vectors
+ * @param xyz     the input, 3 floats per element
+ * @param count   the number of elements
+ * @param output  the output
+ *
+ * The input and the output have the same layout, the elements are copied
+ * with a single memcpy().
+ */
+void convert_vec3(const float* xyz, size_t count, QVector3D* output)
+{
+  if (count > 0)
+  {
+    std::memcpy(static_cast<void*>(output), xyz, count * sizeof(QVector3D));
+  }
+}
+
+/**
+ * @brief converts 3d texture coordinates to 2d texture coordinates
+ * @param uvw     the input, 3 floats per element
+ * @param count   the number of elements
+ * @param output  the output
+ *
+ * The third coordinate is dropped.
+ */
+void convert_texcoords(const float* uvw, size_t count, QVector2D* output)
+{
+  size_t i = 0;
+
+#if defined(QMLGL_CONVERSION_SSE)
+  float* out = reinterpret_cast<float*>(output);
+
+  // 4 elements per iteration: 3 loads of [u0 v0 w0 u1] [v1 w1 u2 v2] [w2 u3 v3 w3]
+  // and 2 stores of [u0 v0 u1 v1] [u2 v2 u3 v3]
+  for (; i + 4 <= count; i += 4)
+  {
+    const __m128 a = _mm_loadu_ps(uvw + 3 * i);
+    const __m128 b = _mm_loadu_ps(uvw + 3 * i + 4);
+    const __m128 c = _mm_loadu_ps(uvw + 3 * i + 8);
+
+    const __m128 u1v1 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 3, 3));
+    _mm_storeu_ps(out + 2 * i, _mm_shuffle_ps(a, u1v1, _MM_SHUFFLE(2, 0, 1, 0)));
+    _mm_storeu_ps(out + 2 * i + 4, _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2)));
+  }
+#endif // QMLGL_CONVERSION_SSE
+
+  convert_texcoords_scalar(uvw + 3 * i, count - i, output + i);
+}
+
+/**
+ * @brief converts floating-point colors to 8-bit colors
+ * @param rgba    the input, 4 floats per element
+ * @param count   the number of elements
+ * @param output  the output
+ *
+ * The components are clamped to [0, 1] and rounded to the nearest value;
+ * the alpha component is dropped.
+ */
+void convert_colors(const float* rgba, size_t count, RgbColor* output)
+{
+  size_t i = 0;
+
+#if defined(QMLGL_CONVERSION_SSE)
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 scale = _mm_set1_ps(255.f);
+  uint8_t* out = reinterpret_cast<uint8_t*>(output);
+
+  auto to_int = [&](const float* c) {
+    const __m128 v = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(c), scale), zero), scale);
+    return _mm_cvtps_epi32(v);
+  };
+
+  // 4 elements per iteration, packed to 16 bytes of RGBA;
+  // the x86 targets of this path are all little-endian
+  for (; i + 4 <= count; i += 4)
+  {
+    const float* c = rgba + 4 * i;
+    const __m128i rg = _mm_packs_epi32(to_int(c), to_int(c + 4));
+    const __m128i ba = _mm_packs_epi32(to_int(c + 8), to_int(c + 12));
+
+    alignas(16) uint32_t w[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(w), _mm_packus_epi16(rg, ba));
+
+    // drops the alpha bytes: 4 little-endian RGBA words to 3 words of RGB
+    const uint32_t rgb[3] = {
+      (w[0] & 0xFFFFFF) | (w[1] << 24),
+      ((w[1] >> 8) & 0xFFFF) | (w[2] << 16),
+      ((w[2] >> 16) & 0xFF) | (w[3] << 8)
+    };
+
+    std::memcpy(out + 3 * i, rgb, sizeof(rgb));
+  }
+#endif // QMLGL_CONVERSION_SSE
+
+  convert_colors_scalar(rgba + 4 * i, count - i, output + i);
+}
+
+/**
+ * @brief reference implementation of convert_texcoords(), without SIMD
+ */
+void convert_texcoords_scalar(const float* uvw, size_t count, QVector2D* output)
+{
+  for (size_t i(0); i < count; ++i)
+  {
+    output[i] = QVector2D(uvw[3 * i], uvw[3 * i + 1]);
+  }
+}
+
+/**
+ * @brief reference implementation of convert_colors(), without SIMD
+ */
+void convert_colors_scalar(const float* rgba, size_t count, RgbColor* output)
+{
+  // rounds to nearest even, like the SIMD version
+  auto to_unorm8 = [](float x) {
+    return static_cast<uint8_t>(std::nearbyint(std::min(255.f, std::max(0.f, x * 255.f))));
+  };
+
+  for (size_t i(0); i < count; ++i)
+  {
+    const float* c = rgba + 4 * i;
+    output[i] = RgbColor(to_unorm8(c[0]), to_unorm8(c[1]), to_unorm8(c[2]));
+  }
+}
@@ -0,0 +1,22 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "appcommon/color.h"
+
+#include <QVector2D>
+#include <QVector3D>
+
+#include <cstddef>
+
+// bulk conversion of the vertex attributes imported by assimp,
+// the output arrays must have room for count elements
+
+void convert_vec3(const float* xyz, size_t count, QVector3D* output);
+void convert_texcoords(const float* uvw, size_t count, QVector2D* output);
+void convert_colors(const float* rgba, size_t count, RgbColor* output);
+
+void convert_texcoords_scalar(const float* uvw, size_t count, QVector2D* output);
+void convert_colors_scalar(const float* rgba, size_t count, RgbColor* output);
@@ -0,0 +1,436 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "bvh.h"
+
+#include <qmlgl/frustumplanes.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <future>
+#include <limits>
+#include <numeric>
+
+namespace
+{
+
+constexpr int MaxLeafSize = 8;
+constexpr int BinCount = 16;
+
+// subtrees with more items are built in a separate thread,
+// down to the given depth (i.e. at most 2^depth threads)
+constexpr int ParallelBuildThreshold = 4096;
+constexpr int MaxParallelDepth = 3;
+
+float surface_area(const AABB& box)
+{
+  const QVector3D d = box.max - box.min;
+
+  if (d.x() < 0 || d.y() < 0 || d.z() < 0)
+  {
+    return 0;
+  }
+
+  return 2.f * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+}
+
+bool overlaps(const AABB& a, const AABB& b)
+{
+  return a.min.x() <= b.max.x() && b.min.x() <= a.max.x()
+    && a.min.y() <= b.max.y() && b.min.y() <= a.max.y()
+    && a.min.z() <= b.max.z() && b.min.z() <= a.max.z();
+}
+
+enum class Containment
+{
+  Outside,
+  Intersecting,
+  Inside,
+};
+
+Containment classify(const FrustumPlanes& frustum, const AABB& box)
+{
+  const QVector3D c = box.center();
+  const QVector3D e = 0.5f * (box.max - box.min);
+  bool intersecting = false;
+
+  for (const QVector4D& p : frustum.planes())
+  {
+    const float d = p.x() * c.x() + p.y() * c.y() + p.z() * c.z() + p.w();
+    const float r = std::abs(p.x()) * e.x() + std::abs(p.y()) * e.y() + std::abs(p.z()) * e.z();
+
+    if (d + r < 0)
+    {
+      return Containment::Outside;
+    }
+
+    intersecting = intersecting || d - r < 0;
+  }
+
+  return intersecting ? Containment::Intersecting : Containment::Inside;
+}
+
+class BvhBuilder
+{
+public:
+  using Node = BoundingVolumeHierarchy::Node;
+
+  BvhBuilder(const std::vector<AABB>& boxes, std::vector<int>& items) :
+    m_boxes(boxes),
+    m_items(items)
+  {
+    m_centroids.reserve(boxes.size());
+
+    for (const AABB& box : boxes)
+    {
+      m_centroids.push_back(box.center());
+    }
+  }
+
+  /**
+   * @brief builds the subtree of the items in [begin, end)
+   *
+   * The subtree_end of the returned nodes is relative to the first node.
+   * Subtrees of disjoint ranges can be built concurrently.
+   */
+  std::vector<Node> build(int begin, int end, int depth)
+  {
+    Node node;
+    node.first_item = begin;
+    node.item_count = end - begin;
+    node.subtree_end = 1;
+
+    AABB centroid_bounds;
+
+    for (int i = begin; i < end; ++i)
+    {
+      node.bbox = united(node.bbox, m_boxes[m_items[i]]);
+      centroid_bounds.extend(m_centroids[m_items[i]]);
+    }
+
+    if (node.item_count <= 2)
+    {
+      return { node };
+    }
+
+    const int mid = split(begin, end, node, centroid_bounds);
+
+    if (mid == begin)
+    {
+      return { node };
+    }
+
+    std::vector<Node> left;
+    std::vector<Node> right;
+
+    if (node.item_count > ParallelBuildThreshold && depth < MaxParallelDepth)
+    {
+      auto future = std::async(std::launch::async, [this, mid, end, depth]() {
+        return build(mid, end, depth + 1);
+      });
+
+      left = build(begin, mid, depth + 1);
+      right = future.get();
+    }
+    else
+    {
+      left = build(begin, mid, depth + 1);
+      right = build(mid, end, depth + 1);
+    }
+
+    std::vector<Node> result;
+    result.reserve(1 + left.size() + right.size());
+    result.push_back(node);
+    append(result, left);
+    append(result, right);
+    result.front().subtree_end = static_cast<int>(result.size());
+    return result;
+  }
+
+private:
+  static void append(std::vector<Node>& nodes, const std::vector<Node>& subtree)
+  {
+    const int offset = static_cast<int>(nodes.size());
+
+    for (Node n : subtree)
+    {
+      n.subtree_end += offset;
+      nodes.push_back(n);
+    }
+  }
+
+  /**
+   * @brief partitions the items in [begin, end) in two
+   * @return the start of the second half, or begin if the node should be a leaf
+   *
+   * The split is chosen among BinCount candidate planes on each axis by
+   * minimizing the surface area heuristic.
+   */
+  int split(int begin, int end, const Node& node, const AABB& centroid_bounds)
+  {
+    struct Bin
+    {
+      AABB bbox;
+      int count = 0;
+    };
+
+    const int count = end - begin;
+    const QVector3D extent = centroid_bounds.max - centroid_bounds.min;
+
+    float best_cost = std::numeric_limits<float>::max();
+    int best_axis = -1;
+    int best_bin = 0;
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      if (extent[axis] <= 0)
+      {
+        continue;
+      }
+
+      std::array<Bin, BinCount> bins;
+      const float scale = BinCount / extent[axis];
+
+      for (int i = begin; i < end; ++i)
+      {
+        Bin& bin = bins[bin_index(m_centroids[m_items[i]][axis], centroid_bounds.min[axis], scale)];
+        bin.bbox = united(bin.bbox, m_boxes[m_items[i]]);
+        ++bin.count;
+      }
+
+      // sweep from the right to get the cost of every right half
+      std::array<float, BinCount> right_costs;
+      AABB right_box;
+      int right_count = 0;
+
+      for (int b = BinCount - 1; b > 0; --b)
+      {
+        right_box = united(right_box, bins[b].bbox);
+        right_count += bins[b].count;
+        right_costs[b] = right_count * surface_area(right_box);
+      }
+
+      AABB left_box;
+      int left_count = 0;
+
+      for (int b = 1; b < BinCount; ++b)
+      {
+        left_box = united(left_box, bins[b - 1].bbox);
+        left_count += bins[b - 1].count;
+
+        if (left_count == 0 || left_count == count)
+        {
+          continue;
+        }
+
+        const float cost = left_count * surface_area(left_box) + right_costs[b];
+
+        if (cost < best_cost)
+        {
+          best_cost = cost;
+          best_axis = axis;
+          best_bin = b;
+        }
+      }
+    }
+
+    const float leaf_cost = count * surface_area(node.bbox);
+
+    if (best_axis == -1 || best_cost >= leaf_cost)
+    {
+      if (count <= MaxLeafSize)
+      {
+        return begin;
+      }
+
+      if (best_axis == -1)
+      {
+        // all the centroids are at the same place
+        return begin + count / 2;
+      }
+    }
+
+    const float scale = BinCount / extent[best_axis];
+    const float min = centroid_bounds.min[best_axis];
+
+    auto it = std::partition(m_items.begin() + begin, m_items.begin() + end, [&](int item) {
+      return bin_index(m_centroids[item][best_axis], min, scale) < best_bin;
+    });
+
+    return static_cast<int>(it - m_items.begin());
+  }
+
+  static int bin_index(float value, float min, float scale)
+  {
+    return std::clamp(static_cast<int>((value - min) * scale), 0, BinCount - 1);
+  }
+
+private:
+  const std::vector<AABB>& m_boxes;
+  std::vector<int>& m_items;
+  std::vector<QVector3D> m_centroids;
+};
+
+} // namespace
+
+/**
+ * @brief builds the hierarchy
+ * @param boxes  the boxes, the index of a box is the identifier of its item
+ */
+void BoundingVolumeHierarchy::build(const std::vector<AABB>& boxes)
+{
+  m_boxes = boxes;
+  m_items.resize(boxes.size());
+  std::iota(m_items.begin(), m_items.end(), 0);
+  m_nodes.clear();
+
+  if (boxes.empty())
+  {
+    return;
+  }
+
+  BvhBuilder builder{ m_boxes, m_items };
+  m_nodes = builder.build(0, static_cast<int>(boxes.size()), 0);
+}
+
+/**
+ * @brief updates the bounds of the nodes after the boxes have moved
+ * @param boxes  the new boxes, there must be as many as when the hierarchy was built
+ *
+ * The structure of the hierarchy is kept, so the quality of the hierarchy
+ * decreases if the boxes move a lot; build() should then be called instead.
+ */
+void BoundingVolumeHierarchy::refit(const std::vector<AABB>& boxes)
+{
+  if (boxes.size() != m_boxes.size())
+  {
+    build(boxes);
+    return;
+  }
+
+  m_boxes = boxes;
+
+  // children come after their parent
+  for (int i = static_cast<int>(m_nodes.size()) - 1; i >= 0; --i)
+  {
+    Node& node = m_nodes[i];
+
+    if (isLeaf(i))
+    {
+      AABB bbox;
+
+      for (int j = node.first_item; j < node.first_item + node.item_count; ++j)
+      {
+        bbox = united(bbox, m_boxes[m_items[j]]);
+      }
+
+      node.bbox = bbox;
+    }
+    else
+    {
+      const Node& left = m_nodes[i + 1];
+      const Node& right = m_nodes[left.subtree_end];
+      node.bbox = united(left.bbox, right.bbox);
+    }
+  }
+}
+
+void BoundingVolumeHierarchy::clear()
+{
+  m_nodes.clear();
+  m_items.clear();
+  m_boxes.clear();
+}
+
+/**
+ * @brief computes which boxes intersect a frustum
+ * @param frustum     the frustum
+ * @param visibility  receives the result, indexed by item
+ *
+ * Subtrees entirely inside or outside of the frustum are accepted
+ * or rejected without visiting their nodes.
+ */
+void BoundingVolumeHierarchy::cull(const FrustumPlanes& frustum, VisibilityMask& visibility) const
+{
+  visibility.reset(m_boxes.size());
+
+  int i = 0;
+  const int n = static_cast<int>(m_nodes.size());
+
+  while (i < n)
+  {
+    const Node& node = m_nodes[i];
+    const Containment c = classify(frustum, node.bbox);
+
+    if (c == Containment::Outside)
+    {
+      i = node.subtree_end;
+    }
+    else if (c == Containment::Inside)
+    {
+      for (int j = node.first_item; j < node.first_item + node.item_count; ++j)
+      {
+        visibility.set(m_items[j]);
+      }
+
+      i = node.subtree_end;
+    }
+    else if (isLeaf(i))
+    {
+      for (int j = node.first_item; j < node.first_item + node.item_count; ++j)
+      {
+        const AABB& box = m_boxes[m_items[j]];
+
+        if (frustum.intersectsBox(box.min, box.max))
+        {
+          visibility.set(m_items[j]);
+        }
+      }
+
+      i = node.subtree_end;
+    }
+    else
+    {
+      ++i;
+    }
+  }
+}
+
+/**
+ * @brief finds the boxes that overlap a given box
+ * @param box     the box
+ * @param result  receives the items, in no particular order
+ */
+void BoundingVolumeHierarchy::query(const AABB& box, std::vector<int>& result) const
+{
+  int i = 0;
+  const int n = static_cast<int>(m_nodes.size());
+
+  while (i < n)
+  {
+    const Node& node = m_nodes[i];
+
+    if (!overlaps(node.bbox, box))
+    {
+      i = node.subtree_end;
+    }
+    else if (isLeaf(i))
+    {
+      for (int j = node.first_item; j < node.first_item + node.item_count; ++j)
+      {
+        if (overlaps(m_boxes[m_items[j]], box))
+        {
+          result.push_back(m_items[j]);
+        }
+      }
+
+      i = node.subtree_end;
+    }
+    else
+    {
+      ++i;
+    }
+  }
+}
@@ -0,0 +1,91 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "aabb.h"
+
+#include <cstddef>
+#include <vector>
+
+class FrustumPlanes;
+class VisibilityMask;
+
+/**
+ * @brief a bounding volume hierarchy over a set of axis-aligned bounding boxes
+ *
+ * The hierarchy is built with the surface area heuristic (SAH) and stored
+ * as a flat array of nodes in depth-first order: the left child of an interior
+ * node immediately follows it, and its right child starts where the subtree
+ * of the left child ends.
+ * The items (indices of the boxes) are reordered so that the items of every
+ * subtree are contiguous, which allows a whole subtree to be accepted at once.
+ *
+ * Large hierarchies are built in parallel.
+ * When the boxes move without changing much, refit() updates the bounds
+ * of the nodes without rebuilding the hierarchy.
+ */
+class BoundingVolumeHierarchy
+{
+public:
+  struct Node
+  {
+    AABB bbox;
+    int first_item = 0;  ///< index of the first item of the subtree in items()
+    int item_count = 0;  ///< number of items in the subtree
+    int subtree_end = 0; ///< index of the node following the subtree
+  };
+
+  BoundingVolumeHierarchy() = default;
+
+  void build(const std::vector<AABB>& boxes);
+  void refit(const std::vector<AABB>& boxes);
+  void clear();
+
+  bool empty() const;
+  size_t size() const;
+
+  const std::vector<Node>& nodes() const;
+  const std::vector<int>& items() const;
+  bool isLeaf(int node) const;
+
+  void cull(const FrustumPlanes& frustum, VisibilityMask& visibility) const;
+  void query(const AABB& box, std::vector<int>& result) const;
+
+private:
+  std::vector<Node> m_nodes;
+  std::vector<int> m_items;
+  std::vector<AABB> m_boxes;
+};
+
+/**
+ * @brief returns whether the hierarchy contains no boxes
+ */
+inline bool BoundingVolumeHierarchy::empty() const
+{
+  return m_boxes.empty();
+}
+
+/**
+ * @brief returns the number of boxes in the hierarchy
+ */
+inline size_t BoundingVolumeHierarchy::size() const
+{
+  return m_boxes.size();
+}
+
+inline const std::vector<BoundingVolumeHierarchy::Node>& BoundingVolumeHierarchy::nodes() const
+{
+  return m_nodes;
+}
+
+inline const std::vector<int>& BoundingVolumeHierarchy::items() const
+{
+  return m_items;
+}
+
+inline bool BoundingVolumeHierarchy::isLeaf(int node) const
+{
+  return m_nodes[node].subtree_end == node + 1;
+}
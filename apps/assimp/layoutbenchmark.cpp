@@ -0,0 +1,112 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "layoutbenchmark.h"
+
+#include "modeloptions.h"
+#include "q3dmodel.h"
+
+#include "appcommon/offscreen.h"
+
+#include <qmlgl/window.h>
+
+#include <QCommandLineParser>
+#include <QThreadPool>
+
+#include <QDebug>
+
+#include <algorithm>
+#include <utility>
+
+/**
+ * @brief adds the options of the vertex layout benchmark to a command line parser
+ *
+ * The following options are added:
+ * - "benchmark-layout <n>": renders the model n times offscreen with each vertex layout,
+ *   prints the frame statistics and exits
+ */
+void add_layout_benchmark_options(QCommandLineParser& parser)
+{
+  parser.addOption(QCommandLineOption("benchmark-layout", "Renders <n> frames offscreen with each vertex layout, prints the frame statistics and exits.", "n"));
+}
+
+/**
+ * @brief reads the options of the vertex layout benchmark from a command line parser
+ */
+LayoutBenchmarkOptions layout_benchmark_options(const QCommandLineParser& parser)
+{
+  LayoutBenchmarkOptions result;
+
+  result.enabled = parser.isSet("benchmark-layout");
+
+  if (result.enabled)
+  {
+    result.frames = std::max(parser.value("benchmark-layout").toInt(), 1);
+  }
+
+  return result;
+}
+
+/**
+ * @brief compares the rendering performance of the vertex layouts
+ * @param window     a window constructed in Window::Offscreen mode
+ * @param model      the model, already loaded
+ * @param offscreen  the offscreen options, the frames are rendered for each layout
+ * @return the exit code of the application
+ *
+ * The meshes are drawn one by one, as the layout does not apply to
+ * ModelDrawMode::MultiDrawIndirect, and the scene is rendered on every frame.
+ * After each change of layout, frames are rendered until the buffers and
+ * the textures are created again; only the following frames are measured.
+ */
+int run_layout_benchmark(Window& window, Q3dModel& model, const OffscreenOptions& offscreen)
+{
+  const std::pair<VertexLayout, const char*> layouts[] = {
+    { VertexLayout::Separate, "separate" },
+    { VertexLayout::Interleaved, "interleaved" },
+    { VertexLayout::Compact, "compact" },
+  };
+
+  window.setRenderOnDemand(false);
+
+  for (const auto& layout : layouts)
+  {
+    ModelOptions options = model.options();
+    options.vertex_layout = layout.first;
+    options.draw_mode = ModelDrawMode::PerMesh;
+    model.setOptions(options);
+
+    // the textures are decoded in the thread pool and uploaded by render tasks
+    do
+    {
+      QThreadPool::globalInstance()->waitForDone();
+
+      if (!window.renderOffscreenFrames(1))
+      {
+        qCritical() << "offscreen rendering failed";
+        return 1;
+      }
+    } while (window.hasPendingRenderTasks() || QThreadPool::globalInstance()->activeThreadCount() > 0);
+
+    qInfo().noquote() << QString("vertex layout: %1").arg(layout.second);
+
+    if (const int result = run_offscreen(window, offscreen))
+    {
+      return result;
+    }
+
+    // delivered to the model along with the frame statistics
+    const ModelRenderStatistics& stats = model.renderStatistics();
+    qInfo().noquote() << QString("  meshes: %1 drawn, %2 culled  triangles: %3  draw calls: %4  program changes: %5  texture changes: %6  vao changes: %7")
+      .arg(stats.drawn_meshes)
+      .arg(stats.culled_meshes)
+      .arg(stats.drawn_triangles)
+      .arg(stats.draw_calls)
+      .arg(stats.program_changes)
+      .arg(stats.texture_changes)
+      .arg(stats.vao_changes);
+  }
+
+  return 0;
+}
@@ -0,0 +1,29 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+class QCommandLineParser;
+
+class Q3dModel;
+class Window;
+
+struct OffscreenOptions;
+
+/**
+ * @brief options for comparing the rendering performance of the vertex layouts
+ *
+ * When enabled, the model is rendered offscreen with each vertex layout,
+ * the frame statistics are printed and the application exits.
+ */
+struct LayoutBenchmarkOptions
+{
+  bool enabled = false;
+  int frames = 1; ///< frames rendered with each layout
+};
+
+void add_layout_benchmark_options(QCommandLineParser& parser);
+LayoutBenchmarkOptions layout_benchmark_options(const QCommandLineParser& parser);
+
+int run_layout_benchmark(Window& window, Q3dModel& model, const OffscreenOptions& offscreen);
@@ -0,0 +1,400 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "loadbenchmark.h"
+
+#include "attributeconversion.h"
+#include "modelloader.h"
+#include "modeloptions.h"
+#include "parallel.h"
+
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <QTextStream>
+
+#include <QDebug>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+
+// resolution of the spheres of the synthetic scene
+constexpr int SyntheticSlices = 16;
+constexpr int SyntheticStacks = 8;
+constexpr int SyntheticMaterials = 16;
+
+/**
+ * @brief writes a scene made of many small spheres in the OBJ format
+ * @param dir    the directory in which the .obj and .mtl files are written
+ * @param meshes the number of spheres
+ * @return the path of the .obj file, or an empty string on failure
+ *
+ * Each sphere is a separate object, and therefore a separate mesh once
+ * loaded, so that the scene stresses the per-mesh work of the loader.
+ */
+QString write_synthetic_scene(const QDir& dir, int meshes)
+{
+  QFile mtl_file{ dir.filePath("synthetic.mtl") };
+
+  if (!mtl_file.open(QIODevice::WriteOnly | QIODevice::Text))
+  {
+    return QString();
+  }
+
+  QTextStream mtl{ &mtl_file };
+
+  for (int i(0); i < SyntheticMaterials; ++i)
+  {
+    mtl << "newmtl material" << i << "\n";
+    mtl << "Kd " << (i % 4) / 3.f << " " << (i / 4) / 3.f << " 0.5\n\n";
+  }
+
+  QFile obj_file{ dir.filePath("synthetic.obj") };
+
+  if (!obj_file.open(QIODevice::WriteOnly | QIODevice::Text))
+  {
+    return QString();
+  }
+
+  QTextStream obj{ &obj_file };
+  obj << "mtllib synthetic.mtl\n";
+
+  const int grid_size = static_cast<int>(std::ceil(std::sqrt(float(meshes))));
+  const float pi = 3.14159265f;
+  int first_vertex = 1;
+
+  for (int m(0); m < meshes; ++m)
+  {
+    const float cx = 3.f * (m % grid_size);
+    const float cy = 3.f * (m / grid_size);
+
+    obj << "o sphere" << m << "\n";
+    obj << "usemtl material" << (m % SyntheticMaterials) << "\n";
+
+    for (int j(0); j <= SyntheticStacks; ++j)
+    {
+      const float theta = pi * j / SyntheticStacks;
+
+      for (int i(0); i <= SyntheticSlices; ++i)
+      {
+        const float phi = 2 * pi * i / SyntheticSlices;
+        const float x = std::sin(theta) * std::cos(phi);
+        const float y = std::sin(theta) * std::sin(phi);
+        const float z = std::cos(theta);
+        obj << "v " << (cx + x) << " " << (cy + y) << " " << z << "\n";
+        obj << "vn " << x << " " << y << " " << z << "\n";
+      }
+    }
+
+    for (int j(0); j < SyntheticStacks; ++j)
+    {
+      for (int i(0); i < SyntheticSlices; ++i)
+      {
+        const int a = first_vertex + j * (SyntheticSlices + 1) + i;
+        const int b = a + SyntheticSlices + 1;
+        obj << "f " << a << "//" << a << " " << b << "//" << b << " " << (b + 1) << "//" << (b + 1) << "\n";
+        obj << "f " << a << "//" << a << " " << (b + 1) << "//" << (b + 1) << " " << (a + 1) << "//" << (a + 1) << "\n";
+      }
+    }
+
+    first_vertex += (SyntheticStacks + 1) * (SyntheticSlices + 1);
+  }
+
+  obj.flush();
+  mtl.flush();
+
+  return obj.status() == QTextStream::Ok && mtl.status() == QTextStream::Ok ? obj_file.fileName() : QString();
+}
+
+struct LoadTimes
+{
+  double min = 0;
+  double median = 0;
+  int meshes = 0;
+  size_t triangles = 0;
+};
+
+LoadTimes benchmark_load(const QString& file, const ModelOptions& options, int iterations, size_t max_threads, const QString& cache_dir = QString())
+{
+  std::vector<double> times;
+  LoadTimes result;
+
+  for (int i(0); i < iterations; ++i)
+  {
+    ModelLoader loader;
+    configure_loader(loader, options);
+    loader.setMaxThreads(max_threads);
+    loader.setCacheDirectory(cache_dir);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    std::unique_ptr<Model> model = loader.load(file);
+
+    times.push_back(timer.nsecsElapsed() / 1e6);
+
+    result.meshes = model->meshCount();
+    result.triangles = 0;
+
+    for (int j(0); j < model->meshCount(); ++j)
+    {
+      result.triangles += model->getMesh(j)->indices.size() / 3;
+    }
+  }
+
+  std::sort(times.begin(), times.end());
+  result.min = times.front();
+  result.median = times[times.size() / 2];
+
+  return result;
+}
+
+// number of vertices and of repetitions of the conversion benchmark
+constexpr size_t ConversionVertices = 1 << 20;
+constexpr int ConversionIterations = 20;
+
+/**
+ * @brief returns the median throughput of a conversion, in millions of vertices per second
+ */
+double conversion_throughput(const std::function<void()>& convert)
+{
+  std::vector<double> times;
+
+  for (int i(0); i < ConversionIterations; ++i)
+  {
+    QElapsedTimer timer;
+    timer.start();
+    convert();
+    times.push_back(timer.nsecsElapsed() / 1e9);
+  }
+
+  std::sort(times.begin(), times.end());
+  return ConversionVertices / std::max(times[times.size() / 2], 1e-9) / 1e6;
+}
+
+void print_throughput(const char* name, double per_element, double bulk)
+{
+  qInfo().noquote() << QString("  %1  per-element: %2 Mvertices/s  bulk: %3 Mvertices/s  speedup: %4x")
+    .arg(name, -9)
+    .arg(per_element, 0, 'f', 1)
+    .arg(bulk, 0, 'f', 1)
+    .arg(bulk / std::max(per_element, 1e-9), 0, 'f', 2);
+}
+
+} // namespace
+
+/**
+ * @brief adds the options controlling the load benchmark to a command line parser
+ *
+ * The following options are added:
+ * - "benchmark-load <n>": loads each model n times, prints the load times and exits
+ * - "benchmark-synthetic-meshes <n>": number of meshes of the synthetic scene (default 2000)
+ * - "benchmark-conversion": measures the throughput of the vertex attribute conversion and exits
+ */
+void add_load_benchmark_options(QCommandLineParser& parser)
+{
+  parser.addOption(QCommandLineOption("benchmark-load", "Loads each model <n> times, prints the load times and exits.", "n"));
+  parser.addOption(QCommandLineOption("benchmark-conversion", "Measures the throughput of the vertex attribute conversion and exits."));
+  parser.addOption(QCommandLineOption("benchmark-synthetic-meshes", "Number of meshes of the synthetic scene of the load benchmark.", "n", "2000"));
+}
+
+/**
+ * @brief reads the load benchmark options from a command line parser
+ *
+ * The benchmark is enabled if the "benchmark-load" option is set.
+ */
+LoadBenchmarkOptions load_benchmark_options(const QCommandLineParser& parser)
+{
+  LoadBenchmarkOptions result;
+
+  if (parser.isSet("benchmark-load"))
+  {
+    result.enabled = true;
+    result.iterations = std::max(parser.value("benchmark-load").toInt(), 1);
+  }
+
+  result.synthetic_meshes = std::max(parser.value("benchmark-synthetic-meshes").toInt(), 1);
+  result.conversion = parser.isSet("benchmark-conversion");
+
+  return result;
+}
+
+/**
+ * @brief measures the time taken to load models
+ * @param files         the models to load; if empty, the bundled models and a synthetic scene are used
+ * @param options       the benchmark options
+ * @param modelOptions  the options with which the models are loaded
+ * @return the exit code of the application
+ *
+ * Each model is loaded with a single thread and with all the cores, without
+ * the model cache, and then from a temporary model cache.
+ * The whole loading is measured: assimp import, conversion and, if enabled,
+ * optimization of the meshes.
+ */
+int run_load_benchmark(QStringList files, const LoadBenchmarkOptions& options, const ModelOptions& modelOptions)
+{
+  QTemporaryDir synthetic_dir;
+  QTemporaryDir cache_dir;
+
+  if (!cache_dir.isValid())
+  {
+    qCritical() << "could not create a temporary cache directory";
+    return 1;
+  }
+
+  if (files.isEmpty())
+  {
+    const QDir models_dir{ QMLGL_ASSIMP_MODELS_DIR };
+    files << models_dir.filePath("crash/crash.obj") << models_dir.filePath("zeppelin/zeppelin.obj");
+
+    const QString synthetic = synthetic_dir.isValid() ? write_synthetic_scene(QDir(synthetic_dir.path()), options.synthetic_meshes) : QString();
+
+    if (synthetic.isEmpty())
+    {
+      qCritical() << "could not write the synthetic scene";
+      return 1;
+    }
+
+    files << synthetic;
+  }
+
+  const size_t cores = parallel_thread_count(std::numeric_limits<size_t>::max());
+
+  for (const QString& file : files)
+  {
+    try
+    {
+      const LoadTimes sequential = benchmark_load(file, modelOptions, options.iterations, 1);
+      const LoadTimes parallel = benchmark_load(file, modelOptions, options.iterations, 0);
+
+      // the first load writes the cache, the others read it
+      benchmark_load(file, modelOptions, 1, 0, cache_dir.path());
+      const LoadTimes cached = benchmark_load(file, modelOptions, options.iterations, 0, cache_dir.path());
+
+      qInfo().noquote() << QString("%1: %2 meshes, %3 triangles")
+        .arg(QFileInfo(file).fileName())
+        .arg(parallel.meshes)
+        .arg(parallel.triangles);
+      qInfo().noquote() << QString("  1 thread   min: %1 ms  median: %2 ms")
+        .arg(sequential.min, 0, 'f', 1)
+        .arg(sequential.median, 0, 'f', 1);
+      qInfo().noquote() << QString("  %1 threads  min: %2 ms  median: %3 ms  speedup: %4x")
+        .arg(cores, -2)
+        .arg(parallel.min, 0, 'f', 1)
+        .arg(parallel.median, 0, 'f', 1)
+        .arg(sequential.median / std::max(parallel.median, 1e-3), 0, 'f', 2);
+      qInfo().noquote() << QString("  cached     min: %1 ms  median: %2 ms  speedup: %3x")
+        .arg(cached.min, 0, 'f', 1)
+        .arg(cached.median, 0, 'f', 1)
+        .arg(sequential.median / std::max(cached.median, 1e-3), 0, 'f', 2);
+    }
+    catch (const std::runtime_error& ex)
+    {
+      qCritical() << "could not load" << file << ":" << ex.what();
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * @brief measures the throughput of the conversion of the vertex attributes
+ * @return the exit code of the application
+ *
+ * The bulk conversion functions of attributeconversion.h are compared to
+ * the conversion of one element at a time into a growing vector, which is
+ * how the meshes used to be converted.
+ */
+int run_conversion_benchmark()
+{
+  std::vector<float> xyz(3 * ConversionVertices);
+  std::vector<float> rgba(4 * ConversionVertices);
+
+  for (size_t i(0); i < xyz.size(); ++i)
+  {
+    xyz[i] = std::sin(float(i));
+  }
+
+  for (size_t i(0); i < rgba.size(); ++i)
+  {
+    rgba[i] = 0.5f + 0.5f * std::cos(float(i));
+  }
+
+  std::vector<QVector3D> positions;
+  std::vector<QVector2D> uv;
+  std::vector<RgbColor> colors;
+
+  qInfo().noquote() << QString("conversion of %1 vertices (median of %2 runs):").arg(ConversionVertices).arg(ConversionIterations);
+
+  const double positions_per_element = conversion_throughput([&]() {
+    positions.clear();
+    positions.shrink_to_fit();
+
+    for (size_t i(0); i < ConversionVertices; ++i)
+    {
+      positions.push_back(QVector3D(xyz[3 * i], xyz[3 * i + 1], xyz[3 * i + 2]));
+    }
+  });
+
+  const double positions_bulk = conversion_throughput([&]() {
+    positions.clear();
+    positions.shrink_to_fit();
+    positions.resize(ConversionVertices);
+    convert_vec3(xyz.data(), ConversionVertices, positions.data());
+  });
+
+  print_throughput("positions", positions_per_element, positions_bulk);
+
+  const double uv_per_element = conversion_throughput([&]() {
+    uv.clear();
+    uv.shrink_to_fit();
+
+    for (size_t i(0); i < ConversionVertices; ++i)
+    {
+      uv.push_back(QVector2D(xyz[3 * i], xyz[3 * i + 1]));
+    }
+  });
+
+  const double uv_bulk = conversion_throughput([&]() {
+    uv.clear();
+    uv.shrink_to_fit();
+    uv.resize(ConversionVertices);
+    convert_texcoords(xyz.data(), ConversionVertices, uv.data());
+  });
+
+  print_throughput("uv", uv_per_element, uv_bulk);
+
+  const double colors_per_element = conversion_throughput([&]() {
+    colors.clear();
+    colors.shrink_to_fit();
+
+    for (size_t i(0); i < ConversionVertices; ++i)
+    {
+      colors.push_back(RgbColor(rgba[4 * i], rgba[4 * i + 1], rgba[4 * i + 2]));
+    }
+  });
+
+  const double colors_bulk = conversion_throughput([&]() {
+    colors.clear();
+    colors.shrink_to_fit();
+    colors.resize(ConversionVertices);
+    convert_colors(rgba.data(), ConversionVertices, colors.data());
+  });
+
+  print_throughput("colors", colors_per_element, colors_bulk);
+
+  return 0;
+}
@@ -0,0 +1,32 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include <QStringList>
+
+struct ModelOptions;
+
+class QCommandLineParser;
+
+/**
+ * @brief options for benchmarking the loading of models
+ *
+ * When enabled, each model is loaded a given number of times with a single
+ * thread, with all the cores and from the model cache, the load times are
+ * printed and the application exits without opening a window.
+ */
+struct LoadBenchmarkOptions
+{
+  bool enabled = false;
+  int iterations = 5;
+  int synthetic_meshes = 2000;
+  bool conversion = false; ///< measure the throughput of the vertex attribute conversion instead
+};
+
+void add_load_benchmark_options(QCommandLineParser& parser);
+LoadBenchmarkOptions load_benchmark_options(const QCommandLineParser& parser);
+
+int run_load_benchmark(QStringList files, const LoadBenchmarkOptions& options, const ModelOptions& modelOptions);
+int run_conversion_benchmark();
@@ -7,11 +7,19 @@
 #include "q3dmodelcontroller.h"
 
 #include "bboxsidecamera.h"
+#include "layoutbenchmark.h"
+#include "loadbenchmark.h"
+#include "modeloptions.h"
 
 #include "appcommon/appwindow.h"
+#include "appcommon/offscreen.h"
 
+#include <QCommandLineParser>
+#include <QEventLoop>
 #include <QGuiApplication>
 
+#include <QDebug>
+
 int main(int argc, char *argv[])
 {
   QGuiApplication app{ argc, argv };
@@ -19,16 +27,87 @@ int main(int argc, char *argv[])
   qmlRegisterType<OrthographicCameraController>("Assimp", 1, 0, "OrthographicCameraController");
   qmlRegisterType<BboxSideCameraController>("Assimp", 1, 0, "BboxSideCameraController");
 
-  AppWindow w{ OpenGLSceneFactory::factoryFor<AssimpScene>() };
+  QCommandLineParser parser;
+  parser.addHelpOption();
+  parser.addPositionalArgument("model", "The model to open, or the models to load with --benchmark-load.", "[model...]");
+  add_offscreen_options(parser);
+  add_layout_benchmark_options(parser);
+  add_load_benchmark_options(parser);
+  add_model_options(parser);
+  parser.process(app);
+
+  const LoadBenchmarkOptions benchmark = load_benchmark_options(parser);
+
+  if (benchmark.conversion)
+  {
+    return run_conversion_benchmark();
+  }
+
+  if (benchmark.enabled)
+  {
+    return run_load_benchmark(parser.positionalArguments(), benchmark, model_options(parser));
+  }
+
+  OffscreenOptions offscreen = offscreen_options(parser);
+  const LayoutBenchmarkOptions layout_benchmark = layout_benchmark_options(parser);
+
+  if (layout_benchmark.enabled)
+  {
+    if (parser.positionalArguments().isEmpty())
+    {
+      qCritical() << "--benchmark-layout requires a model";
+      return 1;
+    }
+
+    offscreen.enabled = true;
+    offscreen.frames = layout_benchmark.frames;
+  }
+
+  AppWindow w{ OpenGLSceneFactory::factoryFor<AssimpScene>(), offscreen.enabled ? Window::Offscreen : Window::OnScreen };
 
   auto* model = new Q3dModel(&w);
+  model->setOptions(model_options(parser));
   auto* controller = new Q3dModelController(*model, &w);
 
+  w.setRenderOnDemand(true);
+  w.setDynamicResolution(true);
+  QObject::connect(model, &Q3dModel::modelChanged, &w, &Window::requestSceneUpdate);
+
   w.exposeQObjectToQml(model, "q_3dmodel");
   w.exposeQObjectToQml(controller, "q_3dmodel_controller");
 
   w.setSource(QUrl("qrc:/qml/MainWindow.qml"));
 
+  if (!parser.positionalArguments().isEmpty())
+  {
+    controller->openModel(QUrl::fromLocalFile(parser.positionalArguments().front()));
+  }
+
+  if (offscreen.enabled)
+  {
+    // the model is loaded in the background, but the rendered frames must include it
+    QEventLoop loop;
+    QObject::connect(model, &Q3dModel::loadingChanged, &loop, &QEventLoop::quit);
+
+    while (model->loading())
+    {
+      loop.exec();
+    }
+
+    if (layout_benchmark.enabled)
+    {
+      if (!model->model())
+      {
+        qCritical() << "could not load" << parser.positionalArguments().front();
+        return 1;
+      }
+
+      return run_layout_benchmark(w, *model, offscreen);
+    }
+
+    return run_offscreen(w, offscreen);
+  }
+
   w.show();
 
   return app.exec();
@@ -0,0 +1,521 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "meshoptimization.h"
+
+#include "meshsimplification.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <numeric>
+#include <thread>
+
+namespace
+{
+
+// size of the FIFO cache used for measuring the ACMR
+constexpr int SimulatedCacheSize = 16;
+
+// parameters of the vertex scores, see Tom Forsyth's
+// "Linear-Speed Vertex Cache Optimisation"
+constexpr int ScoringCacheSize = 32;
+constexpr float CacheDecayPower = 1.5f;
+constexpr float LastTriangleScore = 0.75f;
+constexpr float ValenceBoostScale = 2.0f;
+constexpr float ValenceBoostPower = 0.5f;
+
+float vertex_score(int cache_position, int remaining_triangles)
+{
+  if (remaining_triangles == 0)
+  {
+    return -1.f;
+  }
+
+  float score = 0;
+
+  if (cache_position >= 0)
+  {
+    if (cache_position < 3)
+    {
+      // the vertices of the last triangle get a fixed score so that
+      // the next triangle does not favor them too much
+      score = LastTriangleScore;
+    }
+    else
+    {
+      const float s = 1.f - float(cache_position - 3) / (ScoringCacheSize - 3);
+      score = std::pow(s, CacheDecayPower);
+    }
+  }
+
+  // vertices with few remaining triangles are favored so that they
+  // are not left alone and transformed again later
+  return score + ValenceBoostScale * std::pow(float(remaining_triangles), -ValenceBoostPower);
+}
+
+/**
+ * @brief the triangles referencing each vertex, in compressed rows
+ */
+struct VertexAdjacency
+{
+  std::vector<int> offsets;
+  std::vector<int> triangles;
+
+  VertexAdjacency(const std::vector<int>& indices, size_t vertex_count) :
+    offsets(vertex_count + 1, 0),
+    triangles(indices.size())
+  {
+    for (int v : indices)
+    {
+      ++offsets[v + 1];
+    }
+
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+
+    for (size_t i(0); i < indices.size(); ++i)
+    {
+      triangles[fill[indices[i]]++] = static_cast<int>(i / 3);
+    }
+  }
+
+  int count(int v) const
+  {
+    return offsets[v + 1] - offsets[v];
+  }
+};
+
+QVector3D triangle_normal(const std::vector<QVector3D>& vertices, const int* tri)
+{
+  // the length of the cross product is twice the area of the triangle
+  return QVector3D::crossProduct(vertices[tri[1]] - vertices[tri[0]], vertices[tri[2]] - vertices[tri[0]]);
+}
+
+} // namespace
+
+/**
+ * @brief computes the average cache miss ratio of a list of triangles
+ * @param indices       the indices of the triangles
+ * @param vertex_count  the number of vertices
+ *
+ * A FIFO post-transform cache of 16 entries is simulated, which is a conservative
+ * approximation of the behavior of most GPUs.
+ */
+float simulate_vertex_cache(const std::vector<int>& indices, size_t vertex_count)
+{
+  if (indices.size() < 3)
+  {
+    return 0;
+  }
+
+  // a vertex is in the cache if less than SimulatedCacheSize vertices
+  // were inserted since it was
+  std::vector<size_t> insertion_time(vertex_count, 0);
+  size_t time = SimulatedCacheSize + 1;
+  size_t misses = 0;
+
+  for (int v : indices)
+  {
+    if (time - insertion_time[v] > SimulatedCacheSize)
+    {
+      insertion_time[v] = time++;
+      ++misses;
+    }
+  }
+
+  return float(misses) / float(indices.size() / 3);
+}
+
+/**
+ * @brief reorders triangles to maximize post-transform vertex cache hits
+ * @param indices       the indices of the triangles, reordered in place
+ * @param vertex_count  the number of vertices
+ *
+ * This implements Tom Forsyth's linear-speed algorithm: each vertex has a
+ * score that depends on its position in a simulated LRU cache and on the
+ * number of triangles that still reference it; the triangle with the best
+ * score among those adjacent to the cache is emitted next.
+ */
+void optimize_vertex_cache(std::vector<int>& indices, size_t vertex_count)
+{
+  const size_t triangle_count = indices.size() / 3;
+
+  if (triangle_count == 0)
+  {
+    return;
+  }
+
+  VertexAdjacency adjacency{ indices, vertex_count };
+
+  std::vector<int> remaining(vertex_count);
+  std::vector<int> cache_position(vertex_count, -1);
+  std::vector<float> vertex_scores(vertex_count);
+
+  for (size_t v(0); v < vertex_count; ++v)
+  {
+    remaining[v] = adjacency.count(static_cast<int>(v));
+    vertex_scores[v] = vertex_score(-1, remaining[v]);
+  }
+
+  std::vector<float> triangle_scores(triangle_count);
+  std::vector<bool> emitted(triangle_count, false);
+
+  for (size_t t(0); t < triangle_count; ++t)
+  {
+    triangle_scores[t] = vertex_scores[indices[3 * t]] + vertex_scores[indices[3 * t + 1]] + vertex_scores[indices[3 * t + 2]];
+  }
+
+  std::vector<int> result;
+  result.reserve(indices.size());
+
+  std::vector<int> cache;
+  std::vector<int> next_cache;
+  cache.reserve(ScoringCacheSize + 3);
+  next_cache.reserve(ScoringCacheSize + 3);
+
+  int best = static_cast<int>(std::max_element(triangle_scores.begin(), triangle_scores.end()) - triangle_scores.begin());
+  size_t next_unemitted = 0;
+
+  while (result.size() < triangle_count * 3)
+  {
+    if (best < 0)
+    {
+      // no triangle is adjacent to the cache, restart from the
+      // first triangle that was not emitted
+      while (emitted[next_unemitted])
+      {
+        ++next_unemitted;
+      }
+
+      best = static_cast<int>(next_unemitted);
+    }
+
+    emitted[best] = true;
+    next_cache.clear();
+
+    for (int k(0); k < 3; ++k)
+    {
+      const int v = indices[3 * best + k];
+      result.push_back(v);
+
+      if (std::find(next_cache.begin(), next_cache.end(), v) == next_cache.end())
+      {
+        next_cache.push_back(v);
+      }
+
+      // the triangle is moved past the remaining triangles of the vertex
+      int* first = adjacency.triangles.data() + adjacency.offsets[v];
+      int* last = first + remaining[v];
+      std::swap(*std::find(first, last, best), *(last - 1));
+      --remaining[v];
+    }
+
+    const size_t triangle_vertices = next_cache.size();
+
+    for (int v : cache)
+    {
+      if (std::find(next_cache.begin(), next_cache.begin() + triangle_vertices, v) == next_cache.begin() + triangle_vertices)
+      {
+        next_cache.push_back(v);
+      }
+    }
+
+    // the scores of the vertices that entered, moved in or left the cache
+    // are updated, together with the scores of their remaining triangles
+    for (size_t i(0); i < next_cache.size(); ++i)
+    {
+      const int v = next_cache[i];
+      cache_position[v] = i < size_t(ScoringCacheSize) ? static_cast<int>(i) : -1;
+
+      const float score = vertex_score(cache_position[v], remaining[v]);
+      const float delta = score - vertex_scores[v];
+      vertex_scores[v] = score;
+
+      for (int j(0); j < remaining[v]; ++j)
+      {
+        triangle_scores[adjacency.triangles[adjacency.offsets[v] + j]] += delta;
+      }
+    }
+
+    if (next_cache.size() > size_t(ScoringCacheSize))
+    {
+      next_cache.resize(ScoringCacheSize);
+    }
+
+    std::swap(cache, next_cache);
+
+    best = -1;
+    float best_score = -1.f;
+
+    for (int v : cache)
+    {
+      for (int j(0); j < remaining[v]; ++j)
+      {
+        const int t = adjacency.triangles[adjacency.offsets[v] + j];
+
+        if (triangle_scores[t] > best_score)
+        {
+          best = t;
+          best_score = triangle_scores[t];
+        }
+      }
+    }
+  }
+
+  indices.swap(result);
+}
+
+/**
+ * @brief reorders clusters of triangles so that occluders are drawn first
+ * @param indices   the indices of the triangles, optimized for the vertex cache
+ * @param vertices  the positions of the vertices
+ *
+ * This follows the approximation of Sander et al. ("Fast Triangle Reordering
+ * for Vertex Locality and Reduced Overdraw"): the triangles are split into
+ * clusters at the triangles whose three vertices miss the cache, so that
+ * reordering the clusters does not change the ACMR much; the clusters facing
+ * away from the center of the mesh are drawn first as they are the most
+ * likely to occlude the others.
+ */
+void optimize_overdraw(std::vector<int>& indices, const std::vector<QVector3D>& vertices)
+{
+  const size_t triangle_count = indices.size() / 3;
+
+  if (triangle_count == 0)
+  {
+    return;
+  }
+
+  std::vector<size_t> cluster_starts;
+
+  {
+    std::vector<size_t> insertion_time(vertices.size(), 0);
+    size_t time = SimulatedCacheSize + 1;
+
+    for (size_t t(0); t < triangle_count; ++t)
+    {
+      int misses = 0;
+
+      for (int k(0); k < 3; ++k)
+      {
+        const int v = indices[3 * t + k];
+
+        if (time - insertion_time[v] > SimulatedCacheSize)
+        {
+          insertion_time[v] = time++;
+          ++misses;
+        }
+      }
+
+      if (t == 0 || misses == 3)
+      {
+        cluster_starts.push_back(t);
+      }
+    }
+
+    cluster_starts.push_back(triangle_count);
+  }
+
+  const size_t cluster_count = cluster_starts.size() - 1;
+
+  if (cluster_count < 2)
+  {
+    return;
+  }
+
+  // the centroids are weighted by the area of the triangles
+  QVector3D mesh_centroid;
+  float mesh_area = 0;
+  std::vector<QVector3D> cluster_centroids(cluster_count);
+  std::vector<QVector3D> cluster_normals(cluster_count);
+
+  for (size_t c(0); c < cluster_count; ++c)
+  {
+    QVector3D centroid;
+    QVector3D normal;
+    float area = 0;
+
+    for (size_t t = cluster_starts[c]; t < cluster_starts[c + 1]; ++t)
+    {
+      const int* tri = indices.data() + 3 * t;
+      const QVector3D n = triangle_normal(vertices, tri);
+      const float a = n.length();
+
+      centroid += a * (vertices[tri[0]] + vertices[tri[1]] + vertices[tri[2]]) / 3.f;
+      normal += n;
+      area += a;
+    }
+
+    mesh_centroid += centroid;
+    mesh_area += area;
+
+    cluster_centroids[c] = area > 0 ? centroid / area : centroid;
+    cluster_normals[c] = normal.normalized();
+  }
+
+  if (mesh_area > 0)
+  {
+    mesh_centroid /= mesh_area;
+  }
+
+  std::vector<float> sort_keys(cluster_count);
+
+  for (size_t c(0); c < cluster_count; ++c)
+  {
+    sort_keys[c] = QVector3D::dotProduct(cluster_centroids[c] - mesh_centroid, cluster_normals[c]);
+  }
+
+  std::vector<size_t> order(cluster_count);
+  std::iota(order.begin(), order.end(), size_t(0));
+  std::stable_sort(order.begin(), order.end(), [&sort_keys](size_t a, size_t b) {
+    return sort_keys[a] > sort_keys[b];
+  });
+
+  std::vector<int> result;
+  result.reserve(indices.size());
+
+  for (size_t c : order)
+  {
+    result.insert(result.end(), indices.begin() + 3 * cluster_starts[c], indices.begin() + 3 * cluster_starts[c + 1]);
+  }
+
+  indices.swap(result);
+}
+
+namespace
+{
+
+template<typename T>
+void remap_attribute(std::vector<T>& values, const std::vector<int>& new_to_old)
+{
+  if (values.empty())
+  {
+    return;
+  }
+
+  std::vector<T> result;
+  result.reserve(new_to_old.size());
+
+  for (int old_index : new_to_old)
+  {
+    result.push_back(values[old_index]);
+  }
+
+  values.swap(result);
+}
+
+} // namespace
+
+/**
+ * @brief reorders the vertices of a mesh in the order in which they are first referenced
+ * @param mesh  the mesh
+ *
+ * This makes the fetches of the vertex attributes mostly sequential.
+ * Vertices that are not referenced by any triangle are removed.
+ */
+void optimize_vertex_fetch(model::Mesh& mesh)
+{
+  std::vector<int> old_to_new(mesh.vertices.size(), -1);
+  std::vector<int> new_to_old;
+  new_to_old.reserve(mesh.vertices.size());
+
+  for (int& index : mesh.indices)
+  {
+    if (old_to_new[index] < 0)
+    {
+      old_to_new[index] = static_cast<int>(new_to_old.size());
+      new_to_old.push_back(index);
+    }
+
+    index = old_to_new[index];
+  }
+
+  remap_attribute(mesh.vertices, new_to_old);
+  remap_attribute(mesh.colors, new_to_old);
+  remap_attribute(mesh.uv, new_to_old);
+  remap_attribute(mesh.normals, new_to_old);
+}
+
+/**
+ * @brief optimizes the triangle and vertex order of a mesh
+ * @param mesh     the mesh
+ * @param options  the optimizations to perform
+ *
+ * The triangles are reordered for the vertex cache and then for overdraw,
+ * after which the vertices are reordered for fetch locality.
+ * The levels of detail are generated from the reordered mesh.
+ */
+MeshOptimizationStatistics optimize_mesh(model::Mesh& mesh, const MeshOptimizationOptions& options)
+{
+  MeshOptimizationStatistics stats;
+  stats.triangles = mesh.indices.size() / 3;
+  stats.acmr_before = simulate_vertex_cache(mesh.indices, mesh.vertices.size());
+
+  if (options.reorder)
+  {
+    optimize_vertex_cache(mesh.indices, mesh.vertices.size());
+    optimize_overdraw(mesh.indices, mesh.vertices);
+    optimize_vertex_fetch(mesh);
+  }
+
+  if (options.generate_lods)
+  {
+    generate_lods(mesh);
+    stats.lods = mesh.lods.size();
+  }
+
+  stats.acmr_after = simulate_vertex_cache(mesh.indices, mesh.vertices.size());
+  return stats;
+}
+
+/**
+ * @brief optimizes several meshes in parallel
+ * @param meshes   the meshes
+ * @param options  the optimizations to perform
+ * @param progress called with the number of meshes optimized so far, may be empty
+ * @return the statistics over all the meshes, the ACMR being weighted by the number of triangles
+ *
+ * The progress callback is only called in the calling thread, after each
+ * mesh it optimizes; if it throws, the meshes that are not started yet are
+ * skipped and the exception is rethrown.
+ */
+MeshOptimizationStatistics optimize_meshes(const std::vector<model::Mesh*>& meshes, const MeshOptimizationOptions& options,
+  const std::function<void(size_t)>& progress)
+{
+  std::vector<MeshOptimizationStatistics> mesh_stats(meshes.size());
+  std::atomic<size_t> optimized{ 0 };
+  const std::thread::id caller = std::this_thread::get_id();
+
+  parallel_for(meshes.size(), [&meshes, &mesh_stats, &options, &progress, &optimized, caller](size_t i) {
+    mesh_stats[i] = optimize_mesh(*meshes[i], options);
+
+    const size_t n = ++optimized;
+
+    if (progress && std::this_thread::get_id() == caller)
+    {
+      progress(n);
+    }
+  }, options.max_threads);
+
+  MeshOptimizationStatistics result;
+
+  for (const MeshOptimizationStatistics& s : mesh_stats)
+  {
+    result.triangles += s.triangles;
+    result.acmr_before += s.acmr_before * s.triangles;
+    result.acmr_after += s.acmr_after * s.triangles;
+    result.lods += s.lods;
+  }
+
+  if (result.triangles > 0)
+  {
+    result.acmr_before /= result.triangles;
+    result.acmr_after /= result.triangles;
+  }
+
+  return result;
+}
@@ -0,0 +1,42 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "model.h"
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/**
+ * @brief average cache miss ratios of a mesh before and after optimization
+ *
+ * The ACMR is the number of vertices transformed per triangle, as measured
+ * by simulate_vertex_cache(); it ranges from 0.5 (ideal) to 3.
+ */
+struct MeshOptimizationStatistics
+{
+  size_t triangles = 0;
+  float acmr_before = 0;
+  float acmr_after = 0;
+  size_t lods = 0; ///< number of levels of detail generated
+};
+
+struct MeshOptimizationOptions
+{
+  bool reorder = true;        ///< reorder the triangles and vertices
+  bool generate_lods = false; ///< generate the levels of detail, see generate_lods()
+  size_t max_threads = 0;     ///< maximum number of threads used by optimize_meshes(), 0 for the number of cores
+};
+
+float simulate_vertex_cache(const std::vector<int>& indices, size_t vertex_count);
+
+void optimize_vertex_cache(std::vector<int>& indices, size_t vertex_count);
+void optimize_overdraw(std::vector<int>& indices, const std::vector<QVector3D>& vertices);
+void optimize_vertex_fetch(model::Mesh& mesh);
+
+MeshOptimizationStatistics optimize_mesh(model::Mesh& mesh, const MeshOptimizationOptions& options = {});
+MeshOptimizationStatistics optimize_meshes(const std::vector<model::Mesh*>& meshes, const MeshOptimizationOptions& options = {},
+  const std::function<void(size_t)>& progress = {});
@@ -0,0 +1,436 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "meshsimplification.h"
+
+#include "meshoptimization.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+
+namespace
+{
+
+constexpr int MaxLodCount = 4;
+constexpr size_t MinLodTriangles = 64;
+
+// each level targets half the triangles of the previous one and
+// is discarded if it is not at least 20% smaller
+constexpr float LodReduction = 0.5f;
+constexpr float MinLodReduction = 0.8f;
+
+// levels whose error exceeds this fraction of the size of the mesh are not generated
+constexpr float MaxRelativeLodError = 0.05f;
+
+// collapses changing the normal of a triangle by more than ~75 degrees are rejected
+constexpr float MinNormalCosine = 0.25f;
+
+/**
+ * @brief a quadric measuring the sum of the squared distances to a set of planes
+ *
+ * Each plane is weighted by the area of the triangle it comes from,
+ * and the weights are accumulated so that the error can be converted
+ * back to a distance.
+ */
+struct Quadric
+{
+  double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+  double b0 = 0, b1 = 0, b2 = 0;
+  double c = 0;
+  double w = 0;
+
+  Quadric& operator+=(const Quadric& other)
+  {
+    a00 += other.a00; a01 += other.a01; a02 += other.a02;
+    a11 += other.a11; a12 += other.a12; a22 += other.a22;
+    b0 += other.b0; b1 += other.b1; b2 += other.b2;
+    c += other.c;
+    w += other.w;
+    return *this;
+  }
+
+  double evaluate(const QVector3D& p) const
+  {
+    const double x = p.x(), y = p.y(), z = p.z();
+    const double r = a00 * x * x + a11 * y * y + a22 * z * z
+      + 2 * (a01 * x * y + a02 * x * z + a12 * y * z)
+      + 2 * (b0 * x + b1 * y + b2 * z)
+      + c;
+    return std::max(r, 0.0);
+  }
+};
+
+Quadric plane_quadric(const QVector3D& normal, double d, double weight)
+{
+  const double x = normal.x(), y = normal.y(), z = normal.z();
+
+  Quadric q;
+  q.a00 = weight * x * x; q.a01 = weight * x * y; q.a02 = weight * x * z;
+  q.a11 = weight * y * y; q.a12 = weight * y * z; q.a22 = weight * z * z;
+  q.b0 = weight * d * x; q.b1 = weight * d * y; q.b2 = weight * d * z;
+  q.c = weight * d * d;
+  q.w = weight;
+  return q;
+}
+
+uint64_t edge_id(int a, int b)
+{
+  return (uint64_t(uint32_t(std::min(a, b))) << 32) | uint32_t(std::max(a, b));
+}
+
+/**
+ * @brief returns which vertices must not be moved by the simplification
+ *
+ * Vertices on the border of the mesh are locked so that the silhouette
+ * of open meshes is preserved.
+ * Vertices sharing their position with another vertex (e.g. on a UV seam
+ * or on a hard edge) are also locked, as collapsing them independently
+ * would open cracks in the surface.
+ */
+std::vector<bool> locked_vertices(const std::vector<int>& indices, const std::vector<QVector3D>& vertices)
+{
+  std::vector<bool> result(vertices.size(), false);
+
+  {
+    struct PositionHash
+    {
+      size_t operator()(const QVector3D& p) const
+      {
+        uint32_t h[3];
+        std::memcpy(h, &p, sizeof(h));
+        return (size_t(h[0]) * 73856093u) ^ (size_t(h[1]) * 19349663u) ^ (size_t(h[2]) * 83492791u);
+      }
+    };
+
+    std::unordered_map<QVector3D, int, PositionHash> first_vertex;
+    first_vertex.reserve(vertices.size());
+
+    for (size_t v(0); v < vertices.size(); ++v)
+    {
+      auto it = first_vertex.emplace(vertices[v], static_cast<int>(v)).first;
+
+      if (it->second != static_cast<int>(v))
+      {
+        result[v] = true;
+        result[it->second] = true;
+      }
+    }
+  }
+
+  std::unordered_map<uint64_t, int> edge_count;
+  edge_count.reserve(indices.size());
+
+  for (size_t i(0); i + 2 < indices.size(); i += 3)
+  {
+    for (int k(0); k < 3; ++k)
+    {
+      ++edge_count[edge_id(indices[i + k], indices[i + (k + 1) % 3])];
+    }
+  }
+
+  for (const auto& e : edge_count)
+  {
+    if (e.second == 1)
+    {
+      result[e.first >> 32] = true;
+      result[e.first & 0xFFFFFFFF] = true;
+    }
+  }
+
+  return result;
+}
+
+std::vector<Quadric> vertex_quadrics(const std::vector<int>& indices, const std::vector<QVector3D>& vertices)
+{
+  std::vector<Quadric> result(vertices.size());
+
+  for (size_t i(0); i + 2 < indices.size(); i += 3)
+  {
+    const QVector3D& p0 = vertices[indices[i]];
+    const QVector3D n = QVector3D::crossProduct(vertices[indices[i + 1]] - p0, vertices[indices[i + 2]] - p0);
+    const float area = 0.5f * n.length();
+
+    if (area <= 0)
+    {
+      continue;
+    }
+
+    const QVector3D normal = n.normalized();
+    const Quadric q = plane_quadric(normal, -QVector3D::dotProduct(normal, p0), area);
+
+    for (int k(0); k < 3; ++k)
+    {
+      result[indices[i + k]] += q;
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief the triangles referencing each vertex, in compressed rows
+ */
+struct TriangleAdjacency
+{
+  std::vector<int> offsets;
+  std::vector<int> triangles;
+
+  TriangleAdjacency(const std::vector<int>& indices, size_t vertex_count) :
+    offsets(vertex_count + 1, 0),
+    triangles(indices.size())
+  {
+    for (int v : indices)
+    {
+      ++offsets[v + 1];
+    }
+
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+
+    for (size_t i(0); i < indices.size(); ++i)
+    {
+      triangles[fill[indices[i]]++] = static_cast<int>(i / 3);
+    }
+  }
+};
+
+/**
+ * @brief returns whether moving a vertex onto another flips or degenerates one of its triangles
+ */
+bool collapse_flips_triangles(int from, int to, const std::vector<int>& indices, const std::vector<QVector3D>& vertices, const TriangleAdjacency& adjacency)
+{
+  for (int j = adjacency.offsets[from]; j < adjacency.offsets[from + 1]; ++j)
+  {
+    const int* tri = indices.data() + 3 * adjacency.triangles[j];
+
+    if (tri[0] == to || tri[1] == to || tri[2] == to)
+    {
+      // the triangle is removed by the collapse
+      continue;
+    }
+
+    QVector3D p[3] = { vertices[tri[0]], vertices[tri[1]], vertices[tri[2]] };
+    const QVector3D before = QVector3D::crossProduct(p[1] - p[0], p[2] - p[0]);
+
+    for (int k(0); k < 3; ++k)
+    {
+      if (tri[k] == from)
+      {
+        p[k] = vertices[to];
+      }
+    }
+
+    const QVector3D after = QVector3D::crossProduct(p[1] - p[0], p[2] - p[0]);
+
+    if (QVector3D::dotProduct(before, after) <= MinNormalCosine * before.length() * after.length())
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+struct Collapse
+{
+  int from;
+  int to;
+  float error;
+};
+
+} // namespace
+
+/**
+ * @brief simplifies a triangle mesh with quadric error metrics
+ * @param indices             the indices of the triangles
+ * @param vertices            the positions of the vertices
+ * @param target_index_count  the number of indices at which the simplification stops
+ * @param max_error           maximum distance between the simplified and original surfaces
+ * @param result_error        receives the distance error of the simplified mesh
+ * @return the indices of the simplified mesh
+ *
+ * Edges are collapsed onto one of their vertices, in order of increasing error,
+ * so that the simplified mesh references a subset of the original vertices
+ * and can share their buffer.
+ * The error of a collapse is measured with the quadric of Garland and
+ * Heckbert, accumulated over the collapses, and converted to a distance.
+ * The simplification stops early if no collapse is below the maximum error.
+ */
+std::vector<int> simplify_mesh(const std::vector<int>& indices, const std::vector<QVector3D>& vertices,
+  size_t target_index_count, float max_error, float* result_error)
+{
+  std::vector<int> result = indices;
+  float error = 0;
+
+  const std::vector<bool> locked = locked_vertices(indices, vertices);
+  std::vector<Quadric> quadrics = vertex_quadrics(indices, vertices);
+
+  std::vector<Collapse> candidates;
+  std::vector<int> collapse_target(vertices.size());
+  std::vector<bool> touched(vertices.size());
+
+  while (result.size() > target_index_count)
+  {
+    const TriangleAdjacency adjacency{ result, vertices.size() };
+
+    candidates.clear();
+
+    for (size_t i(0); i < result.size(); i += 3)
+    {
+      for (int k(0); k < 3; ++k)
+      {
+        const int a = result[i + k];
+        const int b = result[i + (k + 1) % 3];
+
+        // the edge is collapsed in the direction with the lowest error
+        Collapse best{ -1, -1, std::numeric_limits<float>::max() };
+
+        for (const auto& dir : { std::make_pair(a, b), std::make_pair(b, a) })
+        {
+          if (locked[dir.first])
+          {
+            continue;
+          }
+
+          Quadric q = quadrics[dir.first];
+          q += quadrics[dir.second];
+          const float e = q.w > 0 ? static_cast<float>(std::sqrt(q.evaluate(vertices[dir.second]) / q.w)) : 0.f;
+
+          if (e < best.error)
+          {
+            best = Collapse{ dir.first, dir.second, e };
+          }
+        }
+
+        if (best.from >= 0 && best.error <= max_error)
+        {
+          candidates.push_back(best);
+        }
+      }
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const Collapse& lhs, const Collapse& rhs) {
+      return lhs.error < rhs.error;
+    });
+
+    // the collapses of a pass must not share vertices nor triangles,
+    // so that the flip test is done on the actual topology
+    std::iota(collapse_target.begin(), collapse_target.end(), 0);
+    std::fill(touched.begin(), touched.end(), false);
+
+    // each collapse removes about two triangles
+    const size_t triangles_to_remove = (result.size() - target_index_count) / 3;
+    size_t removed = 0;
+
+    for (const Collapse& c : candidates)
+    {
+      if (removed >= triangles_to_remove)
+      {
+        break;
+      }
+
+      if (touched[c.from] || touched[c.to] || collapse_flips_triangles(c.from, c.to, result, vertices, adjacency))
+      {
+        continue;
+      }
+
+      collapse_target[c.from] = c.to;
+      quadrics[c.to] += quadrics[c.from];
+      error = std::max(error, c.error);
+      removed += 2;
+
+      for (int j = adjacency.offsets[c.from]; j < adjacency.offsets[c.from + 1]; ++j)
+      {
+        const int* tri = result.data() + 3 * adjacency.triangles[j];
+        touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+      }
+
+      touched[c.to] = true;
+    }
+
+    if (removed == 0)
+    {
+      break;
+    }
+
+    size_t write = 0;
+
+    for (size_t i(0); i < result.size(); i += 3)
+    {
+      const int a = collapse_target[result[i]];
+      const int b = collapse_target[result[i + 1]];
+      const int c = collapse_target[result[i + 2]];
+
+      if (a != b && b != c && a != c)
+      {
+        result[write++] = a;
+        result[write++] = b;
+        result[write++] = c;
+      }
+    }
+
+    result.resize(write);
+  }
+
+  if (result_error)
+  {
+    *result_error = error;
+  }
+
+  return result;
+}
+
+/**
+ * @brief generates the levels of detail of a mesh
+ * @param mesh  the mesh
+ *
+ * Each level is obtained by simplifying the previous one to about half
+ * its triangles; its error is the sum of the errors of the simplifications,
+ * which bounds the distance to the original surface.
+ * The generation stops when a level becomes too small, or cannot be
+ * simplified without a large error.
+ */
+void generate_lods(model::Mesh& mesh)
+{
+  mesh.lods.clear();
+
+  AABB bbox;
+
+  for (const QVector3D& p : mesh.vertices)
+  {
+    bbox.extend(p);
+  }
+
+  const float max_error = mesh.vertices.empty() ? 0.f : MaxRelativeLodError * (bbox.max - bbox.min).length();
+
+  // the previous level is referenced while the next one is generated
+  mesh.lods.reserve(MaxLodCount);
+
+  const std::vector<int>* source = &mesh.indices;
+  float error = 0;
+
+  while (static_cast<int>(mesh.lods.size()) < MaxLodCount && source->size() / 3 >= 2 * MinLodTriangles)
+  {
+    const size_t target = static_cast<size_t>(source->size() / 3 * LodReduction) * 3;
+    float level_error = 0;
+    std::vector<int> indices = simplify_mesh(*source, mesh.vertices, target, max_error - error, &level_error);
+
+    if (indices.size() > source->size() * MinLodReduction)
+    {
+      break;
+    }
+
+    error += level_error;
+    optimize_vertex_cache(indices, mesh.vertices.size());
+
+    mesh.lods.push_back(model::MeshLod{ std::move(indices), error });
+    source = &mesh.lods.back().indices;
+  }
+}
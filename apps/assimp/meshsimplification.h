@@ -0,0 +1,15 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "model.h"
+
+#include <cstddef>
+#include <vector>
+
+std::vector<int> simplify_mesh(const std::vector<int>& indices, const std::vector<QVector3D>& vertices,
+  size_t target_index_count, float max_error, float* result_error = nullptr);
+
+void generate_lods(model::Mesh& mesh);
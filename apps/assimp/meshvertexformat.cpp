@@ -0,0 +1,248 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "meshvertexformat.h"
+
+#include <QFloat16>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+/**
+ * @brief computes the interleaved vertex format of a mesh
+ * @param mesh     the mesh
+ * @param compact  whether the attributes are quantized
+ */
+MeshVertexFormat MeshVertexFormat::fromMesh(const model::Mesh& mesh, bool compact)
+{
+  MeshVertexFormat result;
+  result.compact = compact;
+
+  if (compact)
+  {
+    AABB bbox;
+
+    for (const QVector3D& p : mesh.vertices)
+    {
+      bbox.extend(p);
+    }
+
+    if (!mesh.vertices.empty())
+    {
+      result.position_origin = bbox.min;
+      result.position_scale = bbox.max - bbox.min;
+    }
+
+    result.attributes.push_back(BufferSpecsBuilder().index(0).tuplesize(3).type(GL_UNSIGNED_SHORT).normalized(GL_TRUE));
+  }
+  else
+  {
+    result.attributes.push_back(BufferSpecsBuilder().index(0).tuplesize(3).type(GL_FLOAT));
+  }
+
+  if (!mesh.colors.empty())
+  {
+    result.attributes.push_back(BufferSpecsBuilder().index(2).tuplesize(3).type(GL_UNSIGNED_BYTE));
+  }
+
+  if (!mesh.uv.empty())
+  {
+    result.attributes.push_back(BufferSpecsBuilder().index(3).tuplesize(2).type(compact ? GL_HALF_FLOAT : GL_FLOAT));
+  }
+
+  if (!mesh.normals.empty())
+  {
+    if (compact)
+      result.attributes.push_back(BufferSpecsBuilder().index(4).tuplesize(2).type(GL_SHORT).normalized(GL_TRUE));
+    else
+      result.attributes.push_back(BufferSpecsBuilder().index(4).tuplesize(3).type(GL_FLOAT));
+  }
+
+  result.stride = interleave_buffer_specs(result.attributes);
+
+  for (const BufferSpecs& specs : result.attributes)
+  {
+    const int offset = static_cast<int>(reinterpret_cast<uintptr_t>(specs.offset));
+
+    switch (specs.index)
+    {
+    case 0: result.position_offset = offset; break;
+    case 2: result.color_offset = offset; break;
+    case 3: result.uv_offset = offset; break;
+    case 4: result.normal_offset = offset; break;
+    }
+  }
+
+  return result;
+}
+
+namespace
+{
+
+template<typename T>
+void scatter(uint8_t* dest, size_t stride, size_t count, const std::vector<T>& values, size_t size)
+{
+  count = std::min(count, values.size());
+
+  for (size_t i(0); i < count; ++i)
+  {
+    std::memcpy(dest, &values[i], size);
+    dest += stride;
+  }
+}
+
+template<typename T, typename F>
+void scatter_encoded(uint8_t* dest, size_t stride, size_t count, const std::vector<T>& values, F&& encode)
+{
+  count = std::min(count, values.size());
+
+  for (size_t i(0); i < count; ++i)
+  {
+    const auto encoded = encode(values[i]);
+    std::memcpy(dest, &encoded, sizeof(encoded));
+    dest += stride;
+  }
+}
+
+uint16_t quantize_unorm16(float value, float origin, float scale)
+{
+  const float t = scale > 0 ? (value - origin) / scale : 0.f;
+  return static_cast<uint16_t>(std::lround(std::clamp(t, 0.f, 1.f) * 65535.f));
+}
+
+int16_t quantize_snorm16(float value)
+{
+  return static_cast<int16_t>(std::lround(std::clamp(value, -1.f, 1.f) * 32767.f));
+}
+
+/**
+ * @brief encodes a unit vector with the octahedral mapping
+ *
+ * The vector is projected on the octahedron |x| + |y| + |z| = 1, whose lower
+ * half is folded over the upper half; the result is in [-1, 1]^2.
+ */
+std::array<int16_t, 2> encode_octahedral(const QVector3D& n)
+{
+  const float l1 = std::abs(n.x()) + std::abs(n.y()) + std::abs(n.z());
+
+  if (l1 == 0)
+  {
+    return { 0, 0 };
+  }
+
+  float x = n.x() / l1;
+  float y = n.y() / l1;
+
+  if (n.z() < 0)
+  {
+    const float fx = (1.f - std::abs(y)) * (x >= 0 ? 1.f : -1.f);
+    const float fy = (1.f - std::abs(x)) * (y >= 0 ? 1.f : -1.f);
+    x = fx;
+    y = fy;
+  }
+
+  return { quantize_snorm16(x), quantize_snorm16(y) };
+}
+
+} // namespace
+
+/**
+ * @brief packs the attributes of a mesh into an interleaved vertex buffer
+ * @param mesh    the mesh
+ * @param format  the format, computed with MeshVertexFormat::fromMesh()
+ *
+ * Padding bytes are set to zero.
+ */
+std::vector<uint8_t> pack_interleaved_vertices(const model::Mesh& mesh, const MeshVertexFormat& format)
+{
+  const size_t count = mesh.vertices.size();
+  std::vector<uint8_t> result(count * format.stride, uint8_t(0));
+
+  if (result.empty())
+  {
+    return result;
+  }
+
+  if (format.color_offset >= 0)
+  {
+    scatter(result.data() + format.color_offset, format.stride, count, mesh.colors, 3);
+  }
+
+  if (format.compact)
+  {
+    const QVector3D o = format.position_origin;
+    const QVector3D s = format.position_scale;
+
+    scatter_encoded(result.data() + format.position_offset, format.stride, count, mesh.vertices, [&o, &s](const QVector3D& p) {
+      return std::array<uint16_t, 3>{ quantize_unorm16(p.x(), o.x(), s.x()), quantize_unorm16(p.y(), o.y(), s.y()), quantize_unorm16(p.z(), o.z(), s.z()) };
+    });
+
+    if (format.uv_offset >= 0)
+    {
+      scatter_encoded(result.data() + format.uv_offset, format.stride, count, mesh.uv, [](const QVector2D& uv) {
+        return std::array<qfloat16, 2>{ qfloat16(uv.x()), qfloat16(uv.y()) };
+      });
+    }
+
+    if (format.normal_offset >= 0)
+    {
+      scatter_encoded(result.data() + format.normal_offset, format.stride, count, mesh.normals, encode_octahedral);
+    }
+
+    return result;
+  }
+
+  // attributes are copied one after the other, which keeps the reads sequential
+  scatter(result.data() + format.position_offset, format.stride, count, mesh.vertices, 3 * sizeof(float));
+
+  if (format.uv_offset >= 0)
+  {
+    scatter(result.data() + format.uv_offset, format.stride, count, mesh.uv, 2 * sizeof(float));
+  }
+
+  if (format.normal_offset >= 0)
+  {
+    scatter(result.data() + format.normal_offset, format.stride, count, mesh.normals, 3 * sizeof(float));
+  }
+
+  return result;
+}
+
+/**
+ * @brief returns the type of the indices of a mesh in an index buffer
+ * @param mesh     the mesh
+ * @param compact  whether 16-bit indices may be used
+ *
+ * 16-bit indices are used in compact mode if the mesh has less than 65536 vertices.
+ */
+GLenum index_type(const model::Mesh& mesh, bool compact)
+{
+  return compact && mesh.vertices.size() <= std::numeric_limits<uint16_t>::max() + size_t(1)
+    ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+/**
+ * @brief converts indices to the content of an index buffer
+ * @param indices  the indices
+ * @param type     GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+ */
+std::vector<uint8_t> pack_indices(const std::vector<int>& indices, GLenum type)
+{
+  std::vector<uint8_t> result(indices.size() * gl_type_size(type));
+
+  if (type == GL_UNSIGNED_SHORT)
+  {
+    auto* dest = reinterpret_cast<uint16_t*>(result.data());
+    std::transform(indices.begin(), indices.end(), dest, [](int i) { return static_cast<uint16_t>(i); });
+  }
+  else
+  {
+    std::memcpy(result.data(), indices.data(), result.size());
+  }
+
+  return result;
+}
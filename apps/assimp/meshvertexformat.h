@@ -0,0 +1,54 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "model.h"
+
+#include "appcommon/openglbuffer.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief specifies how the vertex attributes of meshes are stored in buffers
+ */
+enum class VertexLayout
+{
+  Separate,    ///< one buffer per attribute
+  Interleaved, ///< all the attributes in a single strided buffer
+  Compact,     ///< interleaved, with quantized attributes and 16-bit indices when possible
+};
+
+/**
+ * @brief describes the layout of the vertices of a mesh in an interleaved buffer
+ *
+ * Only the attributes present in the mesh are part of the format.
+ * Attribute locations match those used by the model shaders.
+ *
+ * In the compact format, positions are stored as 16-bit normalized integers
+ * relative to the bounding box of the mesh (the shaders compute
+ * position_origin + position_scale * p), normals are octahedral-encoded
+ * in two 16-bit normalized integers, and UVs are half floats.
+ */
+struct MeshVertexFormat
+{
+  std::vector<BufferSpecs> attributes;
+  GLsizei stride = 0;
+  int position_offset = 0;
+  int color_offset = -1;
+  int uv_offset = -1;
+  int normal_offset = -1;
+  bool compact = false;
+  QVector3D position_origin;
+  QVector3D position_scale = QVector3D(1, 1, 1);
+
+public:
+  static MeshVertexFormat fromMesh(const model::Mesh& mesh, bool compact = false);
+};
+
+std::vector<uint8_t> pack_interleaved_vertices(const model::Mesh& mesh, const MeshVertexFormat& format);
+
+GLenum index_type(const model::Mesh& mesh, bool compact);
+std::vector<uint8_t> pack_indices(const std::vector<int>& indices, GLenum type);
@@ -72,6 +72,154 @@ void MeshNode::setMesh(Mesh* m)
   m_mesh = m;
 }
 
+/**
+ * @brief builds the hierarchy from a scene graph
+ * @param root  the root of the scene graph, may be null
+ *
+ * The meshes must have their bounding box computed.
+ */
+void SceneHierarchy::build(SceneNode* root)
+{
+  m_parents.clear();
+  m_subtree_ends.clear();
+  m_meshes.clear();
+  m_mesh_nodes.clear();
+  m_local_transforms.clear();
+
+  if (root)
+  {
+    append(root, NoParent);
+  }
+
+  const size_t n = m_parents.size();
+  m_world_transforms.assign(n, QMatrix4x4());
+  m_world_bboxes.assign(n, AABB());
+  m_dirty_transforms.assign(n, uint8_t(1));
+  m_dirty_bboxes.assign(n, uint8_t(1));
+  m_dirty = true;
+
+  update();
+}
+
+void SceneHierarchy::append(SceneNode* node, int parent)
+{
+  const int index = size();
+
+  m_parents.push_back(parent);
+  m_subtree_ends.push_back(index + 1);
+
+  if (node->isTranformNode())
+  {
+    auto& trnode = static_cast<TransformNode&>(*node);
+    m_meshes.push_back(nullptr);
+    m_local_transforms.push_back(trnode.transformMatrix());
+
+    for (const auto& child : trnode.children())
+    {
+      append(child.get(), index);
+    }
+
+    m_subtree_ends[index] = size();
+  }
+  else
+  {
+    Mesh* m = node->isMeshNode() ? static_cast<MeshNode&>(*node).mesh() : nullptr;
+    m_meshes.push_back(m);
+    m_local_transforms.push_back(QMatrix4x4());
+
+    if (m)
+    {
+      m_mesh_nodes.push_back(index);
+    }
+  }
+}
+
+/**
+ * @brief changes the local transform of a node
+ *
+ * The world transforms of the subtree and the bounding boxes of the subtree
+ * and of the ancestors are recomputed by the next call to update().
+ */
+void SceneHierarchy::setLocalTransform(int node, const QMatrix4x4& m)
+{
+  m_local_transforms[node] = m;
+
+  std::fill(m_dirty_transforms.begin() + node, m_dirty_transforms.begin() + m_subtree_ends[node], uint8_t(1));
+
+  for (int i = node; i != NoParent && !m_dirty_bboxes[i]; i = m_parents[i])
+  {
+    m_dirty_bboxes[i] = 1;
+  }
+
+  m_dirty = true;
+}
+
+/**
+ * @brief recomputes the world transforms and bounding boxes of the dirty nodes
+ *
+ * The transforms are computed in a forward scan, parents before children;
+ * the bounding boxes in a backward scan, children before parents.
+ */
+void SceneHierarchy::update()
+{
+  if (!m_dirty)
+  {
+    return;
+  }
+
+  const int n = size();
+
+  for (int i = 0; i < n; ++i)
+  {
+    if (!m_dirty_transforms[i])
+    {
+      continue;
+    }
+
+    const int p = m_parents[i];
+    m_world_transforms[i] = p == NoParent ? m_local_transforms[i] : m_world_transforms[p] * m_local_transforms[i];
+    m_dirty_transforms[i] = 0;
+    m_dirty_bboxes[i] = 1;
+  }
+
+  for (int i = n - 1; i >= 0; --i)
+  {
+    if (!m_dirty_bboxes[i])
+    {
+      continue;
+    }
+
+    if (m_meshes[i])
+    {
+      m_world_bboxes[i] = m_meshes[i]->boundingbox * m_world_transforms[i];
+    }
+    else
+    {
+      AABB bbox;
+
+      // the children are the roots of the subtrees that follow the node;
+      // those without meshes have an empty box, which is skipped
+      for (int child = i + 1; child < m_subtree_ends[i]; child = m_subtree_ends[child])
+      {
+        const AABB& child_bbox = m_world_bboxes[child];
+
+        if (child_bbox.min.x() <= child_bbox.max.x())
+        {
+          bbox.extend(child_bbox.min);
+          bbox.extend(child_bbox.max);
+        }
+      }
+
+      m_world_bboxes[i] = bbox;
+    }
+
+    m_dirty_bboxes[i] = 0;
+  }
+
+  m_dirty = false;
+  ++m_revision;
+}
+
 } // namespace model
 
 const QString& Model::path() const
@@ -89,9 +237,36 @@ model::SceneNode* Model::rootNode() const
   return m_root_node.get();
 }
 
+/**
+ * @brief sets the scene graph of the model
+ *
+ * The hierarchy is built from the scene graph, which must not be modified afterwards.
+ */
 void Model::setRootNode(std::unique_ptr<model::SceneNode> rn)
 {
   m_root_node = std::move(rn);
+  m_hierarchy.build(m_root_node.get());
+  m_bvh_revision = -1;
+  updateBounds();
+}
+
+/**
+ * @brief returns the flattened scene graph, used for rendering
+ */
+const model::SceneHierarchy& Model::hierarchy() const
+{
+  return m_hierarchy;
+}
+
+/**
+ * @brief returns the flattened scene graph
+ *
+ * The hierarchy must not be modified while the model is being rendered.
+ * updateBounds() must be called after modifying the hierarchy.
+ */
+model::SceneHierarchy& Model::hierarchy()
+{
+  return m_hierarchy;
 }
 
 void Model::appendMaterial(std::unique_ptr<model::Material> m)
@@ -104,6 +279,11 @@ model::Material* Model::getMaterial(int index) const
   return m_materials.at(index).get();
 }
 
+int Model::materialCount() const
+{
+  return static_cast<int>(m_materials.size());
+}
+
 void Model::appendMesh(std::unique_ptr<model::Mesh> m)
 {
   m_meshes.push_back(std::move(m));
@@ -114,35 +294,64 @@ model::Mesh* Model::getMesh(int index) const
   return m_meshes.at(index).get();
 }
 
-namespace
+int Model::meshCount() const
 {
+  return static_cast<int>(m_meshes.size());
+}
 
-void compute_bbox_recursive(AABB& bbox, const QMatrix4x4& modelMatrix, model::SceneNode* node)
+/**
+ * @brief returns the bounding box of the model
+ *
+ * The value is outdated if the hierarchy is dirty.
+ */
+AABB Model::boundingBox() const
 {
-  if (node->isTranformNode())
-  {
-    auto& trnode = static_cast<model::TransformNode&>(*node);
-    QMatrix4x4 tr = modelMatrix * trnode.transformMatrix();
+  return m_hierarchy.size() > 0 ? m_hierarchy.worldBoundingBox(0) : AABB();
+}
 
-    for (const auto& child : trnode.children())
-    {
-      compute_bbox_recursive(bbox, tr, child.get());
-    }
+/**
+ * @brief returns the bounding volume hierarchy of the mesh nodes
+ *
+ * The items of the hierarchy are the indices of the mesh nodes in
+ * model::SceneHierarchy::meshNodes().
+ */
+const BoundingVolumeHierarchy& Model::bvh() const
+{
+  return m_bvh;
+}
+
+/**
+ * @brief updates the bounding boxes after the hierarchy was modified
+ *
+ * The world bounding boxes of the hierarchy are updated and the
+ * bounding volume hierarchy is refitted.
+ * The bounding volume hierarchy is built the first time this is called.
+ */
+void Model::updateBounds()
+{
+  m_hierarchy.update();
+
+  if (m_bvh_revision == m_hierarchy.revision())
+  {
+    return;
   }
-  else if (node->isMeshNode())
+
+  std::vector<AABB> boxes;
+  boxes.reserve(m_hierarchy.meshNodes().size());
+
+  for (int node : m_hierarchy.meshNodes())
   {
-    auto& meshnode = static_cast<model::MeshNode&>(*node);
-    const AABB& meshbbox = meshnode.mesh()->boundingbox;
-    const AABB trbbox = meshbbox * modelMatrix;
-    bbox = united(bbox, trbbox);
+    boxes.push_back(m_hierarchy.worldBoundingBox(node));
   }
-}
 
-}
+  if (m_bvh_revision == -1)
+  {
+    m_bvh.build(boxes);
+  }
+  else
+  {
+    m_bvh.refit(boxes);
+  }
 
-AABB Model::boundingBox() const
-{
-  AABB result;
-  compute_bbox_recursive(result, QMatrix4x4(), rootNode());
-  return result;
+  m_bvh_revision = m_hierarchy.revision();
 }
@@ -6,6 +6,7 @@
 #define MODEL_H
 
 #include "aabb.h"
+#include "bvh.h"
 
 #include "appcommon/color.h"
 
@@ -15,6 +16,7 @@
 
 #include <QString>
 
+#include <cstdint>
 #include <memory>
 #include <variant>
 #include <vector>
@@ -86,6 +88,15 @@ private:
   Variant m_variant;
 };
 
+/**
+ * @brief a simplified version of a mesh, sharing its vertices
+ */
+struct MeshLod
+{
+  std::vector<int> indices;
+  float error = 0; ///< maximum distance to the original surface, in mesh units
+};
+
 struct Mesh
 {
   std::vector<QVector3D> vertices;
@@ -93,6 +104,7 @@ struct Mesh
   std::vector<RgbColor> colors;
   std::vector<QVector2D> uv;
   std::vector<QVector3D> normals;
+  std::vector<MeshLod> lods; ///< from the finest to the coarsest, may be empty
   Material* material = nullptr;
   AABB boundingbox;
 };
@@ -140,6 +152,144 @@ public:
   void setMesh(Mesh* m);
 };
 
+/**
+ * @brief a flattened representation of a scene graph
+ *
+ * The nodes are stored in arrays in depth-first order: a parent always comes
+ * before its children and the descendants of a node are stored right after it.
+ * The world transform and the world bounding box of each node are cached;
+ * modifying the local transform of a node only marks its subtree as dirty,
+ * the cached values are recomputed by update().
+ *
+ * Mesh nodes have an identity local transform, and their bounding box is the one
+ * of their mesh; the bounding box of a transform node encloses its subtree.
+ */
+class SceneHierarchy
+{
+public:
+  SceneHierarchy() = default;
+
+  static constexpr int NoParent = -1;
+
+  void build(SceneNode* root);
+
+  int size() const;
+
+  int parent(int node) const;
+  int subtreeEnd(int node) const;
+  Mesh* mesh(int node) const;
+
+  const std::vector<int>& meshNodes() const;
+
+  const QMatrix4x4& localTransform(int node) const;
+  void setLocalTransform(int node, const QMatrix4x4& m);
+
+  const QMatrix4x4& worldTransform(int node) const;
+  const AABB& worldBoundingBox(int node) const;
+
+  bool isDirty() const;
+  void update();
+
+  int revision() const;
+
+private:
+  void append(SceneNode* node, int parent);
+
+private:
+  std::vector<int> m_parents;
+  std::vector<int> m_subtree_ends;
+  std::vector<Mesh*> m_meshes;
+  std::vector<int> m_mesh_nodes;
+  std::vector<QMatrix4x4> m_local_transforms;
+  std::vector<QMatrix4x4> m_world_transforms;
+  std::vector<AABB> m_world_bboxes;
+  std::vector<uint8_t> m_dirty_transforms;
+  std::vector<uint8_t> m_dirty_bboxes;
+  bool m_dirty = false;
+  int m_revision = 0;
+};
+
+/**
+ * @brief returns the number of nodes
+ */
+inline int SceneHierarchy::size() const
+{
+  return static_cast<int>(m_parents.size());
+}
+
+/**
+ * @brief returns the index of the parent of a node, or NoParent for the root
+ */
+inline int SceneHierarchy::parent(int node) const
+{
+  return m_parents[node];
+}
+
+/**
+ * @brief returns the index following the last descendant of a node
+ */
+inline int SceneHierarchy::subtreeEnd(int node) const
+{
+  return m_subtree_ends[node];
+}
+
+/**
+ * @brief returns the mesh of a node, or null if the node is not a mesh node
+ */
+inline Mesh* SceneHierarchy::mesh(int node) const
+{
+  return m_meshes[node];
+}
+
+/**
+ * @brief returns the indices of the mesh nodes, in increasing order
+ */
+inline const std::vector<int>& SceneHierarchy::meshNodes() const
+{
+  return m_mesh_nodes;
+}
+
+inline const QMatrix4x4& SceneHierarchy::localTransform(int node) const
+{
+  return m_local_transforms[node];
+}
+
+/**
+ * @brief returns the cached world transform of a node
+ *
+ * The value is outdated if the hierarchy is dirty.
+ */
+inline const QMatrix4x4& SceneHierarchy::worldTransform(int node) const
+{
+  return m_world_transforms[node];
+}
+
+/**
+ * @brief returns the cached world bounding box of a node
+ *
+ * The value is outdated if the hierarchy is dirty.
+ */
+inline const AABB& SceneHierarchy::worldBoundingBox(int node) const
+{
+  return m_world_bboxes[node];
+}
+
+/**
+ * @brief returns whether a local transform was changed since the last call to update()
+ */
+inline bool SceneHierarchy::isDirty() const
+{
+  return m_dirty;
+}
+
+/**
+ * @brief returns a number that changes whenever the cached values are recomputed
+ */
+inline int SceneHierarchy::revision() const
+{
+  return m_revision;
+}
+
 } // namespace model
 
 class Model
@@ -153,11 +303,19 @@ public:
   model::SceneNode* rootNode() const;
   void setRootNode(std::unique_ptr<model::SceneNode> rn);
 
+  const model::SceneHierarchy& hierarchy() const;
+  model::SceneHierarchy& hierarchy();
+
+  const BoundingVolumeHierarchy& bvh() const;
+  void updateBounds();
+
   void appendMaterial(std::unique_ptr<model::Material> m);
   model::Material* getMaterial(int index) const;
+  int materialCount() const;
 
   void appendMesh(std::unique_ptr<model::Mesh> m);
   model::Mesh* getMesh(int index) const;
+  int meshCount() const;
 
   AABB boundingBox() const;
 
@@ -166,6 +324,9 @@ private:
   std::vector<std::unique_ptr<model::Mesh>> m_meshes;
   std::vector<std::unique_ptr<model::Material>> m_materials;
   std::unique_ptr<model::SceneNode> m_root_node;
+  model::SceneHierarchy m_hierarchy;
+  BoundingVolumeHierarchy m_bvh;
+  int m_bvh_revision = -1;
 };
 
 #endif // MODEL_H
@@ -0,0 +1,615 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "modelcache.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <type_traits>
+
+/**
+ * @brief returns the directory in which the cached models are stored by default
+ *
+ * This is the "models" subdirectory of the cache location of the application.
+ */
+QString default_model_cache_dir()
+{
+  return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/models";
+}
+
+namespace
+{
+
+/*
+ * Layout of a cache file
+ *
+ * The file starts with a CacheHeader, followed by the arrays of CacheMaterial,
+ * CacheMesh, CacheLod and CacheNode it references and by the data of the meshes.
+ * Every array starts at an offset, from the beginning of the file, that is a
+ * multiple of CacheAlignment; all the values are in the byte order of the machine
+ * that wrote the file.
+ * The vertex attributes are stored exactly as in model::Mesh so that each of
+ * them is copied with a single memcpy() from the mapped file.
+ *
+ * The nodes are stored in depth-first order, each node being followed by its
+ * children.
+ */
+
+constexpr char CacheMagic[8] = { 'Q', 'M', 'L', 'G', 'L', 'M', 'D', 'L' };
+constexpr uint32_t CacheVersion = 1;
+constexpr uint32_t CacheByteOrderMark = 0x01020304;
+constexpr size_t CacheAlignment = 16;
+
+struct CacheArray
+{
+  uint64_t offset;
+  uint64_t count;
+};
+
+struct CacheHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order_mark;
+  int64_t source_size;
+  int64_t source_mtime;
+  uint32_t import_flags;
+  uint32_t reserved;
+  CacheArray source_path; ///< UTF-8
+  CacheArray materials;
+  CacheArray meshes;
+  CacheArray lods;
+  CacheArray nodes;
+  uint64_t file_size;
+};
+
+enum class CacheMaterialType : uint32_t
+{
+  Default,
+  VertexColor,
+  FlatColor,
+  Texture,
+};
+
+struct CacheMaterial
+{
+  CacheMaterialType type;
+  uint8_t color[4];
+  CacheArray texture_path; ///< UTF-8
+};
+
+struct CacheMesh
+{
+  CacheArray vertices;
+  CacheArray indices;
+  CacheArray colors;
+  CacheArray uv;
+  CacheArray normals;
+  uint32_t first_lod;
+  uint32_t lod_count;
+  int32_t material; ///< -1 if the mesh has no material
+  float bbox_min[3];
+  float bbox_max[3];
+};
+
+struct CacheLod
+{
+  CacheArray indices;
+  float error;
+  uint32_t reserved;
+};
+
+struct CacheNode
+{
+  float transform[16]; ///< column-major
+  int32_t mesh;        ///< -1 for transform nodes
+  uint32_t child_count;
+};
+
+static_assert(sizeof(QVector3D) == 3 * sizeof(float), "QVector3D is stored as is");
+static_assert(sizeof(QVector2D) == 2 * sizeof(float), "QVector2D is stored as is");
+static_assert(sizeof(RgbColor) == 3, "RgbColor is stored as is");
+static_assert(std::is_trivially_copyable<CacheHeader>::value && std::is_trivially_copyable<CacheNode>::value);
+
+/**
+ * @brief writes the content of a cache file
+ *
+ * The arrays are written to the file as they are appended, with 64-bit
+ * offsets, and the header is written last at the beginning of the file.
+ */
+class CacheWriter
+{
+public:
+  explicit CacheWriter(QIODevice& file) :
+    m_file(file)
+  {
+    write(nullptr, sizeof(CacheHeader));
+  }
+
+  template<typename T>
+  CacheArray append(const T* values, size_t count)
+  {
+    static_assert(std::is_trivially_copyable<T>::value);
+
+    write(nullptr, (CacheAlignment - m_pos % CacheAlignment) % CacheAlignment);
+
+    CacheArray result{ m_pos, count };
+    write(values, count * sizeof(T));
+    return result;
+  }
+
+  template<typename T>
+  CacheArray append(const std::vector<T>& values)
+  {
+    return append(values.data(), values.size());
+  }
+
+  CacheArray append(const QString& str)
+  {
+    const QByteArray utf8 = str.toUtf8();
+    return append(utf8.constData(), size_t(utf8.size()));
+  }
+
+  /**
+   * @brief writes the header
+   * @return whether all the writes succeeded
+   */
+  bool finish(CacheHeader header)
+  {
+    header.file_size = m_pos;
+
+    if (m_ok && m_file.seek(0))
+    {
+      m_pos = 0;
+      write(&header, sizeof(CacheHeader));
+      return m_ok;
+    }
+
+    return false;
+  }
+
+private:
+  // writes zeros if 'data' is null
+  void write(const void* data, uint64_t size)
+  {
+    static const char zeros[sizeof(CacheHeader)] = {};
+
+    m_pos += size;
+
+    while (m_ok && size > 0)
+    {
+      const qint64 n = data ? qint64(size) : qint64(std::min<uint64_t>(size, sizeof(zeros)));
+      m_ok = m_file.write(data ? static_cast<const char*>(data) : zeros, n) == n;
+      data = data ? static_cast<const char*>(data) + n : nullptr;
+      size -= uint64_t(n);
+    }
+  }
+
+private:
+  QIODevice& m_file;
+  uint64_t m_pos = 0;
+  bool m_ok = true;
+};
+
+/**
+ * @brief checks that indices reference existing vertices
+ */
+void check_indices(const std::vector<int>& indices, size_t vertex_count)
+{
+  // negative indices become larger than any vertex count
+  const bool valid = std::all_of(indices.begin(), indices.end(), [vertex_count](int i) {
+    return size_t(unsigned(i)) < vertex_count;
+  });
+
+  if (!valid)
+  {
+    throw std::runtime_error("corrupted model cache");
+  }
+}
+
+/**
+ * @brief gives access to the arrays of a mapped cache file
+ *
+ * All the accesses are checked against the size of the file so that
+ * a truncated or corrupted file is detected instead of being read out of bounds.
+ */
+class CacheReader
+{
+public:
+  CacheReader(const uchar* data, qint64 size) :
+    m_data(data),
+    m_size(uint64_t(size))
+  {
+
+  }
+
+  template<typename T>
+  const T* get(const CacheArray& array) const
+  {
+    if (array.offset % alignof(T) != 0 || array.offset > m_size || array.count > (m_size - array.offset) / sizeof(T))
+    {
+      throw std::runtime_error("corrupted model cache");
+    }
+
+    return reinterpret_cast<const T*>(m_data + array.offset);
+  }
+
+  template<typename T>
+  void copy(const CacheArray& array, std::vector<T>& output) const
+  {
+    const T* values = get<T>(array);
+    output.resize(array.count);
+
+    if (array.count > 0)
+    {
+      std::memcpy(static_cast<void*>(output.data()), values, array.count * sizeof(T));
+    }
+  }
+
+  QString string(const CacheArray& array) const
+  {
+    return QString::fromUtf8(get<char>(array), int(array.count));
+  }
+
+private:
+  const uchar* m_data;
+  uint64_t m_size;
+};
+
+QMatrix4x4 read_matrix(const float* values)
+{
+  QMatrix4x4 m;
+  std::copy(values, values + 16, m.data());
+  return m;
+}
+
+std::unique_ptr<model::Material> read_material(const CacheReader& reader, const CacheMaterial& mat)
+{
+  switch (mat.type)
+  {
+  case CacheMaterialType::Default:
+    return std::make_unique<model::Material>(model::material::DefaultMaterial());
+  case CacheMaterialType::VertexColor:
+    return std::make_unique<model::Material>(model::material::VertexColorMaterial());
+  case CacheMaterialType::FlatColor:
+    return std::make_unique<model::Material>(model::material::FlatColorMaterial(RgbColor(mat.color[0], mat.color[1], mat.color[2])));
+  case CacheMaterialType::Texture:
+    return std::make_unique<model::Material>(model::material::TextureMaterial(reader.string(mat.texture_path)));
+  }
+
+  throw std::runtime_error("corrupted model cache");
+}
+
+CacheMaterial write_material(CacheWriter& writer, const model::Material& mat)
+{
+  CacheMaterial result = {};
+
+  if (mat.is<model::material::VertexColorMaterial>())
+  {
+    result.type = CacheMaterialType::VertexColor;
+  }
+  else if (mat.is<model::material::FlatColorMaterial>())
+  {
+    const RgbColor c = mat.as<model::material::FlatColorMaterial>().color;
+    result.type = CacheMaterialType::FlatColor;
+    result.color[0] = c.r;
+    result.color[1] = c.g;
+    result.color[2] = c.b;
+  }
+  else if (mat.is<model::material::TextureMaterial>())
+  {
+    result.type = CacheMaterialType::Texture;
+    result.texture_path = writer.append(mat.as<model::material::TextureMaterial>().texture_path);
+  }
+  else
+  {
+    result.type = CacheMaterialType::Default;
+  }
+
+  return result;
+}
+
+void write_node(const model::SceneNode* node, const std::map<const model::Mesh*, int32_t>& mesh_indices, std::vector<CacheNode>& output)
+{
+  const QMatrix4x4 identity;
+  CacheNode cnode = {};
+  std::copy(identity.constData(), identity.constData() + 16, cnode.transform);
+  cnode.mesh = -1;
+
+  if (node->isMeshNode())
+  {
+    cnode.mesh = mesh_indices.at(static_cast<const model::MeshNode*>(node)->mesh());
+    output.push_back(cnode);
+    return;
+  }
+
+  const auto* tnode = static_cast<const model::TransformNode*>(node);
+  std::copy(tnode->transformMatrix().constData(), tnode->transformMatrix().constData() + 16, cnode.transform);
+  cnode.child_count = uint32_t(tnode->children().size());
+  output.push_back(cnode);
+
+  for (const std::unique_ptr<model::SceneNode>& child : tnode->children())
+  {
+    write_node(child.get(), mesh_indices, output);
+  }
+}
+
+std::unique_ptr<model::SceneNode> read_node(const CacheNode* nodes, size_t node_count, size_t& next, const Model& model)
+{
+  if (next >= node_count)
+  {
+    throw std::runtime_error("corrupted model cache");
+  }
+
+  const CacheNode& cnode = nodes[next++];
+
+  if (cnode.mesh >= 0)
+  {
+    if (cnode.mesh >= model.meshCount())
+    {
+      throw std::runtime_error("corrupted model cache");
+    }
+
+    return std::make_unique<model::MeshNode>(model.getMesh(cnode.mesh));
+  }
+
+  auto result = std::make_unique<model::TransformNode>(read_matrix(cnode.transform));
+
+  for (uint32_t i(0); i < cnode.child_count; ++i)
+  {
+    result->appendChild(read_node(nodes, node_count, next, model));
+  }
+
+  return result;
+}
+
+} // namespace
+
+/**
+ * @brief constructs the key of a model file
+ * @param path   the path of the model file
+ * @param flags  flags identifying the options used for importing the file
+ */
+ModelCacheKey::ModelCacheKey(const QString& path, uint32_t flags) :
+  import_flags(flags)
+{
+  QFileInfo info{ path };
+  source_path = info.absoluteFilePath();
+  source_size = info.size();
+  source_mtime = info.lastModified().toMSecsSinceEpoch();
+}
+
+/**
+ * @brief returns the path of the cache file of a model
+ * @param cache_dir  the directory of the cache
+ * @param key        the key of the model
+ *
+ * The name of the file only depends on the path of the source file, so
+ * that a model has at most one cache file, which is overwritten whenever
+ * the source file or the import flags change.
+ */
+QString model_cache_path(const QString& cache_dir, const ModelCacheKey& key)
+{
+  const QByteArray hash = QCryptographicHash::hash(key.source_path.toUtf8(), QCryptographicHash::Sha1).toHex();
+  return QDir(cache_dir).filePath(QString::fromLatin1(hash) + ".qmlglmodel");
+}
+
+/**
+ * @brief reads a model from a cache file
+ * @param cache_file  the path of the cache file
+ * @param key         the key of the model
+ * @return the model, or null if the file does not exist or was written for another key
+ * @throw std::runtime_error if the file is corrupted
+ *
+ * The file is mapped in memory and the arrays of the meshes are copied
+ * directly from the mapping, without parsing.
+ */
+std::unique_ptr<Model> read_model_cache(const QString& cache_file, const ModelCacheKey& key)
+{
+  QFile file{ cache_file };
+
+  if (!file.open(QIODevice::ReadOnly) || file.size() < qint64(sizeof(CacheHeader)))
+  {
+    return nullptr;
+  }
+
+  const uchar* data = file.map(0, file.size());
+
+  if (!data)
+  {
+    return nullptr;
+  }
+
+  const CacheReader reader{ data, file.size() };
+  const CacheHeader& header = *reader.get<CacheHeader>(CacheArray{ 0, 1 });
+
+  if (std::memcmp(header.magic, CacheMagic, sizeof(CacheMagic)) != 0
+    || header.version != CacheVersion
+    || header.byte_order_mark != CacheByteOrderMark
+    || header.file_size != uint64_t(file.size()))
+  {
+    return nullptr;
+  }
+
+  if (header.source_size != key.source_size
+    || header.source_mtime != key.source_mtime
+    || header.import_flags != key.import_flags
+    || reader.string(header.source_path) != key.source_path)
+  {
+    return nullptr;
+  }
+
+  auto result = std::make_unique<Model>();
+  result->setPath(key.source_path);
+
+  const CacheMaterial* materials = reader.get<CacheMaterial>(header.materials);
+
+  for (size_t i(0); i < header.materials.count; ++i)
+  {
+    result->appendMaterial(read_material(reader, materials[i]));
+  }
+
+  const CacheMesh* meshes = reader.get<CacheMesh>(header.meshes);
+  const CacheLod* lods = reader.get<CacheLod>(header.lods);
+
+  for (size_t i(0); i < header.meshes.count; ++i)
+  {
+    const CacheMesh& cmesh = meshes[i];
+    auto mesh = std::make_unique<model::Mesh>();
+
+    reader.copy(cmesh.vertices, mesh->vertices);
+    reader.copy(cmesh.indices, mesh->indices);
+    reader.copy(cmesh.colors, mesh->colors);
+    reader.copy(cmesh.uv, mesh->uv);
+    reader.copy(cmesh.normals, mesh->normals);
+    check_indices(mesh->indices, mesh->vertices.size());
+
+    if (cmesh.first_lod > header.lods.count || cmesh.lod_count > header.lods.count - cmesh.first_lod)
+    {
+      throw std::runtime_error("corrupted model cache");
+    }
+
+    mesh->lods.resize(cmesh.lod_count);
+
+    for (uint32_t j(0); j < cmesh.lod_count; ++j)
+    {
+      reader.copy(lods[cmesh.first_lod + j].indices, mesh->lods[j].indices);
+      mesh->lods[j].error = lods[cmesh.first_lod + j].error;
+      check_indices(mesh->lods[j].indices, mesh->vertices.size());
+    }
+
+    if (cmesh.material >= int32_t(header.materials.count))
+    {
+      throw std::runtime_error("corrupted model cache");
+    }
+
+    mesh->material = cmesh.material >= 0 ? result->getMaterial(cmesh.material) : nullptr;
+    mesh->boundingbox.min = QVector3D(cmesh.bbox_min[0], cmesh.bbox_min[1], cmesh.bbox_min[2]);
+    mesh->boundingbox.max = QVector3D(cmesh.bbox_max[0], cmesh.bbox_max[1], cmesh.bbox_max[2]);
+
+    result->appendMesh(std::move(mesh));
+  }
+
+  const CacheNode* nodes = reader.get<CacheNode>(header.nodes);
+  size_t next = 0;
+
+  if (header.nodes.count > 0)
+  {
+    result->setRootNode(read_node(nodes, header.nodes.count, next, *result));
+  }
+
+  return result;
+}
+
+/**
+ * @brief writes a model in a cache file
+ * @param cache_file  the path of the cache file
+ * @param key         the key of the model
+ * @param model       the model
+ * @return whether the file was written
+ *
+ * The file is written atomically: a concurrent reader either sees
+ * the previous content or the new one.
+ * The arrays are streamed to the file, the model is not serialized
+ * in memory first.
+ */
+bool write_model_cache(const QString& cache_file, const ModelCacheKey& key, const Model& model)
+{
+  QDir().mkpath(QFileInfo(cache_file).absolutePath());
+
+  QSaveFile file{ cache_file };
+
+  if (!file.open(QIODevice::WriteOnly))
+  {
+    return false;
+  }
+
+  CacheWriter writer{ file };
+
+  CacheHeader header = {};
+  std::memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+  header.version = CacheVersion;
+  header.byte_order_mark = CacheByteOrderMark;
+  header.source_size = key.source_size;
+  header.source_mtime = key.source_mtime;
+  header.import_flags = key.import_flags;
+  header.source_path = writer.append(key.source_path);
+
+  std::map<const model::Material*, int32_t> material_indices;
+  std::vector<CacheMaterial> materials;
+
+  for (int i(0); i < model.materialCount(); ++i)
+  {
+    material_indices[model.getMaterial(i)] = i;
+    materials.push_back(write_material(writer, *model.getMaterial(i)));
+  }
+
+  std::map<const model::Mesh*, int32_t> mesh_indices;
+  std::vector<CacheMesh> meshes;
+  std::vector<CacheLod> lods;
+
+  for (int i(0); i < model.meshCount(); ++i)
+  {
+    const model::Mesh& mesh = *model.getMesh(i);
+    mesh_indices[&mesh] = i;
+
+    CacheMesh cmesh = {};
+    cmesh.vertices = writer.append(mesh.vertices);
+    cmesh.indices = writer.append(mesh.indices);
+    cmesh.colors = writer.append(mesh.colors);
+    cmesh.uv = writer.append(mesh.uv);
+    cmesh.normals = writer.append(mesh.normals);
+    cmesh.first_lod = uint32_t(lods.size());
+    cmesh.lod_count = uint32_t(mesh.lods.size());
+
+    for (const model::MeshLod& lod : mesh.lods)
+    {
+      CacheLod clod = {};
+      clod.indices = writer.append(lod.indices);
+      clod.error = lod.error;
+      lods.push_back(clod);
+    }
+
+    auto material_it = material_indices.find(mesh.material);
+    cmesh.material = material_it != material_indices.end() ? material_it->second : -1;
+
+    for (int k(0); k < 3; ++k)
+    {
+      cmesh.bbox_min[k] = mesh.boundingbox.min[k];
+      cmesh.bbox_max[k] = mesh.boundingbox.max[k];
+    }
+
+    meshes.push_back(cmesh);
+  }
+
+  std::vector<CacheNode> nodes;
+
+  if (model.rootNode())
+  {
+    write_node(model.rootNode(), mesh_indices, nodes);
+  }
+
+  header.materials = writer.append(materials);
+  header.meshes = writer.append(meshes);
+  header.lods = writer.append(lods);
+  header.nodes = writer.append(nodes);
+
+  if (!writer.finish(header))
+  {
+    file.cancelWriting();
+    return false;
+  }
+
+  return file.commit();
+}
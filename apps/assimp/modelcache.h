@@ -0,0 +1,38 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "model.h"
+
+#include <QString>
+
+#include <cstdint>
+#include <memory>
+
+QString default_model_cache_dir();
+
+/**
+ * @brief identifies the result of importing a model file
+ *
+ * A cached model is only used if the source file has the same path, size
+ * and modification time as when the cache was written, and if it was
+ * imported with the same flags.
+ */
+struct ModelCacheKey
+{
+  QString source_path;
+  qint64 source_size = 0;
+  qint64 source_mtime = 0;
+  uint32_t import_flags = 0;
+
+public:
+  ModelCacheKey() = default;
+  ModelCacheKey(const QString& path, uint32_t flags);
+};
+
+QString model_cache_path(const QString& cache_dir, const ModelCacheKey& key);
+
+std::unique_ptr<Model> read_model_cache(const QString& cache_file, const ModelCacheKey& key);
+bool write_model_cache(const QString& cache_file, const ModelCacheKey& key, const Model& model);
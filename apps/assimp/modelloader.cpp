@@ -4,24 +4,179 @@
 
 #include "modelloader.h"
 
+#include "attributeconversion.h"
+#include "meshoptimization.h"
+#include "parallel.h"
+
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFileInfo>
+#include <QLoggingCategory>
 
-#include <assimp/Importer.hpp>  // C++ importer interface
-#include <assimp/postprocess.h> // Post processing flags
-#include <assimp/scene.h>       // Output data structure
+#include <assimp/Importer.hpp>        // C++ importer interface
+#include <assimp/postprocess.h>       // Post processing flags
+#include <assimp/ProgressHandler.hpp> // Progress reporting
+#include <assimp/scene.h>             // Output data structure
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <stdexcept>
+#include <thread>
+
+Q_LOGGING_CATEGORY(lcModelLoader, "qmlgl.assimp.loader", QtWarningMsg)
+
+namespace
+{
+
+// share of the progress taken by each stage of the loading
+constexpr float ImportProgress = 0.6f;
+constexpr float ConversionProgress = 0.8f;
+constexpr float OptimizationProgress = 0.95f;
+
+/**
+ * @brief forwards the progress of assimp to the progress callback of a ModelLoader
+ */
+class ImportProgressHandler : public Assimp::ProgressHandler
+{
+public:
+  explicit ImportProgressHandler(const ModelLoader::ProgressCallback& callback) :
+    m_callback(callback)
+  {
+
+  }
+
+  bool Update(float percentage) override
+  {
+    // the percentage is -1 if it is not available
+    if (percentage >= 0)
+    {
+      m_progress = ImportProgress * std::min(percentage, 1.f);
+    }
+
+    m_canceled = m_canceled || (m_callback && !m_callback(m_progress));
+    return !m_canceled;
+  }
+
+  bool canceled() const
+  {
+    return m_canceled;
+  }
+
+private:
+  const ModelLoader::ProgressCallback& m_callback;
+  float m_progress = 0;
+  bool m_canceled = false;
+};
+
+} // namespace
+
+ModelLoadingCanceled::ModelLoadingCanceled() : std::runtime_error("Loading canceled")
+{
 
+}
+
+/**
+ * @brief sets the function receiving the progress of load()
+ */
+void ModelLoader::setProgressCallback(ProgressCallback callback)
+{
+  m_progress_callback = std::move(callback);
+}
+
+/**
+ * @brief calls the progress callback
+ * @throw ModelLoadingCanceled if the callback cancels the loading
+ */
+void ModelLoader::reportProgress(float progress)
+{
+  if (m_progress_callback && !m_progress_callback(progress))
+  {
+    throw ModelLoadingCanceled();
+  }
+}
+
+/**
+ * @brief returns flags identifying the options that change the result of load()
+ *
+ * These flags are part of the key of the cached models.
+ */
+uint32_t ModelLoader::importFlags() const
+{
+  return (m_optimize_meshes ? 1 : 0) | (m_generate_lods ? 2 : 0);
+}
+
+/**
+ * @brief loads a model
+ * @param file_path  the path of the model file
+ * @throw std::runtime_error if the file cannot be loaded
+ * @throw ModelLoadingCanceled if the progress callback cancels the loading
+ *
+ * If the model cache is enabled, the model is read from the cache when the
+ * file was already imported with the same options; otherwise it is imported
+ * with assimp and written in the cache.
+ */
 std::unique_ptr<Model> ModelLoader::load(const QString& file_path)
+{
+  if (m_cache_dir.isEmpty())
+  {
+    return import(file_path);
+  }
+
+  const ModelCacheKey key{ file_path, importFlags() };
+  const QString cache_file = model_cache_path(m_cache_dir, key);
+
+  QElapsedTimer timer;
+  timer.start();
+
+  std::unique_ptr<Model> model;
+
+  try
+  {
+    model = read_model_cache(cache_file, key);
+  }
+  catch (const std::runtime_error& ex)
+  {
+    qCWarning(lcModelLoader) << "could not read" << cache_file << ":" << ex.what();
+  }
+
+  if (model)
+  {
+    qCDebug(lcModelLoader) << "loaded" << file_path << "from cache in" << timer.elapsed() << "ms";
+    reportProgress(1);
+    return model;
+  }
+
+  model = import(file_path);
+
+  if (!write_model_cache(cache_file, key, *model))
+  {
+    qCWarning(lcModelLoader) << "could not write" << cache_file;
+  }
+
+  return model;
+}
+
+std::unique_ptr<Model> ModelLoader::import(const QString& file_path)
 {
   m_model.setPath(file_path);
 
   Assimp::Importer importer;
+  ImportProgressHandler progress_handler{ m_progress_callback };
+  importer.SetProgressHandler(&progress_handler);
 
-  m_scene = importer.ReadFile(file_path.toStdString(), 
-    aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_SortByPType | aiProcess_GenBoundingBoxes);
+  // the bounding boxes are computed during the conversion of the meshes,
+  // which unlike the post-processing steps of assimp runs in parallel
+  m_scene = importer.ReadFile(file_path.toStdString(),
+    aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_SortByPType);
+
+  // gives the ownership of the handler back, the importer would delete it otherwise
+  importer.SetProgressHandler(nullptr);
+
+  if (progress_handler.canceled())
+  {
+    throw ModelLoadingCanceled();
+  }
 
   if (!m_scene)
   {
@@ -32,16 +187,38 @@ std::unique_ptr<Model> ModelLoader::load(const QString& file_path)
   if (!m_scene->HasMeshes())
     throw std::runtime_error("No meshes found");
 
-  for (unsigned int i(0); i < m_scene->mNumMaterials; ++i)
-  {
-    auto mat = processAiMaterial(m_scene->mMaterials[i]);
-    m_model.appendMaterial(std::move(mat));
-  }
+  convertMaterials();
+  convertMeshes();
+
+  reportProgress(ConversionProgress);
 
-  for (unsigned int i(0); i < m_scene->mNumMeshes; ++i)
+  if (m_optimize_meshes || m_generate_lods)
   {
-    auto mesh = processAiMesh(m_scene->mMeshes[i]);
-    m_model.appendMesh(std::move(mesh));
+    std::vector<model::Mesh*> meshes;
+
+    for (unsigned int i(0); i < m_scene->mNumMeshes; ++i)
+    {
+      meshes.push_back(m_model.getMesh(i));
+    }
+
+    MeshOptimizationOptions options;
+    options.reorder = m_optimize_meshes;
+    options.generate_lods = m_generate_lods;
+    options.max_threads = m_max_threads;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // the loading can be canceled between two meshes
+    const MeshOptimizationStatistics stats = optimize_meshes(meshes, options, [this, &meshes](size_t n) {
+      reportProgress(ConversionProgress + (OptimizationProgress - ConversionProgress) * n / meshes.size());
+    });
+
+    qCDebug(lcModelLoader).nospace() << "optimized " << meshes.size() << " meshes (" << stats.triangles << " triangles) in "
+      << timer.elapsed() << " ms, ACMR: " << stats.acmr_before << " -> " << stats.acmr_after
+      << ", levels of detail: " << stats.lods;
+
+    reportProgress(OptimizationProgress);
   }
 
   std::unique_ptr<model::TransformNode> result = processAiNode(m_scene->mRootNode);
@@ -57,6 +234,8 @@ std::unique_ptr<Model> ModelLoader::load(const QString& file_path)
 
   m_model.setRootNode(std::move(result));
 
+  reportProgress(1);
+
   return std::make_unique<Model>(std::move(m_model));
 }
 
@@ -74,21 +253,15 @@ std::unique_ptr<Model> ModelLoader::tryLoad(const QString& file_path) noexcept
   return nullptr;
 }
 
-static QVector3D convertVector(const aiVector3D& vec)
-{
-  return QVector3D(vec.x, vec.y, vec.z);
-}
+// the kernels of attributeconversion.h read the assimp arrays as arrays of floats
+static_assert(sizeof(aiVector3D) == 3 * sizeof(float), "assimp must be built with single-precision floats");
+static_assert(sizeof(aiColor4D) == 4 * sizeof(float), "assimp must be built with single-precision floats");
 
 static RgbColor convertColor(const aiColor3D& c)
 {
   return RgbColor(c.r, c.g, c.b);
 }
 
-static RgbColor convertColor(const aiColor4D& c)
-{
-  return RgbColor(c.r, c.g, c.b);
-}
-
 static QQuaternion convertQuaternion(const aiQuaternion& q)
 {
   return QQuaternion(q.w, q.x, q.y, q.z);
@@ -104,6 +277,59 @@ static QMatrix4x4 convertTransform(const aiMatrix4x4& m)
     );
 }
 
+/**
+ * @brief converts the materials of the scene
+ *
+ * The materials are converted in parallel into a pre-sized array and
+ * appended to the model in the order of the scene.
+ */
+void ModelLoader::convertMaterials()
+{
+  std::vector<std::unique_ptr<model::Material>> materials{ m_scene->mNumMaterials };
+
+  parallel_for(materials.size(), [this, &materials](size_t i) {
+    materials[i] = processAiMaterial(m_scene->mMaterials[i]);
+  }, m_max_threads);
+
+  for (std::unique_ptr<model::Material>& mat : materials)
+  {
+    m_model.appendMaterial(std::move(mat));
+  }
+}
+
+/**
+ * @brief converts the meshes of the scene
+ *
+ * The meshes are converted in parallel into a pre-sized array and
+ * appended to the model in the order of the scene, so that the result
+ * does not depend on the scheduling of the threads.
+ * The materials must have been converted before.
+ *
+ * The progress is reported from the calling thread only.
+ */
+void ModelLoader::convertMeshes()
+{
+  std::vector<std::unique_ptr<model::Mesh>> meshes{ m_scene->mNumMeshes };
+  std::atomic<size_t> converted{ 0 };
+  const std::thread::id caller = std::this_thread::get_id();
+
+  parallel_for(meshes.size(), [this, &meshes, &converted, caller](size_t i) {
+    meshes[i] = processAiMesh(m_scene->mMeshes[i]);
+
+    const size_t n = ++converted;
+
+    if (std::this_thread::get_id() == caller)
+    {
+      reportProgress(ImportProgress + (ConversionProgress - ImportProgress) * n / meshes.size());
+    }
+  }, m_max_threads);
+
+  for (std::unique_ptr<model::Mesh>& mesh : meshes)
+  {
+    m_model.appendMesh(std::move(mesh));
+  }
+}
+
 std::unique_ptr<model::Material> ModelLoader::processAiMaterial(const aiMaterial* ai_mat)
 {
   if (ai_mat->GetTextureCount(aiTextureType_DIFFUSE) > 0)
@@ -142,15 +368,14 @@ std::unique_ptr<model::Mesh> ModelLoader::processAiMesh(aiMesh* ai_mesh)
   if (ai_mesh->mNumVertices <= 0)
     throw std::runtime_error("No vertices in mesh");
 
-  mymesh->vertices.reserve(ai_mesh->mNumVertices);
+  const size_t vertex_count = ai_mesh->mNumVertices;
 
-  // Get Vertices
-  for (uint i = 0; i < ai_mesh->mNumVertices; ++i)
-  {
-    mymesh->vertices.push_back(convertVector(ai_mesh->mVertices[i]));
-  }
+  // the attributes are converted in bulk, straight into the output arrays
+  mymesh->vertices.resize(vertex_count);
+  convert_vec3(&ai_mesh->mVertices[0].x, vertex_count, mymesh->vertices.data());
 
-  mymesh->indices.reserve(ai_mesh->mNumFaces * 3);
+  mymesh->indices.resize(size_t(ai_mesh->mNumFaces) * 3);
+  size_t index_count = 0;
 
   // Get ai_mesh faces / indexes
   for (uint t = 0; t < ai_mesh->mNumFaces; ++t)
@@ -164,49 +389,40 @@ std::unique_ptr<model::Mesh> ModelLoader::processAiMesh(aiMesh* ai_mesh)
       continue;
     }
 
-    mymesh->indices.push_back(face.mIndices[0]);
-    mymesh->indices.push_back(face.mIndices[1]);
-    mymesh->indices.push_back(face.mIndices[2]);
+    mymesh->indices[index_count++] = face.mIndices[0];
+    mymesh->indices[index_count++] = face.mIndices[1];
+    mymesh->indices[index_count++] = face.mIndices[2];
   }
 
+  mymesh->indices.resize(index_count);
+
   // Colors
   if (ai_mesh->mColors[0])
   {
-    mymesh->colors.reserve(mymesh->vertices.size());
-
-    for (uint i = 0; i < ai_mesh->mNumVertices; ++i)
-    {
-      const aiColor4D& c = ai_mesh->mColors[0][i];
-      mymesh->colors.push_back(convertColor(c));
-    }
+    mymesh->colors.resize(vertex_count);
+    convert_colors(&ai_mesh->mColors[0][0].r, vertex_count, mymesh->colors.data());
   }
 
   // Texture coordinates
   if (ai_mesh->HasTextureCoords(0))
   {
-    mymesh->uv.reserve(ai_mesh->mNumVertices);
-
-    for (uint i = 0; i < ai_mesh->mNumVertices; ++i)
-    {
-      const aiVector3D& tcoord = ai_mesh->mTextureCoords[0][i];
-      mymesh->uv.push_back(QVector2D(tcoord.x, tcoord.y));
-    }
+    mymesh->uv.resize(vertex_count);
+    convert_texcoords(&ai_mesh->mTextureCoords[0][0].x, vertex_count, mymesh->uv.data());
   }
 
   // Normals
   if (ai_mesh->HasNormals())
   {
-    mymesh->normals.reserve(ai_mesh->mNumVertices);
-
-    for (uint i = 0; i < ai_mesh->mNumVertices; ++i)
-    {
-      mymesh->normals.push_back(convertVector(ai_mesh->mNormals[i]));
-    }
+    mymesh->normals.resize(vertex_count);
+    convert_vec3(&ai_mesh->mNormals[0].x, vertex_count, mymesh->normals.data());
   }
 
   mymesh->material = m_model.getMaterial(ai_mesh->mMaterialIndex);
 
-  mymesh->boundingbox = AABB(convertVector(ai_mesh->mAABB.mMin), convertVector(ai_mesh->mAABB.mMax));
+  for (const QVector3D& v : mymesh->vertices)
+  {
+    mymesh->boundingbox.extend(v);
+  }
 
   return mymesh;
 }
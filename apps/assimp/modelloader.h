@@ -5,23 +5,64 @@
 #pragma once
 
 #include "model.h"
+#include "modelcache.h"
 
 #include <assimp/matrix4x4.h>
 
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <stdexcept>
 
 struct aiScene;
 struct aiNode;
 struct aiMesh;
 struct aiMaterial;
 
+/**
+ * @brief exception thrown by ModelLoader::load() when the progress callback cancels the loading
+ */
+class ModelLoadingCanceled : public std::runtime_error
+{
+public:
+  ModelLoadingCanceled();
+};
+
 class ModelLoader
 {
 public:
   std::unique_ptr<Model> load(const QString& filePath);
   std::unique_ptr<Model> tryLoad(const QString& filePath) noexcept;
 
+  /**
+   * @brief function receiving the progress of the loading, between 0 and 1
+   *
+   * The function is called from the thread calling load(); it returns
+   * false to cancel the loading.
+   */
+  using ProgressCallback = std::function<bool(float)>;
+
+  void setProgressCallback(ProgressCallback callback);
+
+  bool optimizeMeshes() const;
+  void setOptimizeMeshes(bool on);
+
+  bool generateLods() const;
+  void setGenerateLods(bool on);
+
+  size_t maxThreads() const;
+  void setMaxThreads(size_t n);
+
+  const QString& cacheDirectory() const;
+  void setCacheDirectory(const QString& dir);
+
+  uint32_t importFlags() const;
+
 private:
+  std::unique_ptr<Model> import(const QString& filePath);
+  void reportProgress(float progress);
+  void convertMaterials();
+  void convertMeshes();
   std::unique_ptr<model::Material> processAiMaterial(const aiMaterial* ai_mat);
   std::unique_ptr<model::Mesh> processAiMesh(aiMesh* ai_mesh);
 
@@ -30,4 +71,71 @@ private:
 private:
   Model m_model;
   const aiScene* m_scene = nullptr;
+  bool m_optimize_meshes = true;
+  bool m_generate_lods = false;
+  size_t m_max_threads = 0;
+  QString m_cache_dir = default_model_cache_dir();
+  ProgressCallback m_progress_callback;
 };
+
+inline bool ModelLoader::optimizeMeshes() const
+{
+  return m_optimize_meshes;
+}
+
+/**
+ * @brief sets whether the triangles and vertices of the meshes are reordered after loading
+ *
+ * @sa optimize_mesh()
+ */
+inline void ModelLoader::setOptimizeMeshes(bool on)
+{
+  m_optimize_meshes = on;
+}
+
+inline bool ModelLoader::generateLods() const
+{
+  return m_generate_lods;
+}
+
+/**
+ * @brief sets whether levels of detail are generated for the meshes
+ *
+ * @sa generate_lods()
+ */
+inline void ModelLoader::setGenerateLods(bool on)
+{
+  m_generate_lods = on;
+}
+
+inline size_t ModelLoader::maxThreads() const
+{
+  return m_max_threads;
+}
+
+/**
+ * @brief sets the maximum number of threads used for converting and optimizing the meshes
+ *
+ * The default value, 0, uses as many threads as there are cores.
+ */
+inline void ModelLoader::setMaxThreads(size_t n)
+{
+  m_max_threads = n;
+}
+
+inline const QString& ModelLoader::cacheDirectory() const
+{
+  return m_cache_dir;
+}
+
+/**
+ * @brief sets the directory in which the imported models are cached
+ *
+ * An empty string disables the cache.
+ *
+ * @sa read_model_cache(), write_model_cache()
+ */
+inline void ModelLoader::setCacheDirectory(const QString& dir)
+{
+  m_cache_dir = dir;
+}
@@ -0,0 +1,81 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "modeloptions.h"
+
+#include "modelloader.h"
+
+#include <QCommandLineParser>
+
+#include <QDebug>
+
+/**
+ * @brief adds the options controlling the loading and rendering of models to a command line parser
+ *
+ * The following options are added:
+ * - "vertex-layout <layout>": "separate", "interleaved" (default) or "compact"
+ * - "draw-mode <mode>": "mesh" or "indirect" (default)
+ * - "no-sort-draws": draws the meshes in scene-graph order in "mesh" mode
+ * - "no-optimize-meshes": keeps the triangles and vertices in the order of the file
+ * - "mesh-lods": generates levels of detail for the meshes
+ * - "model-cache-dir <dir>": directory of the model cache (default: see default_model_cache_dir())
+ * - "no-model-cache": disables the model cache
+ */
+void add_model_options(QCommandLineParser& parser)
+{
+  parser.addOption(QCommandLineOption("vertex-layout", "Storage of the vertex attributes: separate, interleaved or compact.", "layout", "interleaved"));
+  parser.addOption(QCommandLineOption("draw-mode", "Submission of the meshes: mesh (one draw call per mesh) or indirect.", "mode", "indirect"));
+  parser.addOption(QCommandLineOption("no-sort-draws", "Draws the meshes in scene-graph order instead of sorting them by state."));
+  parser.addOption(QCommandLineOption("no-optimize-meshes", "Does not reorder the triangles and vertices of the meshes after loading."));
+  parser.addOption(QCommandLineOption("mesh-lods", "Generates levels of detail for the meshes after loading."));
+  parser.addOption(QCommandLineOption("model-cache-dir", "Directory in which the imported models are cached.", "dir"));
+  parser.addOption(QCommandLineOption("no-model-cache", "Imports the models without reading or writing the model cache."));
+}
+
+/**
+ * @brief reads the model options from a command line parser
+ *
+ * Invalid values are reported and replaced by the default ones.
+ */
+ModelOptions model_options(const QCommandLineParser& parser)
+{
+  ModelOptions result;
+
+  const QString layout = parser.value("vertex-layout").toLower();
+
+  if (layout == "separate")
+    result.vertex_layout = VertexLayout::Separate;
+  else if (layout == "compact")
+    result.vertex_layout = VertexLayout::Compact;
+  else if (layout != "interleaved")
+    qWarning() << "unknown vertex layout" << layout;
+
+  const QString mode = parser.value("draw-mode").toLower();
+
+  if (mode == "mesh")
+    result.draw_mode = ModelDrawMode::PerMesh;
+  else if (mode != "indirect")
+    qWarning() << "unknown draw mode" << mode;
+
+  result.sort_draws = !parser.isSet("no-sort-draws");
+  result.optimize_meshes = !parser.isSet("no-optimize-meshes");
+  result.generate_lods = parser.isSet("mesh-lods");
+
+  if (parser.isSet("no-model-cache"))
+    result.cache_dir.clear();
+  else if (parser.isSet("model-cache-dir"))
+    result.cache_dir = parser.value("model-cache-dir");
+
+  return result;
+}
+
+/**
+ * @brief applies the loading options to a model loader
+ */
+void configure_loader(ModelLoader& loader, const ModelOptions& options)
+{
+  loader.setOptimizeMeshes(options.optimize_meshes);
+  loader.setGenerateLods(options.generate_lods);
+  loader.setCacheDirectory(options.cache_dir);
+}
@@ -0,0 +1,34 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "meshvertexformat.h"
+#include "modelcache.h"
+#include "modelrenderer.h"
+
+class QCommandLineParser;
+
+class ModelLoader;
+
+/**
+ * @brief options controlling how the models are loaded and drawn
+ *
+ * The options are set on the Q3dModel; the scene applies them to its
+ * renderer when it synchronizes with the window.
+ */
+struct ModelOptions
+{
+  VertexLayout vertex_layout = VertexLayout::Interleaved;
+  ModelDrawMode draw_mode = ModelDrawMode::MultiDrawIndirect;
+  bool sort_draws = true;
+  bool optimize_meshes = true;
+  bool generate_lods = false;
+  QString cache_dir = default_model_cache_dir(); ///< empty if the models are not cached
+};
+
+void add_model_options(QCommandLineParser& parser);
+ModelOptions model_options(const QCommandLineParser& parser);
+
+void configure_loader(ModelLoader& loader, const ModelOptions& options);
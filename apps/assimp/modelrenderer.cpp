@@ -4,11 +4,30 @@
 
 #include "modelrenderer.h"
 
+#include "texturedecoding.h"
+
 #include "appcommon/coloredvertex.h"
 #include "appcommon/openglbuffer.h"
 
+#include <qmlgl/rendertaskqueue.h>
+
+#include <QDateTime>
 #include <QDir>
 #include <QFileInfo>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFunctions_4_3_Core>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include <QDebug>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <tuple>
 
 ModelRendererUberShader::ModelRendererUberShader() : UberShader(":/shaders/model.vert", ":/shaders/model.frag")
 {
@@ -34,6 +53,20 @@ QOpenGLShaderProgram* ModelRendererUberShader::getProgram(Config conf)
     defines.emplace_back("MESH_HAS_NORMALS");
   }
 
+  if (conf.multi_draw)
+  {
+    defines.emplace_back("MULTI_DRAW_INDIRECT");
+  }
+  else if (conf.instanced)
+  {
+    defines.emplace_back("MESH_INSTANCED");
+  }
+
+  if (conf.compact)
+  {
+    defines.emplace_back("MESH_COMPACT");
+  }
+
   if (conf.material.is<model::material::FlatColorMaterial>())
   {
     defines.emplace_back("MATERIAL_FLAT_COLOR");
@@ -62,197 +95,1705 @@ Model* ModelRenderer::model() const
   return m_model;
 }
 
+/**
+ * @brief sets the model to render
+ *
+ * The resources of the previous model are released, except the shader
+ * programs which do not depend on the model.
+ * Resources held by the resource manager (if any) are kept until the manager
+ * evicts them, which makes reloading a model that was recently displayed instant.
+ */
 void ModelRenderer::setModel(Model* m)
 {
   if (m_model != m)
   {
-    releaseResources();
+    releaseModelResources();
     m_model = m;
   }
 }
 
+/**
+ * @brief sets the queue in which the creation of the OpenGL resources is scheduled
+ * @param queue  the queue, may be null
+ *
+ * If a queue is set, the buffers of the meshes and the textures are created
+ * by tasks executed progressively over the next frames; meshes are not drawn
+ * until their buffers are ready, and are drawn with a placeholder texture
+ * until their texture is ready.
+ * Otherwise, the resources are created during the first call to draw().
+ */
+void ModelRenderer::setTaskQueue(RenderTaskQueue* queue)
+{
+  m_task_queue = queue;
+
+  std::lock_guard<std::mutex> lock{ m_task_queue_handle->mutex };
+  m_task_queue_handle->queue = queue;
+}
+
+/**
+ * @brief sets the manager with which the buffers and textures are shared
+ * @param manager  the manager, may be null
+ *
+ * Buffers are identified by the hash of the mesh data, and textures by their
+ * file path and modification time.
+ */
+void ModelRenderer::setResourceManager(GpuResourceManager* manager)
+{
+  if (m_resource_manager != manager)
+  {
+    releaseModelResources();
+    m_resource_manager = manager;
+  }
+}
+
+VertexLayout ModelRenderer::vertexLayout() const
+{
+  return m_vertex_layout;
+}
+
+/**
+ * @brief sets how the vertex attributes are stored in the buffers
+ *
+ * The buffers of the meshes are created again with the new layout.
+ */
+void ModelRenderer::setVertexLayout(VertexLayout layout)
+{
+  if (m_vertex_layout != layout)
+  {
+    releaseModelResources();
+    m_vertex_layout = layout;
+  }
+}
+
+ModelDrawMode ModelRenderer::drawMode() const
+{
+  return m_draw_mode;
+}
+
+/**
+ * @brief sets how the meshes are submitted to OpenGL
+ *
+ * In ModelDrawMode::MultiDrawIndirect mode, the vertices are always interleaved,
+ * regardless of vertexLayout().
+ * If the OpenGL context does not support glMultiDrawElementsIndirect(),
+ * the meshes are drawn one by one.
+ */
+void ModelRenderer::setDrawMode(ModelDrawMode mode)
+{
+  m_draw_mode = mode;
+}
+
+bool ModelRenderer::sortDraws() const
+{
+  return m_sort_draws;
+}
+
+/**
+ * @brief sets whether meshes drawn one by one are sorted to minimize state changes
+ *
+ * When enabled, the meshes are sorted by shader program, material, texture and VAO,
+ * and then front-to-back.
+ * Otherwise, they are drawn in the order of the scene graph.
+ * This has no effect in ModelDrawMode::MultiDrawIndirect mode, in which the meshes
+ * are always grouped by state.
+ */
+void ModelRenderer::setSortDraws(bool on)
+{
+  m_sort_draws = on;
+}
+
+bool ModelRenderer::frustumCulling() const
+{
+  return m_frustum_culling;
+}
+
+/**
+ * @brief sets whether mesh nodes outside of the view frustum are skipped
+ *
+ * Culling is enabled by default.
+ * The number of culled meshes is reported in statistics().
+ */
+void ModelRenderer::setFrustumCulling(bool on)
+{
+  m_frustum_culling = on;
+}
+
+bool ModelRenderer::instancing() const
+{
+  return m_instancing;
+}
+
+/**
+ * @brief sets whether mesh nodes sharing the same mesh are drawn with instancing
+ *
+ * When drawing the meshes one by one, consecutive draws of the same mesh
+ * (with the same material) are merged into one glDrawElementsInstanced() call,
+ * the model matrices being read from a per-instance attribute buffer.
+ * This is enabled by default and has no effect in ModelDrawMode::MultiDrawIndirect
+ * mode, in which repeated meshes are always instanced.
+ */
+void ModelRenderer::setInstancing(bool on)
+{
+  m_instancing = on;
+}
+
+float ModelRenderer::lodErrorThreshold() const
+{
+  return m_lod_error_threshold;
+}
+
+/**
+ * @brief sets the maximum error, in pixels, of the levels of detail that are drawn
+ *
+ * For each mesh node, the coarsest level of detail whose error projected
+ * on the viewport is below the threshold is drawn.
+ * The default is one pixel, which makes the transitions between levels
+ * hardly noticeable.
+ *
+ * @sa generate_lods()
+ */
+void ModelRenderer::setLodErrorThreshold(float pixels)
+{
+  m_lod_error_threshold = pixels;
+}
+
+/**
+ * @brief draws the model in a viewport
+ *
+ * Unlike the overload taking only the matrices, this selects the
+ * levels of detail of the meshes for the size of the viewport.
+ */
+void ModelRenderer::draw(QOpenGLFunctions* gl, const AppViewportRenderData& view)
+{
+  m_lod_viewport = view.viewport;
+  m_lod_viewport_height = view.rect.height();
+
+  draw(gl, view.projection_matrix, view.view_matrix);
+
+  m_lod_viewport = nullptr;
+  m_lod_viewport_height = 0;
+}
+
 void ModelRenderer::draw(QOpenGLFunctions* gl, const QMatrix4x4& projectionMatrix, const QMatrix4x4& viewMatrix)
 {
   if (model() && model()->rootNode())
   {
-    recursiveDraw(gl, projectionMatrix, viewMatrix, QMatrix4x4(), model()->rootNode());
+    updateVisibility(projectionMatrix * viewMatrix);
+    updateLevelsOfDetail(projectionMatrix, viewMatrix);
+
+    QOpenGLFunctions_4_3_Core* gl43 = m_draw_mode == ModelDrawMode::MultiDrawIndirect ? multiDrawFunctions() : nullptr;
+
+    if (gl43)
+    {
+      drawIndirect(gl43, projectionMatrix, viewMatrix);
+    }
+    else
+    {
+      collectDrawItems(gl, viewMatrix);
+      submitDrawItems(gl, projectionMatrix, viewMatrix);
+    }
+
+    releaseVertexArray();
     releaseTexture();
     releaseShaderProgram();
   }
 }
 
-void ModelRenderer::recursiveDraw(QOpenGLFunctions* gl, const QMatrix4x4& projectionMatrix, const QMatrix4x4& viewMatrix, const QMatrix4x4& modelMatrix, model::SceneNode* node)
+/**
+ * @brief returns the number of draw calls and state changes since the last call to resetStatistics()
+ */
+const ModelRenderStatistics& ModelRenderer::statistics() const
 {
-  if (node->isTranformNode())
+  return m_statistics;
+}
+
+void ModelRenderer::resetStatistics()
+{
+  m_statistics = ModelRenderStatistics();
+}
+
+/**
+ * @brief computes which mesh nodes are inside the view frustum
+ *
+ * The bounding volume hierarchy of the model is used so that
+ * the cost of culling depends on the visible part of the model.
+ */
+void ModelRenderer::updateVisibility(const QMatrix4x4& viewProjectionMatrix)
+{
+  const std::vector<int>& nodes = model()->hierarchy().meshNodes();
+
+  // the hierarchy may be outdated if Model::updateBounds() was not called
+  if (m_frustum_culling && model()->bvh().size() == nodes.size())
+  {
+    FrustumPlanes frustum{ viewProjectionMatrix };
+    model()->bvh().cull(frustum, m_node_visibility);
+  }
+  else
   {
-    auto& trnode = static_cast<model::TransformNode&>(*node);
-    QMatrix4x4 tr = modelMatrix * trnode.transformMatrix();
-    
-    for (const auto& child : trnode.children())
+    m_node_visibility.reset(nodes.size());
+
+    for (size_t i(0); i < nodes.size(); ++i)
     {
-      recursiveDraw(gl, projectionMatrix, viewMatrix, tr, child.get());
+      m_node_visibility.set(i);
     }
   }
-  else if (node->isMeshNode())
+
+  const int visible = static_cast<int>(m_node_visibility.count());
+  m_statistics.drawn_meshes += visible;
+  m_statistics.culled_meshes += static_cast<int>(nodes.size()) - visible;
+}
+
+namespace
+{
+
+// a coarser level is only selected if its error is below this fraction
+// of the threshold, so that nodes near the threshold do not switch every frame
+constexpr float LodHysteresis = 0.8f;
+
+float max_scale(const QMatrix4x4& m)
+{
+  return std::max({ m.column(0).toVector3D().length(), m.column(1).toVector3D().length(), m.column(2).toVector3D().length() });
+}
+
+} // namespace
+
+/**
+ * @brief selects the level of detail of the visible mesh nodes
+ *
+ * The error of a level is projected at the point of the bounding sphere
+ * of the node that is the closest to the camera, which works for both
+ * perspective and orthographic projections.
+ * Levels are only selected if the size of the viewport is known, see draw().
+ */
+void ModelRenderer::updateLevelsOfDetail(const QMatrix4x4& projectionMatrix, const QMatrix4x4& viewMatrix)
+{
+  const model::SceneHierarchy& hierarchy = model()->hierarchy();
+  const std::vector<int>& nodes = hierarchy.meshNodes();
+
+  std::vector<uint8_t>& levels = m_lod_levels[m_lod_viewport];
+  levels.resize(nodes.size(), 0);
+  m_node_lods = &levels;
+  m_lods_selected = false;
+
+  if (m_lod_viewport_height <= 0)
+  {
+    std::fill(levels.begin(), levels.end(), 0);
+    return;
+  }
+
+  // size in pixels of a unit length at w = 1
+  const float pixels_per_unit = projectionMatrix(1, 1) * 0.5f * m_lod_viewport_height;
+
+  for (size_t i(0); i < nodes.size(); ++i)
   {
-    auto& meshnode = static_cast<model::MeshNode&>(*node);
+    const model::Mesh* mesh = hierarchy.mesh(nodes[i]);
 
-    QOpenGLVertexArrayObject& vao = get_vao(gl, meshnode.mesh());
+    if (!m_node_visibility.test(i) || mesh->lods.empty())
+    {
+      continue;
+    }
 
-    ModelRendererUberShader::Config shadconf = get_ubershader_conf(*meshnode.mesh());
-    QOpenGLShaderProgram* shader_program = m_ubershader.getProgram(shadconf);
+    const AABB& box = hierarchy.worldBoundingBox(nodes[i]);
+    const float radius = 0.5f * (box.max - box.min).length();
+    const float z = viewMatrix.map(box.center()).z() + radius;
+    const float w = projectionMatrix(3, 2) * z + projectionMatrix(3, 3);
 
-    if (!shader_program)
+    if (w <= 0)
     {
-      return;
+      // the camera is inside the bounding sphere
+      levels[i] = 0;
+      continue;
     }
 
-    vao.bind();
+    const float error_to_pixels = max_scale(hierarchy.worldTransform(nodes[i])) * pixels_per_unit / w;
+    const int level_count = static_cast<int>(mesh->lods.size()) + 1;
 
-    bindShaderProgram(*shader_program);
+    auto projected_error = [mesh, error_to_pixels](int level) {
+      return level == 0 ? 0.f : mesh->lods[level - 1].error * error_to_pixels;
+    };
 
-    shader_program->setUniformValue("model_matrix", modelMatrix);
-    shader_program->setUniformValue("view_matrix", viewMatrix);
-    shader_program->setUniformValue("projection_matrix", projectionMatrix);
+    int level = std::min<int>(levels[i], level_count - 1);
 
-    if (shadconf.material.is<model::material::FlatColorMaterial>())
+    while (level > 0 && projected_error(level) > m_lod_error_threshold)
     {
-      auto& material = shadconf.material.as<model::material::FlatColorMaterial>();
-      shader_program->setUniformValue("flat_color", QColor(material.color));
+      --level;
     }
-    else if (shadconf.material.is<model::material::TextureMaterial>())
+
+    while (level + 1 < level_count && projected_error(level + 1) <= LodHysteresis * m_lod_error_threshold)
     {
-      auto& material = shadconf.material.as<model::material::TextureMaterial>();
-      QOpenGLTexture& texture = get_texture(material.texture_path);
-      bindTexture(texture);
-      shader_program->setUniformValue("texture_diffuse", 0);
+      ++level;
     }
 
-    gl->glDrawElements(GL_TRIANGLES, meshnode.mesh()->indices.size(), GL_UNSIGNED_INT, nullptr);
-
-    // No neeed to release the shader program (the active one will be released when rendering is completed)
-    // shader_program.release();
-
-    vao.release();
+    levels[i] = static_cast<uint8_t>(level);
+    m_lods_selected = m_lods_selected || level > 0;
   }
 }
 
-void ModelRenderer::releaseResources()
+/**
+ * @brief returns the level of detail selected for a mesh node in the current viewport
+ * @param meshNode  index of the node in SceneHierarchy::meshNodes()
+ */
+int ModelRenderer::levelOfDetail(int meshNode) const
 {
-  m_ubershader.clearCache();
-  m_mesh_render_data.clear();
-  m_textures.clear();
+  return m_node_lods && meshNode < static_cast<int>(m_node_lods->size()) ? (*m_node_lods)[meshNode] : 0;
 }
 
-QOpenGLVertexArrayObject& ModelRenderer::get_vao(QOpenGLFunctions* gl, model::Mesh* mesh)
+/**
+ * @brief returns the OpenGL 4.3 functions, or null if the current context does not provide them
+ */
+QOpenGLFunctions_4_3_Core* ModelRenderer::multiDrawFunctions()
 {
-  auto& entry = m_mesh_render_data[mesh];
-
-  if (!entry)
+  if (!m_multi_draw_checked)
   {
-    entry = std::make_unique<MeshRenderData>();
-  }
+    m_multi_draw_checked = true;
 
-  if (entry->m_vao)
-  {
-    return *(entry->m_vao);
+    QOpenGLContext* context = QOpenGLContext::currentContext();
+    auto* functions = context ? context->versionFunctions<QOpenGLFunctions_4_3_Core>() : nullptr;
+
+    if (functions && functions->initializeOpenGLFunctions())
+    {
+      m_multi_draw_functions = functions;
+    }
+    else
+    {
+      qWarning() << "glMultiDrawElementsIndirect() is not available, meshes will be drawn one by one";
+    }
   }
 
-  entry->m_vao = std::make_unique<QOpenGLVertexArrayObject>();
-  entry->m_vao->create();
+  return m_multi_draw_functions;
+}
 
-  entry->m_vao->bind();
+/**
+ * @brief draws the model with one glMultiDrawElementsIndirect() call per draw group
+ */
+void ModelRenderer::drawIndirect(QOpenGLFunctions_4_3_Core* gl, const QMatrix4x4& projectionMatrix, const QMatrix4x4& viewMatrix)
+{
+  ModelBatchRenderData* batch = get_batch(gl);
 
+  if (!batch)
   {
-    BufferSpecs specs = BufferSpecsBuilder().index(0).tuplesize(3).type(GL_FLOAT);
-    setup_buffer(entry->m_vertex_buffer, gl, buffer_data_from_vector(mesh->vertices), specs);
+    // the resources are still being created
+    return;
   }
 
-  {
-    setup_index_buffer(entry->m_index_buffer, gl, buffer_data_from_vector(mesh->indices));
-  }
+  // the commands of the culled nodes are removed from a copy of the
+  // indirect buffer, the first command of each group is recomputed;
+  // the copy is also used to select the levels of detail
+  const bool all_visible = m_node_visibility.all() && !m_lods_selected;
+  std::vector<int> group_offsets;
 
-  if (!mesh->colors.empty())
+  if (all_visible)
   {
-    BufferSpecs specs = BufferSpecsBuilder().index(2).tuplesize(3).type(GL_UNSIGNED_BYTE);
-    setup_buffer(entry->m_color_buffer, gl, buffer_data_from_vector(mesh->colors), specs);
-  }
+    gl->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, batch->m_indirect_buffer->bufferId());
 
-  if (!mesh->uv.empty())
+    for (const DrawElementsIndirectCommand& cmd : batch->m_commands)
+    {
+      m_statistics.drawn_triangles += qint64(cmd.count / 3) * cmd.instance_count;
+    }
+  }
+  else
   {
-    BufferSpecs specs = BufferSpecsBuilder().index(3).tuplesize(2).type(GL_FLOAT);
-    setup_buffer(entry->m_uv_buffer, gl, buffer_data_from_vector(mesh->uv), specs);
+    m_visible_commands.clear();
+    group_offsets.reserve(batch->m_groups.size() + 1);
+
+    for (const ModelBatchRenderData::DrawGroup& group : batch->m_groups)
+    {
+      group_offsets.push_back(static_cast<int>(m_visible_commands.size()));
+
+      for (int i = group.first_command; i < group.first_command + group.command_count; ++i)
+      {
+        // instanced commands are split into runs of visible instances
+        // with the same level of detail
+        DrawElementsIndirectCommand cmd = batch->m_commands[i];
+        const std::vector<IndexRange>& lods = batch->m_command_lods[i];
+        const GLuint end = cmd.base_instance + cmd.instance_count;
+        GLuint first = cmd.base_instance;
+        int run_level = -1;
+
+        for (GLuint instance = cmd.base_instance; instance <= end; ++instance)
+        {
+          int level = -1;
+
+          if (instance < end && m_node_visibility.test(batch->m_instance_nodes[instance]))
+          {
+            level = std::min<int>(levelOfDetail(batch->m_instance_nodes[instance]), static_cast<int>(lods.size()) - 1);
+          }
+
+          if (instance == end || level != run_level)
+          {
+            if (run_level >= 0)
+            {
+              cmd.base_instance = first;
+              cmd.instance_count = instance - first;
+              cmd.first_index = lods[run_level].first;
+              cmd.count = lods[run_level].count;
+              m_visible_commands.push_back(cmd);
+              m_statistics.drawn_triangles += qint64(cmd.count / 3) * cmd.instance_count;
+            }
+
+            first = instance;
+            run_level = level;
+          }
+        }
+      }
+    }
+
+    group_offsets.push_back(static_cast<int>(m_visible_commands.size()));
+
+    if (!m_visible_commands_buffer)
+    {
+      m_visible_commands_buffer = std::make_unique<QOpenGLBuffer>(QOpenGLBuffer::VertexBuffer);
+      m_visible_commands_buffer->create();
+      m_visible_commands_buffer->setUsagePattern(QOpenGLBuffer::StreamDraw);
+    }
+
+    m_visible_commands_buffer->bind();
+    m_visible_commands_buffer->allocate(m_visible_commands.data(), static_cast<int>(m_visible_commands.size() * sizeof(DrawElementsIndirectCommand)));
+    m_visible_commands_buffer->release();
+
+    gl->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_visible_commands_buffer->bufferId());
   }
 
-  if (!mesh->normals.empty())
+  for (size_t g(0); g < batch->m_groups.size(); ++g)
   {
-    BufferSpecs specs = BufferSpecsBuilder().index(4).tuplesize(3).type(GL_FLOAT);
-    setup_buffer(entry->m_normal_buffer, gl, buffer_data_from_vector(mesh->normals), specs);
-  }
- 
-  entry->m_vao->release();
+    const ModelBatchRenderData::DrawGroup& group = batch->m_groups[g];
+    const int first_command = all_visible ? group.first_command : group_offsets[g];
+    const int command_count = all_visible ? group.command_count : group_offsets[g + 1] - group_offsets[g];
 
-  return *(entry->m_vao);
-}
+    if (command_count == 0)
+    {
+      continue;
+    }
 
-ModelRendererUberShader::Config ModelRenderer::get_ubershader_conf(const model::Mesh& mesh) const
-{
-  ModelRendererUberShader::Config conf;
-  conf.has_colors = !mesh.colors.empty();
-  conf.has_uv = !mesh.uv.empty();
-  conf.has_normals = !mesh.normals.empty();
-  conf.material = *(mesh.material);
+    QOpenGLTexture* texture = nullptr;
 
-  if (conf.material.is<model::material::DefaultMaterial>())
-  {
-    if (conf.has_colors)
+    if (group.config.material.is<model::material::TextureMaterial>())
     {
-      conf.material = model::Material(model::material::VertexColorMaterial());
+      auto& material = group.config.material.as<model::material::TextureMaterial>();
+      texture = get_texture(material.texture_path);
     }
-    else
+
+    QOpenGLShaderProgram* shader_program = m_ubershader.getProgram(group.config);
+
+    if (!shader_program)
     {
-      conf.material = model::Material(model::material::FlatColorMaterial(RgbColor(128, 128, 128)));
+      continue;
+    }
+
+    bindVertexArray(*batch->m_vaos.at(group.vao));
+    bindShaderProgram(*shader_program);
+
+    shader_program->setUniformValue("view_matrix", viewMatrix);
+    shader_program->setUniformValue("projection_matrix", projectionMatrix);
+
+    if (texture)
+    {
+      bindTexture(*texture);
+      shader_program->setUniformValue("texture_diffuse", 0);
     }
+
+    const size_t offset = first_command * sizeof(DrawElementsIndirectCommand);
+    gl->glMultiDrawElementsIndirect(GL_TRIANGLES, batch->m_index_type, reinterpret_cast<const void*>(offset), command_count, 0);
+    ++m_statistics.draw_calls;
   }
 
-  return conf;
+  gl->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 }
 
-void ModelRenderer::bindShaderProgram(QOpenGLShaderProgram& shader_program)
+namespace
 {
-  if (&shader_program != m_current_shader_program)
-  {
-    m_current_shader_program = &shader_program;
-    shader_program.bind();
-  }
+
+/**
+ * @brief returns the identifier of an object, the next free one if it has none yet
+ */
+uint32_t dense_id(std::unordered_map<const void*, uint32_t>& ids, const void* object)
+{
+  return ids.emplace(object, static_cast<uint32_t>(ids.size())).first->second;
 }
 
-void ModelRenderer::releaseShaderProgram()
+} // namespace
+
+/**
+ * @brief fills the render queue with the visible mesh nodes of the model
+ *
+ * Mesh nodes whose resources are not ready yet are skipped.
+ */
+void ModelRenderer::collectDrawItems(QOpenGLFunctions* gl, const QMatrix4x4& viewMatrix)
 {
-  if (m_current_shader_program)
+  const model::SceneHierarchy& hierarchy = model()->hierarchy();
+
+  m_draw_items.clear();
+  m_render_queue.clear();
+  m_program_ids.clear();
+  m_texture_ids.clear();
+  m_vao_ids.clear();
+
+  const std::vector<int>& nodes = hierarchy.meshNodes();
+
+  for (size_t i(0); i < nodes.size(); ++i)
   {
-    m_current_shader_program->release();
-    m_current_shader_program = nullptr;
+    if (!m_node_visibility.test(i))
+    {
+      continue;
+    }
+
+    const int node = nodes[i];
+    model::Mesh* mesh = hierarchy.mesh(node);
+
+    const MeshRenderData* render_data = get_render_data(gl, mesh);
+    const int level = render_data ? std::min<int>(levelOfDetail(static_cast<int>(i)), static_cast<int>(render_data->m_lods.size()) - 1) : 0;
+
+    ModelRendererUberShader::Config shadconf = get_ubershader_conf(*mesh);
+    QOpenGLTexture* texture = nullptr;
+
+    if (shadconf.material.is<model::material::TextureMaterial>())
+    {
+      auto& material = shadconf.material.as<model::material::TextureMaterial>();
+      texture = get_texture(material.texture_path);
+    }
+
+    if (!render_data)
+    {
+      // the resources are still being created
+      continue;
+    }
+
+    QOpenGLShaderProgram* shader_program = m_ubershader.getProgram(shadconf);
+
+    if (!shader_program)
+    {
+      continue;
+    }
+
+    QOpenGLVertexArrayObject* vao = render_data->m_vao.get();
+    MeshDrawItem item{ mesh, hierarchy.worldTransform(node), vao, render_data, render_data->m_lods.at(level), shader_program, texture, QColor() };
+
+    if (shadconf.material.is<model::material::FlatColorMaterial>())
+    {
+      item.flat_color = QColor(shadconf.material.as<model::material::FlatColorMaterial>().color);
+    }
+
+    const float depth = -viewMatrix.map(hierarchy.worldBoundingBox(node).center()).z();
+
+    const uint64_t key = RenderQueue::makeKey(dense_id(m_program_ids, shader_program),
+      materialId(mesh->material),
+      dense_id(m_texture_ids, texture),
+      dense_id(m_vao_ids, vao),
+      depth);
+
+    m_render_queue.push(key, static_cast<uint32_t>(m_draw_items.size()));
+    m_draw_items.push_back(item);
   }
 }
 
-QOpenGLTexture& ModelRenderer::get_texture(const QString& path)
+namespace
 {
-  auto it = m_textures.find(path);
 
-  if (it != m_textures.end())
+// vertex attribute locations of the per-instance and per-draw data, see model.vert
+constexpr GLuint InstanceMatrixLocation = 5;
+constexpr GLuint InstanceColorLocation = 9;
+constexpr GLuint InstancePositionOriginLocation = 10;
+constexpr GLuint InstancePositionScaleLocation = 11;
+
+} // namespace
+
+/**
+ * @brief draws the content of the render queue
+ *
+ * The uniforms that do not change between draws are only set
+ * when the shader program changes.
+ * If instancing is enabled, runs of draw items sharing the same mesh
+ * and material are drawn with a single instanced draw call.
+ */
+void ModelRenderer::submitDrawItems(QOpenGLFunctions* gl, const QMatrix4x4& projectionMatrix, const QMatrix4x4& viewMatrix)
+{
+  if (m_sort_draws)
   {
-    return *(it->second);
+    m_render_queue.sort();
   }
 
-  auto& texture = m_textures[path];
+  QOpenGLExtraFunctions* glx = QOpenGLContext::currentContext()->extraFunctions();
 
-  QString texturepath = QFileInfo(m_model->path()).dir().filePath(path);
-  QImage image{ texturepath };
+  if (m_instancing)
+  {
+    uploadInstanceMatrices();
+  }
 
-  texture = std::make_unique<QOpenGLTexture>(image.mirrored());
-  
-  return *texture;
+  const std::vector<RenderQueue::Item>& queue = m_render_queue.items();
+  QColor flat_color;
+
+  for (size_t i(0); i < queue.size(); )
+  {
+    const MeshDrawItem& item = m_draw_items[queue[i].index];
+    const size_t count = m_instancing ? instanceRunLength(i) : 1;
+    QOpenGLShaderProgram* program = count > 1 ? instancedProgram(item) : item.program;
+
+    if (!program)
+    {
+      i += count;
+      continue;
+    }
+
+    bindVertexArray(*item.vao);
+
+    if (bindShaderProgram(*program))
+    {
+      program->setUniformValue("view_matrix", viewMatrix);
+      program->setUniformValue("projection_matrix", projectionMatrix);
+      program->setUniformValue("texture_diffuse", 0);
+      flat_color = QColor();
+    }
+
+    if (item.flat_color.isValid() && item.flat_color != flat_color)
+    {
+      flat_color = item.flat_color;
+      program->setUniformValue("flat_color", flat_color);
+    }
+
+    if (item.texture)
+    {
+      bindTexture(*item.texture);
+    }
+
+    if (m_vertex_layout == VertexLayout::Compact)
+    {
+      program->setUniformValue("position_origin", item.render_data->m_position_origin);
+      program->setUniformValue("position_scale", item.render_data->m_position_scale);
+    }
+
+    const GLenum index_type = item.render_data->m_index_type;
+    const GLvoid* indices = reinterpret_cast<const GLvoid*>(uintptr_t(item.indices.first) * gl_type_size(index_type));
+    m_statistics.drawn_triangles += qint64(item.indices.count / 3) * qint64(count);
+
+    if (count > 1)
+    {
+      // the VAO of the mesh is pointed at the matrices of the run, which
+      // uploadInstanceMatrices() stored in the order of the queue
+      m_instance_matrix_buffer->bind();
+
+      for (GLuint column = 0; column < 4; ++column)
+      {
+        const GLuint location = InstanceMatrixLocation + column;
+        const uintptr_t offset = (i * 16 + column * 4) * sizeof(float);
+        glx->glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float), reinterpret_cast<const GLvoid*>(offset));
+        glx->glVertexAttribDivisor(location, 1);
+        glx->glEnableVertexAttribArray(location);
+      }
+
+      m_instance_matrix_buffer->release();
+
+      glx->glDrawElementsInstanced(GL_TRIANGLES, item.indices.count, index_type, indices, static_cast<GLsizei>(count));
+      ++m_statistics.instanced_draw_calls;
+
+      // the VAO may be shared with other renderers, and the matrix buffer
+      // is reallocated: the VAO is restored for non-instanced draws
+      for (GLuint column = 0; column < 4; ++column)
+      {
+        glx->glDisableVertexAttribArray(InstanceMatrixLocation + column);
+        glx->glVertexAttribDivisor(InstanceMatrixLocation + column, 0);
+      }
+    }
+    else
+    {
+      program->setUniformValue("model_matrix", item.model_matrix);
+      gl->glDrawElements(GL_TRIANGLES, item.indices.count, index_type, indices);
+    }
+
+    ++m_statistics.draw_calls;
+    i += count;
+  }
+}
+
+/**
+ * @brief returns the number of consecutive items in the queue that can be drawn together
+ * @param first  index of the first item in the queue
+ */
+size_t ModelRenderer::instanceRunLength(size_t first) const
+{
+  const std::vector<RenderQueue::Item>& queue = m_render_queue.items();
+  const MeshDrawItem& item = m_draw_items[queue[first].index];
+
+  size_t last = first + 1;
+
+  while (last < queue.size())
+  {
+    const MeshDrawItem& other = m_draw_items[queue[last].index];
+
+    if (other.mesh != item.mesh || other.indices.first != item.indices.first || other.vao != item.vao || other.program != item.program
+      || other.texture != item.texture || other.flat_color != item.flat_color)
+    {
+      break;
+    }
+
+    ++last;
+  }
+
+  return last - first;
+}
+
+/**
+ * @brief writes the model matrices of the draw items in queue order into the instance buffer
+ */
+void ModelRenderer::uploadInstanceMatrices()
+{
+  const std::vector<RenderQueue::Item>& queue = m_render_queue.items();
+
+  m_instance_matrices.resize(queue.size() * 16);
+
+  for (size_t i(0); i < queue.size(); ++i)
+  {
+    const QMatrix4x4& m = m_draw_items[queue[i].index].model_matrix;
+    std::copy_n(m.constData(), 16, m_instance_matrices.data() + 16 * i);
+  }
+
+  if (!m_instance_matrix_buffer)
+  {
+    m_instance_matrix_buffer = std::make_unique<QOpenGLBuffer>(QOpenGLBuffer::VertexBuffer);
+    m_instance_matrix_buffer->create();
+    m_instance_matrix_buffer->setUsagePattern(QOpenGLBuffer::StreamDraw);
+  }
+
+  m_instance_matrix_buffer->bind();
+  m_instance_matrix_buffer->allocate(m_instance_matrices.data(), static_cast<int>(m_instance_matrices.size() * sizeof(float)));
+  m_instance_matrix_buffer->release();
+}
+
+/**
+ * @brief returns the permutation of the program of a draw item that reads the model matrix per instance
+ */
+QOpenGLShaderProgram* ModelRenderer::instancedProgram(const MeshDrawItem& item)
+{
+  ModelRendererUberShader::Config conf = get_ubershader_conf(*item.mesh);
+  conf.instanced = true;
+  return m_ubershader.getProgram(conf);
+}
+
+/**
+ * @brief returns a small identifier for a material, used for sorting
+ */
+uint32_t ModelRenderer::materialId(const model::Material* material)
+{
+  auto it = m_material_ids.find(material);
+
+  if (it == m_material_ids.end())
+  {
+    it = m_material_ids.emplace(material, static_cast<uint32_t>(m_material_ids.size())).first;
+  }
+
+  return it->second;
+}
+
+void ModelRenderer::releaseResources()
+{
+  m_ubershader.clearCache();
+  releaseModelResources();
+  m_placeholder_texture.reset();
+  m_texture_upload_buffer.reset();
+  // the decoding threads must not enqueue tasks once the queue may be gone
+  {
+    std::lock_guard<std::mutex> lock{ m_task_queue_handle->mutex };
+    m_task_queue_handle->queue = nullptr;
+  }
+  m_task_queue = nullptr;
+  // the next context may not provide the same functions
+  m_multi_draw_functions = nullptr;
+  m_multi_draw_checked = false;
+}
+
+void ModelRenderer::releaseModelResources()
+{
+  m_mesh_render_data.clear();
+  m_batch.reset();
+  m_batch_revision = -1;
+  m_visible_commands_buffer.reset();
+  m_instance_matrix_buffer.reset();
+  m_lod_levels.clear();
+  m_node_lods = nullptr;
+  m_material_ids.clear();
+  m_draw_items.clear();
+  m_render_queue.clear();
+  m_textures.clear();
+  m_generation = std::make_shared<int>(*m_generation + 1);
+}
+
+namespace
+{
+
+template<typename T>
+size_t byte_size(const std::vector<T>& data)
+{
+  return data.size() * sizeof(T);
+}
+
+GpuResourceManager::Key mesh_key(const model::Mesh& mesh)
+{
+  GpuResourceManager::Key key = GpuResourceManager::hash(mesh.vertices);
+  key = GpuResourceManager::hash(mesh.indices, key);
+  key = GpuResourceManager::hash(mesh.colors, key);
+  key = GpuResourceManager::hash(mesh.uv, key);
+  key = GpuResourceManager::hash(mesh.normals, key);
+
+  for (const model::MeshLod& lod : mesh.lods)
+  {
+    key = GpuResourceManager::hash(lod.indices, key);
+  }
+
+  return key;
+}
+
+size_t mesh_byte_size(const model::Mesh& mesh)
+{
+  return byte_size(mesh.vertices) + byte_size(mesh.indices) + byte_size(mesh.colors) + byte_size(mesh.uv) + byte_size(mesh.normals);
+}
+
+/**
+ * @brief returns the indices of all the levels of detail of a mesh, one after the other
+ * @param mesh    the mesh
+ * @param ranges  receives the range of each level
+ */
+std::vector<int> lod_indices(const model::Mesh& mesh, std::vector<IndexRange>& ranges)
+{
+  std::vector<int> result = mesh.indices;
+  ranges.assign(1, IndexRange{ 0, static_cast<GLuint>(mesh.indices.size()) });
+
+  for (const model::MeshLod& lod : mesh.lods)
+  {
+    ranges.push_back(IndexRange{ static_cast<GLuint>(result.size()), static_cast<GLuint>(lod.indices.size()) });
+    result.insert(result.end(), lod.indices.begin(), lod.indices.end());
+  }
+
+  return result;
+}
+
+GpuResourceManager::Key texture_key(const QString& filepath)
+{
+  const QFileInfo info{ filepath };
+  const qint64 stamp[2] = { info.size(), info.lastModified().toMSecsSinceEpoch() };
+  return GpuResourceManager::hash(stamp, sizeof(stamp), GpuResourceManager::hash(info.absoluteFilePath()));
+}
+
+// maximum number of bytes uploaded by a render task, so that large
+// textures are spread over several frames
+constexpr size_t TextureUploadChunkSize = 256 * 1024;
+
+/**
+ * @brief runs a function in a thread of the global QThreadPool
+ */
+class TextureDecodingTask : public QRunnable
+{
+public:
+  explicit TextureDecodingTask(std::function<void()> func) :
+    m_func(std::move(func))
+  {
+
+  }
+
+  void run() override
+  {
+    m_func();
+  }
+
+private:
+  std::function<void()> m_func;
+};
+
+/**
+ * @brief creates the storage of a texture for all the levels of a decoded image
+ */
+std::shared_ptr<QOpenGLTexture> create_texture(const DecodedTexture& image)
+{
+  auto texture = std::make_shared<QOpenGLTexture>(QOpenGLTexture::Target2D);
+  texture->setFormat(QOpenGLTexture::RGBA8_UNorm);
+  texture->setSize(image.levels.front().width(), image.levels.front().height());
+  texture->setMipLevels(static_cast<int>(image.levels.size()));
+  texture->allocateStorage(QOpenGLTexture::RGBA, QOpenGLTexture::UInt8);
+  texture->setMinMagFilters(QOpenGLTexture::LinearMipMapLinear, QOpenGLTexture::Linear);
+  texture->setWrapMode(QOpenGLTexture::Repeat);
+  return texture;
+}
+
+} // namespace
+
+/**
+ * @brief returns the buffers and VAO of a mesh
+ *
+ * Returns nullptr if the mesh is still being uploaded.
+ */
+const MeshRenderData* ModelRenderer::get_render_data(QOpenGLFunctions* gl, model::Mesh* mesh)
+{
+  auto& entry = m_mesh_render_data[mesh];
+
+  if (entry && entry->m_vao)
+  {
+    return entry.get();
+  }
+
+  if (!entry)
+  {
+    // the layout is part of the key as it changes the content of the buffers
+    const GpuResourceManager::Key key = m_resource_manager
+      ? GpuResourceManager::hash(&m_vertex_layout, sizeof(m_vertex_layout), mesh_key(*mesh)) : 0;
+    entry = m_resource_manager ? m_resource_manager->find<MeshRenderData>(key) : nullptr;
+
+    if (entry)
+    {
+      return entry.get();
+    }
+
+    entry = std::make_shared<MeshRenderData>();
+
+    if (!m_task_queue)
+    {
+      upload_mesh(gl, mesh, entry, key);
+      return entry.get();
+    }
+
+    std::weak_ptr<int> generation = m_generation;
+    std::shared_ptr<MeshRenderData> data = entry;
+
+    m_task_queue->enqueue([this, generation, gl, mesh, data, key]() {
+      if (!generation.expired())
+      {
+        upload_mesh(gl, mesh, data, key);
+      }
+    });
+  }
+
+  return nullptr;
+}
+
+void ModelRenderer::upload_mesh(QOpenGLFunctions* gl, model::Mesh* mesh, const std::shared_ptr<MeshRenderData>& entry, GpuResourceManager::Key key)
+{
+  MeshRenderData& data = *entry;
+
+  data.m_vao = std::make_unique<QOpenGLVertexArrayObject>();
+  data.m_vao->create();
+
+  data.m_vao->bind();
+
+  const std::vector<int> mesh_indices = lod_indices(*mesh, data.m_lods);
+  size_t bytes = mesh_byte_size(*mesh) + byte_size(mesh_indices) - byte_size(mesh->indices);
+
+  if (m_vertex_layout != VertexLayout::Separate)
+  {
+    const bool compact = m_vertex_layout == VertexLayout::Compact;
+    const MeshVertexFormat format = MeshVertexFormat::fromMesh(*mesh, compact);
+    const std::vector<uint8_t> vertices = pack_interleaved_vertices(*mesh, format);
+    setup_interleaved_buffer(data.m_interleaved_buffer, gl, buffer_data_from_vector(vertices), format.attributes);
+
+    data.m_index_type = index_type(*mesh, compact);
+    const std::vector<uint8_t> indices = pack_indices(mesh_indices, data.m_index_type);
+    setup_index_buffer(data.m_index_buffer, gl, buffer_data_from_vector(indices));
+
+    data.m_position_origin = format.position_origin;
+    data.m_position_scale = format.position_scale;
+    bytes = vertices.size() + indices.size();
+  }
+  else
+  {
+    upload_separate_buffers(gl, *mesh, mesh_indices, data);
+  }
+
+  data.m_vao->release();
+
+  if (m_resource_manager)
+  {
+    m_resource_manager->insert(key, entry, bytes);
+  }
+}
+
+void ModelRenderer::upload_separate_buffers(QOpenGLFunctions* gl, const model::Mesh& mesh, const std::vector<int>& indices, MeshRenderData& data)
+{
+  {
+    BufferSpecs specs = BufferSpecsBuilder().index(0).tuplesize(3).type(GL_FLOAT);
+    setup_buffer(data.m_vertex_buffer, gl, buffer_data_from_vector(mesh.vertices), specs);
+  }
+
+  {
+    setup_index_buffer(data.m_index_buffer, gl, buffer_data_from_vector(indices));
+  }
+
+  if (!mesh.colors.empty())
+  {
+    BufferSpecs specs = BufferSpecsBuilder().index(2).tuplesize(3).type(GL_UNSIGNED_BYTE);
+    setup_buffer(data.m_color_buffer, gl, buffer_data_from_vector(mesh.colors), specs);
+  }
+
+  if (!mesh.uv.empty())
+  {
+    BufferSpecs specs = BufferSpecsBuilder().index(3).tuplesize(2).type(GL_FLOAT);
+    setup_buffer(data.m_uv_buffer, gl, buffer_data_from_vector(mesh.uv), specs);
+  }
+
+  if (!mesh.normals.empty())
+  {
+    BufferSpecs specs = BufferSpecsBuilder().index(4).tuplesize(3).type(GL_FLOAT);
+    setup_buffer(data.m_normal_buffer, gl, buffer_data_from_vector(mesh.normals), specs);
+  }
+}
+
+namespace
+{
+
+/**
+ * @brief the per-draw data read by the shaders in multi-draw mode
+ *
+ * The position origin and scale are only read with the compact vertex layout.
+ */
+struct BatchInstance
+{
+  float model_matrix[16];
+  float color[3];
+  float position_origin[3];
+  float position_scale[3];
+};
+
+struct BatchDraw
+{
+  int mesh_node; ///< index in SceneHierarchy::meshNodes()
+  model::Mesh* mesh;
+  QMatrix4x4 transform;
+  ModelRendererUberShader::Config config;
+};
+
+/**
+ * @brief a range of the shared vertex buffer holding meshes with the same attributes
+ */
+struct BatchVertexRange
+{
+  int attributes;
+  MeshVertexFormat format;
+  size_t offset;
+};
+
+int attribute_mask(const ModelRendererUberShader::Config& config)
+{
+  return (config.has_colors ? 1 : 0) | (config.has_uv ? 2 : 0) | (config.has_normals ? 4 : 0);
+}
+
+int material_kind(const model::Material& material)
+{
+  if (material.is<model::material::VertexColorMaterial>())
+    return 1;
+  else if (material.is<model::material::FlatColorMaterial>())
+    return 2;
+  else if (material.is<model::material::TextureMaterial>())
+    return 3;
+  else
+    return 0;
+}
+
+/**
+ * @brief returns the key identifying the draws that can be submitted together
+ *
+ * The vertex attributes come first so that the meshes with the same
+ * attributes, which share a VAO, are contiguous.
+ * The flat color is not part of the key as it is passed per draw.
+ */
+std::tuple<int, int, QString> group_key(const BatchDraw& draw)
+{
+  const model::Material& material = draw.config.material;
+  QString texture;
+
+  if (material.is<model::material::TextureMaterial>())
+  {
+    texture = material.as<model::material::TextureMaterial>().texture_path;
+  }
+
+  return std::make_tuple(attribute_mask(draw.config), material_kind(material), texture);
+}
+
+BatchInstance make_instance(const BatchDraw& draw, const MeshVertexFormat& format)
+{
+  BatchInstance result;
+  std::copy_n(draw.transform.constData(), 16, result.model_matrix);
+
+  const model::Material& material = draw.config.material;
+  const RgbColor color = material.is<model::material::FlatColorMaterial>()
+    ? material.as<model::material::FlatColorMaterial>().color : RgbColor();
+  result.color[0] = color.r / 255.f;
+  result.color[1] = color.g / 255.f;
+  result.color[2] = color.b / 255.f;
+
+  for (int i(0); i < 3; ++i)
+  {
+    result.position_origin[i] = format.position_origin[i];
+    result.position_scale[i] = format.position_scale[i];
+  }
+
+  return result;
+}
+
+std::unique_ptr<QOpenGLBuffer> create_batch_buffer(BufferData data)
+{
+  // all buffers are created as vertex buffers: allocating an index buffer
+  // would change the element buffer of the currently bound VAO (if any);
+  // the buffers are bound to their actual target when used
+  auto buffer = std::make_unique<QOpenGLBuffer>(QOpenGLBuffer::VertexBuffer);
+  buffer->create();
+  buffer->bind();
+  buffer->setUsagePattern(QOpenGLBuffer::StaticDraw);
+  buffer->allocate(data.ptr, data.size);
+  buffer->release();
+  return buffer;
+}
+
+} // namespace
+
+ModelBatchRenderData* ModelRenderer::get_batch(QOpenGLFunctions_4_3_Core* gl)
+{
+  // the model matrices are part of the batch
+  if (m_batch_revision != m_model->hierarchy().revision())
+  {
+    m_batch.reset();
+    m_batch_revision = m_model->hierarchy().revision();
+  }
+
+  if (m_batch)
+  {
+    return m_batch->m_indirect_buffer ? m_batch.get() : nullptr;
+  }
+
+  if (!m_task_queue)
+  {
+    m_batch = load_batch(gl);
+    return m_batch.get();
+  }
+
+  // placeholder until the task completes
+  m_batch = std::make_shared<ModelBatchRenderData>();
+
+  std::weak_ptr<int> generation = m_generation;
+
+  m_task_queue->enqueue([this, generation, gl]() {
+    if (!generation.expired())
+    {
+      m_batch = load_batch(gl);
+    }
+  });
+
+  return nullptr;
+}
+
+/**
+ * @brief packs all the meshes of the model into shared buffers
+ *
+ * Each mesh is stored once, even if it is referenced by several mesh nodes;
+ * draw commands address it with a base vertex and a first index.
+ * The nodes of a group that reference the same mesh are drawn by a single
+ * command with several instances.
+ */
+std::shared_ptr<ModelBatchRenderData> ModelRenderer::load_batch(QOpenGLFunctions_4_3_Core* gl)
+{
+  const model::SceneHierarchy& hierarchy = m_model->hierarchy();
+
+  std::vector<BatchDraw> draws;
+  draws.reserve(hierarchy.meshNodes().size());
+
+  for (size_t i(0); i < hierarchy.meshNodes().size(); ++i)
+  {
+    const int node = hierarchy.meshNodes()[i];
+    BatchDraw draw{ static_cast<int>(i), hierarchy.mesh(node), hierarchy.worldTransform(node), get_ubershader_conf(*hierarchy.mesh(node)) };
+    draw.config.multi_draw = true;
+    draws.push_back(draw);
+  }
+
+  const bool compact = m_vertex_layout == VertexLayout::Compact;
+
+  // all the meshes share the index buffer: 16-bit indices can only be used
+  // if every mesh is small enough, as indices are relative to the base vertex
+  const bool short_indices = compact && std::all_of(draws.begin(), draws.end(), [](const BatchDraw& draw) {
+    return index_type(*draw.mesh, true) == GL_UNSIGNED_SHORT;
+  });
+
+  // the nodes referencing the same mesh are made adjacent so that
+  // they can be drawn with a single instanced command
+  std::stable_sort(draws.begin(), draws.end(), [](const BatchDraw& lhs, const BatchDraw& rhs) {
+    return std::make_pair(group_key(lhs), lhs.mesh) < std::make_pair(group_key(rhs), rhs.mesh);
+  });
+
+  auto result = std::make_shared<ModelBatchRenderData>();
+
+  std::vector<BatchVertexRange> ranges;
+  std::vector<uint8_t> vertices;
+  std::vector<GLuint> indices;
+  std::vector<DrawElementsIndirectCommand> commands;
+  std::vector<BatchInstance> instances;
+  // for each mesh, the command drawing its level 0, its vertex format and its levels of detail
+  struct BatchMesh
+  {
+    DrawElementsIndirectCommand command;
+    MeshVertexFormat format;
+    std::vector<IndexRange> lods;
+  };
+
+  std::map<model::Mesh*, BatchMesh> mesh_commands;
+
+  commands.reserve(draws.size());
+  instances.reserve(draws.size());
+
+  for (size_t i(0); i < draws.size(); ++i)
+  {
+    const BatchDraw& draw = draws[i];
+    const int attributes = attribute_mask(draw.config);
+
+    if (ranges.empty() || ranges.back().attributes != attributes)
+    {
+      ranges.push_back(BatchVertexRange{ attributes, MeshVertexFormat::fromMesh(*draw.mesh, compact), vertices.size() });
+    }
+
+    const BatchVertexRange& range = ranges.back();
+
+    auto it = mesh_commands.find(draw.mesh);
+
+    if (it == mesh_commands.end())
+    {
+      std::vector<IndexRange> lods;
+      const std::vector<int> mesh_indices = lod_indices(*draw.mesh, lods);
+
+      for (IndexRange& lod : lods)
+      {
+        lod.first += static_cast<GLuint>(indices.size());
+      }
+
+      DrawElementsIndirectCommand cmd;
+      cmd.count = lods.front().count;
+      cmd.instance_count = 1;
+      cmd.first_index = lods.front().first;
+      cmd.base_vertex = static_cast<GLint>((vertices.size() - range.offset) / range.format.stride);
+      cmd.base_instance = 0;
+
+      // in compact mode, the quantization depends on the bounding box of
+      // each mesh; the attributes, and thus the stride, are those of the range
+      MeshVertexFormat format = compact ? MeshVertexFormat::fromMesh(*draw.mesh, true) : range.format;
+      const std::vector<uint8_t> mesh_vertices = pack_interleaved_vertices(*draw.mesh, format);
+      vertices.insert(vertices.end(), mesh_vertices.begin(), mesh_vertices.end());
+      indices.insert(indices.end(), mesh_indices.begin(), mesh_indices.end());
+
+      it = mesh_commands.emplace(draw.mesh, BatchMesh{ cmd, std::move(format), std::move(lods) }).first;
+    }
+
+    const bool new_group = i == 0 || group_key(draws[i - 1]) != group_key(draw);
+
+    if (new_group)
+    {
+      ModelBatchRenderData::DrawGroup group;
+      group.config = draw.config;
+      group.vao = static_cast<int>(ranges.size()) - 1;
+      group.first_command = static_cast<int>(commands.size());
+      result->m_groups.push_back(group);
+    }
+
+    if (!new_group && draws[i - 1].mesh == draw.mesh)
+    {
+      ++commands.back().instance_count;
+    }
+    else
+    {
+      DrawElementsIndirectCommand cmd = it->second.command;
+      cmd.base_instance = static_cast<GLuint>(i);
+      commands.push_back(cmd);
+      result->m_command_lods.push_back(it->second.lods);
+      ++result->m_groups.back().command_count;
+    }
+
+    result->m_instance_nodes.push_back(draw.mesh_node);
+    instances.push_back(make_instance(draw, it->second.format));
+  }
+
+  GpuResourceManager::Key key = 0;
+
+  if (m_resource_manager)
+  {
+    key = GpuResourceManager::hash(vertices);
+    key = GpuResourceManager::hash(indices, key);
+    key = GpuResourceManager::hash(commands, key);
+    key = GpuResourceManager::hash(instances, key);
+    key = GpuResourceManager::hash(result->m_instance_nodes, key);
+
+    if (auto cached = m_resource_manager->find<ModelBatchRenderData>(key))
+    {
+      return cached;
+    }
+  }
+
+  std::vector<uint8_t> index_data;
+
+  if (short_indices)
+  {
+    result->m_index_type = GL_UNSIGNED_SHORT;
+    index_data = pack_indices(std::vector<int>(indices.begin(), indices.end()), GL_UNSIGNED_SHORT);
+  }
+  else
+  {
+    index_data.resize(byte_size(indices));
+    std::memcpy(index_data.data(), indices.data(), index_data.size());
+  }
+
+  result->m_vertex_buffer = create_batch_buffer(buffer_data_from_vector(vertices));
+  result->m_index_buffer = create_batch_buffer(buffer_data_from_vector(index_data));
+  result->m_instance_buffer = create_batch_buffer(buffer_data_from_vector(instances));
+  result->m_indirect_buffer = create_batch_buffer(buffer_data_from_vector(commands));
+
+  for (const BatchVertexRange& range : ranges)
+  {
+    auto vao = std::make_unique<QOpenGLVertexArrayObject>();
+    vao->create();
+    vao->bind();
+
+    result->m_vertex_buffer->bind();
+
+    for (const BufferSpecs& specs : range.format.attributes)
+    {
+      const uintptr_t offset = reinterpret_cast<uintptr_t>(specs.offset) + range.offset;
+      gl->glVertexAttribPointer(specs.index, specs.tuplesize, specs.type, specs.normalized, specs.stride, reinterpret_cast<const GLvoid*>(offset));
+      gl->glEnableVertexAttribArray(specs.index);
+    }
+
+    result->m_instance_buffer->bind();
+
+    for (GLuint column = 0; column < 4; ++column)
+    {
+      const GLuint location = InstanceMatrixLocation + column;
+      const uintptr_t offset = offsetof(BatchInstance, model_matrix) + column * 4 * sizeof(float);
+      gl->glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(BatchInstance), reinterpret_cast<const GLvoid*>(offset));
+      gl->glVertexAttribDivisor(location, 1);
+      gl->glEnableVertexAttribArray(location);
+    }
+
+    gl->glVertexAttribPointer(InstanceColorLocation, 3, GL_FLOAT, GL_FALSE, sizeof(BatchInstance), reinterpret_cast<const GLvoid*>(offsetof(BatchInstance, color)));
+    gl->glVertexAttribDivisor(InstanceColorLocation, 1);
+    gl->glEnableVertexAttribArray(InstanceColorLocation);
+
+    if (compact)
+    {
+      gl->glVertexAttribPointer(InstancePositionOriginLocation, 3, GL_FLOAT, GL_FALSE, sizeof(BatchInstance), reinterpret_cast<const GLvoid*>(offsetof(BatchInstance, position_origin)));
+      gl->glVertexAttribDivisor(InstancePositionOriginLocation, 1);
+      gl->glEnableVertexAttribArray(InstancePositionOriginLocation);
+      gl->glVertexAttribPointer(InstancePositionScaleLocation, 3, GL_FLOAT, GL_FALSE, sizeof(BatchInstance), reinterpret_cast<const GLvoid*>(offsetof(BatchInstance, position_scale)));
+      gl->glVertexAttribDivisor(InstancePositionScaleLocation, 1);
+      gl->glEnableVertexAttribArray(InstancePositionScaleLocation);
+    }
+
+    result->m_instance_buffer->release();
+
+    gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, result->m_index_buffer->bufferId());
+
+    vao->release();
+    result->m_vaos.push_back(std::move(vao));
+  }
+
+  if (m_resource_manager)
+  {
+    const size_t bytes = byte_size(vertices) + byte_size(index_data) + byte_size(commands) + byte_size(instances);
+    m_resource_manager->insert(key, result, bytes);
+  }
+
+  result->m_commands = std::move(commands);
+
+  return result;
+}
+
+ModelRendererUberShader::Config ModelRenderer::get_ubershader_conf(const model::Mesh& mesh) const
+{
+  ModelRendererUberShader::Config conf;
+  conf.has_colors = !mesh.colors.empty();
+  conf.has_uv = !mesh.uv.empty();
+  conf.has_normals = !mesh.normals.empty();
+  conf.compact = m_vertex_layout == VertexLayout::Compact;
+  conf.material = *(mesh.material);
+
+  if (conf.material.is<model::material::DefaultMaterial>())
+  {
+    if (conf.has_colors)
+    {
+      conf.material = model::Material(model::material::VertexColorMaterial());
+    }
+    else
+    {
+      conf.material = model::Material(model::material::FlatColorMaterial(RgbColor(128, 128, 128)));
+    }
+  }
+
+  return conf;
+}
+
+/**
+ * @brief binds a shader program if it is not already bound
+ * @return whether the program was bound
+ */
+bool ModelRenderer::bindShaderProgram(QOpenGLShaderProgram& shader_program)
+{
+  if (&shader_program != m_current_shader_program)
+  {
+    m_current_shader_program = &shader_program;
+    shader_program.bind();
+    ++m_statistics.program_changes;
+    return true;
+  }
+
+  return false;
+}
+
+void ModelRenderer::releaseShaderProgram()
+{
+  if (m_current_shader_program)
+  {
+    m_current_shader_program->release();
+    m_current_shader_program = nullptr;
+  }
+}
+
+/**
+ * @brief returns the texture of a material
+ *
+ * If a task queue is set, the image is decoded and its mipmaps generated
+ * in a worker thread, and the texture is then uploaded in chunks by render
+ * tasks; the placeholder texture is returned until the texture is complete.
+ * Otherwise, the texture is loaded synchronously.
+ *
+ * The placeholder is also used if the image cannot be read.
+ */
+QOpenGLTexture* ModelRenderer::get_texture(const QString& path)
+{
+  auto it = m_textures.find(path);
+
+  if (it != m_textures.end())
+  {
+    if (it->second)
+    {
+      return it->second.get();
+    }
+
+    ++m_statistics.placeholder_textures;
+    return placeholderTexture();
+  }
+
+  auto& texture = m_textures[path];
+
+  const QString filepath = QFileInfo(m_model->path()).dir().filePath(path);
+  const GpuResourceManager::Key key = m_resource_manager ? texture_key(filepath) : 0;
+
+  if (m_resource_manager)
+  {
+    texture = m_resource_manager->find<QOpenGLTexture>(key);
+
+    if (texture)
+    {
+      return texture.get();
+    }
+  }
+
+  if (!m_task_queue)
+  {
+    uploadTexture(path, key, decode_texture(filepath));
+    return m_textures[path] ? m_textures[path].get() : placeholderTexture();
+  }
+
+  std::weak_ptr<int> generation = m_generation;
+  std::shared_ptr<TaskQueueHandle> handle = m_task_queue_handle;
+
+  QThreadPool::globalInstance()->start(new TextureDecodingTask([this, generation, handle, path, filepath, key]() {
+    if (generation.expired())
+    {
+      return;
+    }
+
+    auto upload = std::make_shared<TextureUpload>();
+    upload->path = path;
+    upload->key = key;
+    upload->image = decode_texture(filepath);
+
+    if (!upload->image)
+    {
+      qWarning() << "could not read texture" << filepath;
+      return;
+    }
+
+    // the resources may have been released while decoding
+    std::lock_guard<std::mutex> lock{ handle->mutex };
+
+    if (!handle->queue || generation.expired())
+    {
+      return;
+    }
+
+    // the meshes are drawn with the placeholder in the meantime,
+    // their own resources are created first
+    handle->queue->enqueue([this, generation, upload]() {
+      if (!generation.expired())
+      {
+        continueTextureUpload(generation, upload);
+      }
+    }, RenderTaskQueue::LowPriority);
+  }));
+
+  ++m_statistics.placeholder_textures;
+  return placeholderTexture();
+}
+
+/**
+ * @brief returns the texture used in place of the textures that are not resident yet
+ */
+QOpenGLTexture* ModelRenderer::placeholderTexture()
+{
+  if (!m_placeholder_texture)
+  {
+    QImage image{ 1, 1, QImage::Format_RGBA8888 };
+    image.fill(QColor(192, 192, 192));
+    m_placeholder_texture = std::make_unique<QOpenGLTexture>(image, QOpenGLTexture::DontGenerateMipMaps);
+  }
+
+  return m_placeholder_texture.get();
+}
+
+/**
+ * @brief uploads a decoded image at once
+ */
+void ModelRenderer::uploadTexture(const QString& path, GpuResourceManager::Key key, const std::shared_ptr<DecodedTexture>& image)
+{
+  if (!image)
+  {
+    qWarning() << "could not read texture" << path;
+    return;
+  }
+
+  TextureUpload upload;
+  upload.path = path;
+  upload.key = key;
+  upload.image = image;
+  upload.texture = create_texture(*image);
+
+  uploadTextureChunk(upload, std::numeric_limits<size_t>::max());
+  finishTextureUpload(upload);
+}
+
+/**
+ * @brief uploads the next rows of a texture through a pixel unpack buffer
+ * @param upload  the texture being uploaded
+ * @param budget  the maximum number of bytes to upload, at least one row is uploaded
+ * @return whether all the levels are uploaded
+ *
+ * The buffer is orphaned before each transfer, so that writing a chunk never
+ * waits for the GPU to finish reading the previous one.
+ */
+bool ModelRenderer::uploadTextureChunk(TextureUpload& upload, size_t budget)
+{
+  QOpenGLExtraFunctions* gl = QOpenGLContext::currentContext()->extraFunctions();
+  const std::vector<QImage>& levels = upload.image->levels;
+
+  if (!m_texture_upload_buffer)
+  {
+    m_texture_upload_buffer = std::make_unique<QOpenGLBuffer>(QOpenGLBuffer::PixelUnpackBuffer);
+    m_texture_upload_buffer->setUsagePattern(QOpenGLBuffer::StreamDraw);
+    m_texture_upload_buffer->create();
+  }
+
+  gl->glBindTexture(GL_TEXTURE_2D, upload.texture->textureId());
+  m_texture_upload_buffer->bind();
+
+  size_t uploaded = 0;
+
+  while (upload.level < levels.size() && uploaded < budget)
+  {
+    const QImage& image = levels[upload.level];
+    const size_t row_size = static_cast<size_t>(image.bytesPerLine());
+    const int rows = static_cast<int>(std::min<size_t>(image.height() - upload.row, std::max<size_t>((budget - uploaded) / row_size, 1)));
+    const int size = static_cast<int>(rows * row_size);
+    const GLint level = static_cast<GLint>(upload.level);
+
+    m_texture_upload_buffer->allocate(size);
+    void* data = m_texture_upload_buffer->mapRange(0, size, QOpenGLBuffer::RangeWrite | QOpenGLBuffer::RangeInvalidateBuffer);
+
+    if (data)
+    {
+      std::memcpy(data, image.constScanLine(upload.row), size);
+      m_texture_upload_buffer->unmap();
+      gl->glTexSubImage2D(GL_TEXTURE_2D, level, 0, upload.row, image.width(), rows, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+    else
+    {
+      // the buffer cannot be mapped, the rows are read from client memory
+      m_texture_upload_buffer->release();
+      gl->glTexSubImage2D(GL_TEXTURE_2D, level, 0, upload.row, image.width(), rows, GL_RGBA, GL_UNSIGNED_BYTE, image.constScanLine(upload.row));
+      m_texture_upload_buffer->bind();
+    }
+
+    uploaded += size;
+    upload.row += rows;
+
+    if (upload.row == image.height())
+    {
+      ++upload.level;
+      upload.row = 0;
+    }
+  }
+
+  m_texture_upload_buffer->release();
+  gl->glBindTexture(GL_TEXTURE_2D, 0);
+  // the texture bound by bindTexture() was replaced
+  m_current_texture = nullptr;
+
+  return upload.level == levels.size();
+}
+
+/**
+ * @brief uploads a chunk of a texture and schedules the upload of the next one
+ */
+void ModelRenderer::continueTextureUpload(const std::weak_ptr<int>& generation, const std::shared_ptr<TextureUpload>& upload)
+{
+  if (!upload->texture)
+  {
+    upload->texture = create_texture(*upload->image);
+  }
+
+  if (uploadTextureChunk(*upload, TextureUploadChunkSize))
+  {
+    finishTextureUpload(*upload);
+    return;
+  }
+
+  m_task_queue->enqueue([this, generation, upload]() {
+    if (!generation.expired())
+    {
+      continueTextureUpload(generation, upload);
+    }
+  }, RenderTaskQueue::LowPriority);
+}
+
+/**
+ * @brief makes a completely uploaded texture available for drawing
+ */
+void ModelRenderer::finishTextureUpload(const TextureUpload& upload)
+{
+  m_textures[upload.path] = upload.texture;
+
+  if (m_resource_manager)
+  {
+    // the mipmaps take a third of the size of the base level
+    const QImage& image = upload.image->levels.front();
+    const size_t bytes = size_t(image.width()) * image.height() * 4;
+    m_resource_manager->insert(upload.key, upload.texture, bytes + bytes / 3);
+  }
+}
+
+void ModelRenderer::bindVertexArray(QOpenGLVertexArrayObject& vao)
+{
+  if (m_current_vao != &vao)
+  {
+    vao.bind();
+    m_current_vao = &vao;
+    ++m_statistics.vao_changes;
+  }
+}
+
+void ModelRenderer::releaseVertexArray()
+{
+  if (m_current_vao)
+  {
+    m_current_vao->release();
+    m_current_vao = nullptr;
+  }
 }
 
 void ModelRenderer::bindTexture(QOpenGLTexture& texture)
@@ -261,6 +1802,7 @@ void ModelRenderer::bindTexture(QOpenGLTexture& texture)
   {
     texture.bind();
     m_current_texture = &texture;
+    ++m_statistics.texture_changes;
   }
 }
 
@@ -4,15 +4,83 @@
 
 #pragma once
 
+#include "meshvertexformat.h"
 #include "model.h"
+#include "renderqueue.h"
 #include "ubershader.h"
 
+#include "appcommon/appviewport.h"
+
+#include <QObject>
 #include <QOpenGLBuffer>
 #include <QOpenGLFunctions>
 #include <QOpenGLTexture>
 #include <QOpenGLVertexArrayObject>
 
+#include <qmlgl/frustumplanes.h>
+#include <qmlgl/gpuresourcemanager.h>
+
 #include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class QOpenGLFunctions_4_3_Core;
+
+class RenderTaskQueue;
+
+struct DecodedTexture;
+
+/**
+ * @brief specifies how the meshes of a model are submitted to OpenGL
+ */
+enum class ModelDrawMode
+{
+  PerMesh,           ///< one VAO and one draw call per mesh node
+  MultiDrawIndirect, ///< shared buffers and one draw call per material group
+};
+
+/**
+ * @brief counts the draw calls and state changes issued by a ModelRenderer
+ *
+ * The statistics of the last rendered frame are exposed to QML by
+ * Q3dModel::renderStatistics().
+ */
+struct ModelRenderStatistics
+{
+  Q_GADGET
+  Q_PROPERTY(int drawnMeshes MEMBER drawn_meshes)
+  Q_PROPERTY(int culledMeshes MEMBER culled_meshes)
+  Q_PROPERTY(qint64 drawnTriangles MEMBER drawn_triangles)
+  Q_PROPERTY(int drawCalls MEMBER draw_calls)
+  Q_PROPERTY(int instancedDrawCalls MEMBER instanced_draw_calls)
+  Q_PROPERTY(int programChanges MEMBER program_changes)
+  Q_PROPERTY(int textureChanges MEMBER texture_changes)
+  Q_PROPERTY(int placeholderTextures MEMBER placeholder_textures)
+  Q_PROPERTY(int vaoChanges MEMBER vao_changes)
+public:
+  int drawn_meshes = 0;
+  int culled_meshes = 0;
+  qint64 drawn_triangles = 0;
+  int draw_calls = 0;
+  int instanced_draw_calls = 0;
+  int program_changes = 0;
+  int texture_changes = 0;
+  int placeholder_textures = 0; ///< draws using the placeholder texture, see ModelRenderer::get_texture()
+  int vao_changes = 0;
+};
+
+Q_DECLARE_METATYPE(ModelRenderStatistics)
+
+/**
+ * @brief a range of an index buffer holding a level of detail of a mesh
+ */
+struct IndexRange
+{
+  GLuint first = 0; ///< position of the first index in the buffer
+  GLuint count = 0;
+};
 
 struct MeshRenderData
 {
@@ -22,6 +90,11 @@ struct MeshRenderData
   std::unique_ptr<QOpenGLBuffer> m_color_buffer;
   std::unique_ptr<QOpenGLBuffer> m_uv_buffer;
   std::unique_ptr<QOpenGLBuffer> m_normal_buffer;
+  std::unique_ptr<QOpenGLBuffer> m_interleaved_buffer;
+  GLenum m_index_type = GL_UNSIGNED_INT;
+  std::vector<IndexRange> m_lods; ///< level 0 is the full mesh
+  QVector3D m_position_origin;                     ///< compact layout only
+  QVector3D m_position_scale = QVector3D(1, 1, 1); ///< compact layout only
 };
 
 class ModelRendererUberShader : public UberShader
@@ -34,14 +107,65 @@ public:
     bool has_colors = false;
     bool has_uv = false;
     bool has_normals = false;
+    bool multi_draw = false;
+    bool instanced = false;
+    bool compact = false;
     model::Material material;
   };
 
   QOpenGLShaderProgram* getProgram(Config conf);
 };
 
+/**
+ * @brief the command layout consumed by glMultiDrawElementsIndirect()
+ */
+struct DrawElementsIndirectCommand
+{
+  GLuint count;
+  GLuint instance_count;
+  GLuint first_index;
+  GLint base_vertex;
+  GLuint base_instance;
+};
+
+/**
+ * @brief the meshes of a model suballocated in shared buffers
+ *
+ * All the vertices of the model are stored in a single vertex buffer and all
+ * the indices in a single index buffer.
+ * Meshes with the same attributes are stored contiguously and share a VAO.
+ * Each mesh node is an instance, with its model matrix and color in the
+ * instance buffer; the nodes referencing the same mesh are instances of the same
+ * draw command. Draw commands using the same shader program and texture
+ * are submitted together.
+ */
+struct ModelBatchRenderData
+{
+  struct DrawGroup
+  {
+    ModelRendererUberShader::Config config;
+    int vao = 0;
+    int first_command = 0;
+    int command_count = 0;
+  };
+
+  std::unique_ptr<QOpenGLBuffer> m_vertex_buffer;
+  std::unique_ptr<QOpenGLBuffer> m_index_buffer;
+  std::unique_ptr<QOpenGLBuffer> m_instance_buffer;
+  std::unique_ptr<QOpenGLBuffer> m_indirect_buffer;
+  GLenum m_index_type = GL_UNSIGNED_INT;
+  std::vector<std::unique_ptr<QOpenGLVertexArrayObject>> m_vaos;
+  std::vector<DrawGroup> m_groups;
+  std::vector<DrawElementsIndirectCommand> m_commands; ///< copy of the content of the indirect buffer
+  std::vector<std::vector<IndexRange>> m_command_lods; ///< for each command, the levels of detail of its mesh
+  std::vector<int> m_instance_nodes;                  ///< for each instance, its index in the mesh nodes of the hierarchy
+};
+
 class ModelRenderer
 {
+private:
+  struct MeshDrawItem;
+
 public:
   ModelRenderer();
   ~ModelRenderer();
@@ -49,25 +173,154 @@ public:
   Model* model() const;
   void setModel(Model* m);
 
+  void setTaskQueue(RenderTaskQueue* queue);
+  void setResourceManager(GpuResourceManager* manager);
+
+  VertexLayout vertexLayout() const;
+  void setVertexLayout(VertexLayout layout);
+
+  ModelDrawMode drawMode() const;
+  void setDrawMode(ModelDrawMode mode);
+
+  bool sortDraws() const;
+  void setSortDraws(bool on);
+
+  bool frustumCulling() const;
+  void setFrustumCulling(bool on);
+
+  bool instancing() const;
+  void setInstancing(bool on);
+
+  float lodErrorThreshold() const;
+  void setLodErrorThreshold(float pixels);
+
+  void draw(QOpenGLFunctions* gl, const AppViewportRenderData& view);
   void draw(QOpenGLFunctions* gl, const QMatrix4x4& projectionMatrix, const QMatrix4x4& viewMatrix);
 
+  const ModelRenderStatistics& statistics() const;
+  void resetStatistics();
+
   void releaseResources();
 
 protected:
-  void recursiveDraw(QOpenGLFunctions* gl, const QMatrix4x4& projectionMatrix, const QMatrix4x4& viewMatrix, const QMatrix4x4& modelMatrix, model::SceneNode* node);
-  QOpenGLVertexArrayObject& get_vao(QOpenGLFunctions* gl, model::Mesh* mesh);
+  void releaseModelResources();
+  void updateVisibility(const QMatrix4x4& viewProjectionMatrix);
+  void updateLevelsOfDetail(const QMatrix4x4& projectionMatrix, const QMatrix4x4& viewMatrix);
+  int levelOfDetail(int meshNode) const;
+  QOpenGLFunctions_4_3_Core* multiDrawFunctions();
+  void drawIndirect(QOpenGLFunctions_4_3_Core* gl, const QMatrix4x4& projectionMatrix, const QMatrix4x4& viewMatrix);
+  ModelBatchRenderData* get_batch(QOpenGLFunctions_4_3_Core* gl);
+  std::shared_ptr<ModelBatchRenderData> load_batch(QOpenGLFunctions_4_3_Core* gl);
+  void collectDrawItems(QOpenGLFunctions* gl, const QMatrix4x4& viewMatrix);
+  void submitDrawItems(QOpenGLFunctions* gl, const QMatrix4x4& projectionMatrix, const QMatrix4x4& viewMatrix);
+  size_t instanceRunLength(size_t first) const;
+  void uploadInstanceMatrices();
+  QOpenGLShaderProgram* instancedProgram(const MeshDrawItem& item);
+  uint32_t materialId(const model::Material* material);
+  const MeshRenderData* get_render_data(QOpenGLFunctions* gl, model::Mesh* mesh);
+  void upload_mesh(QOpenGLFunctions* gl, model::Mesh* mesh, const std::shared_ptr<MeshRenderData>& entry, GpuResourceManager::Key key);
+  void upload_separate_buffers(QOpenGLFunctions* gl, const model::Mesh& mesh, const std::vector<int>& indices, MeshRenderData& data);
   ModelRendererUberShader::Config get_ubershader_conf(const model::Mesh& mesh) const;
-  void bindShaderProgram(QOpenGLShaderProgram& shader_program);
+  bool bindShaderProgram(QOpenGLShaderProgram& shader_program);
   void releaseShaderProgram();
-  QOpenGLTexture& get_texture(const QString& path);
+  void bindVertexArray(QOpenGLVertexArrayObject& vao);
+  void releaseVertexArray();
+  QOpenGLTexture* get_texture(const QString& path);
+  QOpenGLTexture* placeholderTexture();
+  void uploadTexture(const QString& path, GpuResourceManager::Key key, const std::shared_ptr<DecodedTexture>& image);
   void bindTexture(QOpenGLTexture& texture);
   void releaseTexture();
 
+private:
+  /**
+   * @brief a texture being uploaded in chunks, see uploadTextureChunk()
+   */
+  struct TextureUpload
+  {
+    QString path;
+    GpuResourceManager::Key key;
+    std::shared_ptr<DecodedTexture> image;
+    std::shared_ptr<QOpenGLTexture> texture;
+    size_t level = 0; ///< the next level to upload
+    int row = 0;      ///< the next row to upload in that level
+  };
+
+  bool uploadTextureChunk(TextureUpload& upload, size_t budget);
+  void continueTextureUpload(const std::weak_ptr<int>& generation, const std::shared_ptr<TextureUpload>& upload);
+  void finishTextureUpload(const TextureUpload& upload);
+
+  /**
+   * @brief a mesh node ready to be drawn, referenced by the render queue
+   */
+  struct MeshDrawItem
+  {
+    model::Mesh* mesh;
+    QMatrix4x4 model_matrix;
+    QOpenGLVertexArrayObject* vao;
+    const MeshRenderData* render_data;
+    IndexRange indices; ///< the selected level of detail
+    QOpenGLShaderProgram* program;
+    QOpenGLTexture* texture;
+    QColor flat_color; ///< invalid if the material is not a flat color
+  };
+
+  /**
+   * @brief the task queue, as seen from the texture decoding threads
+   *
+   * The threads enqueue their results while holding the mutex; the queue is
+   * reset in releaseResources(), after which no thread can reach it anymore.
+   */
+  struct TaskQueueHandle
+  {
+    std::mutex mutex;
+    RenderTaskQueue* queue = nullptr;
+  };
+
 private:
   Model* m_model = nullptr;
-  std::map<model::Mesh*, std::unique_ptr<MeshRenderData>> m_mesh_render_data;
-  std::map<QString, std::unique_ptr<QOpenGLTexture>> m_textures;
+  std::map<model::Mesh*, std::shared_ptr<MeshRenderData>> m_mesh_render_data;
+  // the texture is null while it is being decoded and uploaded
+  std::map<QString, std::shared_ptr<QOpenGLTexture>> m_textures;
+  std::unique_ptr<QOpenGLTexture> m_placeholder_texture;
+  std::unique_ptr<QOpenGLBuffer> m_texture_upload_buffer;
+  RenderTaskQueue* m_task_queue = nullptr;
+  std::shared_ptr<TaskQueueHandle> m_task_queue_handle = std::make_shared<TaskQueueHandle>();
+  GpuResourceManager* m_resource_manager = nullptr;
+  std::shared_ptr<ModelBatchRenderData> m_batch;
+  int m_batch_revision = -1;
+  VertexLayout m_vertex_layout = VertexLayout::Interleaved;
+  ModelDrawMode m_draw_mode = ModelDrawMode::MultiDrawIndirect;
+  QOpenGLFunctions_4_3_Core* m_multi_draw_functions = nullptr;
+  bool m_multi_draw_checked = false;
+  // the tasks in the queue hold a weak reference to this counter, which is
+  // replaced whenever the resources are released: outdated tasks do nothing
+  std::shared_ptr<int> m_generation = std::make_shared<int>(0);
   ModelRendererUberShader m_ubershader;
+  bool m_frustum_culling = true;
+  bool m_instancing = true;
+  std::vector<float> m_instance_matrices;
+  std::unique_ptr<QOpenGLBuffer> m_instance_matrix_buffer;
+  VisibilityMask m_node_visibility;
+  float m_lod_error_threshold = 1.f;
+  const Viewport* m_lod_viewport = nullptr;
+  int m_lod_viewport_height = 0;
+  // the levels are remembered per viewport for the hysteresis
+  std::map<const Viewport*, std::vector<uint8_t>> m_lod_levels;
+  const std::vector<uint8_t>* m_node_lods = nullptr;
+  bool m_lods_selected = false;
+  std::vector<DrawElementsIndirectCommand> m_visible_commands;
+  std::unique_ptr<QOpenGLBuffer> m_visible_commands_buffer;
+  std::map<const model::Material*, uint32_t> m_material_ids;
+  // the OpenGL names are too sparse for the sort key, the objects drawn
+  // during a frame are numbered in the order they are first seen
+  std::unordered_map<const void*, uint32_t> m_program_ids;
+  std::unordered_map<const void*, uint32_t> m_texture_ids;
+  std::unordered_map<const void*, uint32_t> m_vao_ids;
+  std::vector<MeshDrawItem> m_draw_items;
+  RenderQueue m_render_queue;
+  bool m_sort_draws = true;
+  ModelRenderStatistics m_statistics;
   QOpenGLShaderProgram* m_current_shader_program = nullptr;
   QOpenGLTexture* m_current_texture = nullptr;
+  QOpenGLVertexArrayObject* m_current_vao = nullptr;
 };
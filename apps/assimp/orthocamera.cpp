@@ -159,9 +159,17 @@ void OrthographicCameraController::wheelZoom(float step) // TODO: change to int
 
 void OrthographicCameraController::wheelEvent(QWheelEvent* event)
 {
-  int wheel_angle = event->angleDelta().y();
+  m_pending_wheel_angle += event->angleDelta().y();
+  scheduleInput();
+}
 
-  wheelZoom(-wheel_angle / 120.f);
+void OrthographicCameraController::processPendingInput()
+{
+  if (m_pending_wheel_angle != 0)
+  {
+    wheelZoom(-m_pending_wheel_angle / 120.f);
+    m_pending_wheel_angle = 0;
+  }
 }
 
 void OrthographicCameraController::configureCamera()
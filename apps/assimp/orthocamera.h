@@ -52,6 +52,7 @@ Q_SIGNALS:
 
 protected:
   void wheelEvent(QWheelEvent* ev) override;
+  void processPendingInput() override;
 
   void wheelZoom(float step);
 
@@ -65,4 +66,5 @@ private:
   float m_far_plane = 1.f;
   float m_minimum_frustum_height = 0.1f;
   float m_frustum_height = 1.f;
+  int m_pending_wheel_angle = 0;
 };
@@ -0,0 +1,87 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief returns the number of threads used by parallel_for() for a given number of iterations
+ * @param count       the number of iterations
+ * @param max_threads the maximum number of threads, 0 for the number of cores
+ */
+inline size_t parallel_thread_count(size_t count, size_t max_threads = 0)
+{
+  const size_t cores = std::max(std::thread::hardware_concurrency(), 1u);
+  return std::max<size_t>(std::min(max_threads > 0 ? max_threads : cores, count), 1);
+}
+
+/**
+ * @brief calls a function for each index in [0, count) using several threads
+ * @param count       the number of iterations
+ * @param func        the function, taking the index as parameter
+ * @param max_threads the maximum number of threads, 0 for the number of cores
+ *
+ * The iterations are distributed dynamically, one index at a time, so
+ * that iterations of very different costs are balanced across the threads.
+ * The calling thread takes part in the work.
+ *
+ * If an iteration throws, the remaining iterations are skipped and the first
+ * exception is rethrown in the calling thread once all threads are done.
+ */
+template<typename F>
+void parallel_for(size_t count, F&& func, size_t max_threads = 0)
+{
+  std::atomic<size_t> next{ 0 };
+  std::exception_ptr error;
+  std::mutex error_mutex;
+
+  auto work = [count, &func, &next, &error, &error_mutex]() {
+    try
+    {
+      for (size_t i = next++; i < count; i = next++)
+      {
+        func(i);
+      }
+    }
+    catch (...)
+    {
+      std::lock_guard<std::mutex> lock{ error_mutex };
+
+      if (!error)
+      {
+        error = std::current_exception();
+      }
+
+      next = count;
+    }
+  };
+
+  const size_t thread_count = parallel_thread_count(count, max_threads);
+  std::vector<std::future<void>> futures;
+
+  for (size_t i(1); i < thread_count; ++i)
+  {
+    futures.push_back(std::async(std::launch::async, work));
+  }
+
+  work();
+
+  for (std::future<void>& f : futures)
+  {
+    f.get();
+  }
+
+  if (error)
+  {
+    std::rethrow_exception(error);
+  }
+}
@@ -4,11 +4,47 @@
 
 #include "q3dmodel.h"
 
+#include "modelloader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+/**
+ * @brief a model being loaded in a worker thread
+ *
+ * The model and the error are written by the worker thread and read
+ * by the main thread after the thread is joined.
+ */
+struct Q3dModel::LoadingTask
+{
+  QString file_path;
+  ModelOptions options;
+  std::atomic<bool> canceled{ false };
+  std::thread thread;
+  std::unique_ptr<Model> model;
+  QString error;
+};
+
 Q3dModel::Q3dModel(QObject* parent) : QObject(parent)
 {
 
 }
 
+Q3dModel::~Q3dModel()
+{
+  // the loader is stopped at the next progress report
+  for (const std::unique_ptr<LoadingTask>& task : m_loading_tasks)
+  {
+    task->canceled = true;
+  }
+
+  for (const std::unique_ptr<LoadingTask>& task : m_loading_tasks)
+  {
+    task->thread.join();
+  }
+}
+
 QString Q3dModel::filePath() const
 {
   return m_model ? m_model->path() : QString();
@@ -51,7 +87,255 @@ Model* Q3dModel::model() const
   return m_model.get();
 }
 
+/**
+ * @brief returns the model, for use by the render thread
+ *
+ * The render thread keeps a reference to the model it draws, so that
+ * the model is not destroyed by setModel() while it is being drawn.
+ */
+std::shared_ptr<Model> Q3dModel::sharedModel() const
+{
+  return m_model;
+}
+
 QBoundingBox* Q3dModel::boundingBox() const
 {
   return m_bbox;
 }
+
+const ModelOptions& Q3dModel::options() const
+{
+  return m_options;
+}
+
+/**
+ * @brief sets the options with which the models are loaded and drawn
+ *
+ * The rendering options are applied during the next synchronization
+ * of the scene, the loading options to the next call to load().
+ */
+void Q3dModel::setOptions(const ModelOptions& options)
+{
+  m_options = options;
+}
+
+/**
+ * @brief returns the statistics of the last frame in which the model was rendered
+ *
+ * The number of meshes that were drawn and culled, the draw calls and the
+ * state changes are counted by the renderer in the render thread.
+ */
+const ModelRenderStatistics& Q3dModel::renderStatistics() const
+{
+  return m_render_statistics;
+}
+
+/**
+ * @brief sets the render statistics, called by the scene once a frame is rendered
+ */
+void Q3dModel::setRenderStatistics(const ModelRenderStatistics& statistics)
+{
+  m_render_statistics = statistics;
+  Q_EMIT renderStatisticsChanged();
+}
+
+/**
+ * @brief returns the mesh nodes whose world bounding box overlaps a box
+ * @param min  the minimum corner of the box
+ * @param max  the maximum corner of the box
+ *
+ * The mesh nodes are identified by their index in model::SceneHierarchy::meshNodes(),
+ * and are returned in increasing order.
+ */
+QVariantList Q3dModel::meshNodesInBox(const QVector3D& min, const QVector3D& max) const
+{
+  QVariantList result;
+
+  if (!m_model)
+  {
+    return result;
+  }
+
+  std::vector<int> nodes;
+  m_model->bvh().query(AABB(min, max), nodes);
+  std::sort(nodes.begin(), nodes.end());
+
+  result.reserve(static_cast<int>(nodes.size()));
+
+  for (int n : nodes)
+  {
+    result.push_back(n);
+  }
+
+  return result;
+}
+
+/**
+ * @brief returns the number of mesh nodes whose world bounding box overlaps a box
+ */
+int Q3dModel::meshCountInBox(const QVector3D& min, const QVector3D& max) const
+{
+  if (!m_model)
+  {
+    return 0;
+  }
+
+  std::vector<int> nodes;
+  m_model->bvh().query(AABB(min, max), nodes);
+  return static_cast<int>(nodes.size());
+}
+
+/**
+ * @brief loads a model in a worker thread
+ * @param filePath  the path of the file
+ *
+ * Importing the file, converting it and optimizing the meshes is done in
+ * a worker thread; the model is set once it is ready, the GPU resources are
+ * then created by the render thread when the model is first drawn.
+ * The progress is reported with loadingProgressChanged().
+ * Loading a model cancels the loading of the previous one, if any.
+ */
+void Q3dModel::load(const QString& filePath)
+{
+  if (m_current_loading_task)
+  {
+    m_current_loading_task->canceled = true;
+  }
+
+  m_loading_tasks.push_back(std::make_unique<LoadingTask>());
+  LoadingTask* task = m_loading_tasks.back().get();
+  task->file_path = filePath;
+  task->options = m_options;
+
+  const bool was_loading = loading();
+  m_current_loading_task = task;
+  setLoadingProgress(0);
+
+  task->thread = std::thread([this, task]() { runLoadingTask(task); });
+
+  if (!was_loading)
+  {
+    Q_EMIT loadingChanged();
+  }
+}
+
+/**
+ * @brief cancels the loading started by load()
+ *
+ * loadingCanceled() is emitted once the worker thread has stopped;
+ * the current model is kept.
+ */
+void Q3dModel::cancelLoading()
+{
+  if (m_current_loading_task)
+  {
+    m_current_loading_task->canceled = true;
+  }
+}
+
+/**
+ * @brief returns whether a model is being loaded
+ */
+bool Q3dModel::loading() const
+{
+  return m_current_loading_task != nullptr;
+}
+
+/**
+ * @brief returns the progress of the current loading, between 0 and 1
+ */
+qreal Q3dModel::loadingProgress() const
+{
+  return m_loading_progress;
+}
+
+/**
+ * @brief loads the model of a task, called in the worker thread
+ *
+ * The main thread is notified with queued invocations; they cannot outlive
+ * this object, whose destructor joins the worker threads.
+ */
+void Q3dModel::runLoadingTask(LoadingTask* task)
+{
+  float reported_progress = -1;
+
+  ModelLoader loader;
+  configure_loader(loader, task->options);
+  loader.setProgressCallback([this, task, &reported_progress](float progress) {
+    // the main thread is only notified of noticeable changes
+    if (progress - reported_progress >= 0.01f || progress == 1)
+    {
+      reported_progress = progress;
+      QMetaObject::invokeMethod(
+        this, [this, task, progress]() { onLoadingProgress(task, progress); }, Qt::QueuedConnection);
+    }
+
+    return !task->canceled;
+  });
+
+  try
+  {
+    task->model = loader.load(task->file_path);
+  }
+  catch (const std::exception& ex)
+  {
+    task->error = QString::fromUtf8(ex.what());
+  }
+
+  QMetaObject::invokeMethod(
+    this, [this, task]() { onLoadingFinished(task); }, Qt::QueuedConnection);
+}
+
+void Q3dModel::onLoadingProgress(LoadingTask* task, float progress)
+{
+  if (task == m_current_loading_task && !task->canceled)
+  {
+    setLoadingProgress(progress);
+  }
+}
+
+void Q3dModel::onLoadingFinished(LoadingTask* task)
+{
+  // the thread has nothing left to do
+  task->thread.join();
+
+  auto it = std::find_if(m_loading_tasks.begin(), m_loading_tasks.end(), [task](const std::unique_ptr<LoadingTask>& t) {
+    return t.get() == task;
+  });
+
+  std::unique_ptr<LoadingTask> finished = std::move(*it);
+  m_loading_tasks.erase(it);
+
+  if (finished.get() != m_current_loading_task)
+  {
+    // replaced by another task
+    return;
+  }
+
+  m_current_loading_task = nullptr;
+
+  if (finished->canceled)
+  {
+    Q_EMIT loadingCanceled();
+  }
+  else if (finished->model)
+  {
+    setModel(std::move(finished->model));
+  }
+  else
+  {
+    Q_EMIT loadingFailed(finished->error);
+  }
+
+  setLoadingProgress(0);
+  Q_EMIT loadingChanged();
+}
+
+void Q3dModel::setLoadingProgress(qreal progress)
+{
+  if (m_loading_progress != progress)
+  {
+    m_loading_progress = progress;
+    Q_EMIT loadingProgressChanged();
+  }
+}
@@ -5,9 +5,15 @@
 #pragma once
 
 #include "model.h"
+#include "modeloptions.h"
+#include "modelrenderer.h"
 #include "qboundingbox.h"
 
 #include <QObject>
+#include <QVariantList>
+
+#include <memory>
+#include <vector>
 
 class Q3dModel : public QObject
 {
@@ -16,8 +22,12 @@ class Q3dModel : public QObject
   Q_PROPERTY(QString filePath READ filePath NOTIFY modelChanged)
   Q_PROPERTY(QVector3D modelCenter READ modelCenter NOTIFY modelChanged)
   Q_PROPERTY(QBoundingBox* boundingBox READ boundingBox NOTIFY modelChanged)
+  Q_PROPERTY(bool loading READ loading NOTIFY loadingChanged)
+  Q_PROPERTY(qreal loadingProgress READ loadingProgress NOTIFY loadingProgressChanged)
+  Q_PROPERTY(ModelRenderStatistics renderStatistics READ renderStatistics NOTIFY renderStatisticsChanged)
 public:
   explicit Q3dModel(QObject* parent = nullptr);
+  ~Q3dModel();
 
   QString filePath() const;
   
@@ -25,13 +35,48 @@ public:
 
   void setModel(std::unique_ptr<Model> m);
   Model* model() const;
+  std::shared_ptr<Model> sharedModel() const;
 
   QBoundingBox* boundingBox() const;
 
+  const ModelOptions& options() const;
+  void setOptions(const ModelOptions& options);
+
+  const ModelRenderStatistics& renderStatistics() const;
+  void setRenderStatistics(const ModelRenderStatistics& statistics);
+
+  Q_INVOKABLE QVariantList meshNodesInBox(const QVector3D& min, const QVector3D& max) const;
+  Q_INVOKABLE int meshCountInBox(const QVector3D& min, const QVector3D& max) const;
+
+  Q_INVOKABLE void load(const QString& filePath);
+  Q_INVOKABLE void cancelLoading();
+  bool loading() const;
+  qreal loadingProgress() const;
+
 Q_SIGNALS:
   void modelChanged();
+  void loadingChanged();
+  void loadingProgressChanged();
+  void loadingFailed(const QString& message);
+  void loadingCanceled();
+  void renderStatisticsChanged();
+
+private:
+  struct LoadingTask;
+  void runLoadingTask(LoadingTask* task);
+  void onLoadingProgress(LoadingTask* task, float progress);
+  void onLoadingFinished(LoadingTask* task);
+  void setLoadingProgress(qreal progress);
 
 private:
-  std::unique_ptr<Model> m_model;
+  // shared with the render thread, which may still be drawing the
+  // previous model when a new one is set
+  std::shared_ptr<Model> m_model;
   QBoundingBox* m_bbox = nullptr;
+  ModelOptions m_options;
+  ModelRenderStatistics m_render_statistics;
+  // a task that is canceled keeps running until the loader notices it
+  std::vector<std::unique_ptr<LoadingTask>> m_loading_tasks;
+  LoadingTask* m_current_loading_task = nullptr;
+  qreal m_loading_progress = 0;
 };
@@ -4,21 +4,22 @@
 
 #include "q3dmodelcontroller.h"
 
-#include "modelloader.h"
+#include <QDebug>
 
 Q3dModelController::Q3dModelController(Q3dModel& model, QObject* parent) : QObject(parent),
   m_model(model)
 {
-
+  connect(&m_model, &Q3dModel::loadingFailed, this, [](const QString& message) {
+    qWarning().noquote() << message;
+  });
 }
 
+/**
+ * @brief starts loading a model in the background
+ *
+ * @sa Q3dModel::load()
+ */
 void Q3dModelController::openModel(const QUrl& path)
 {
-  ModelLoader loader;
-  std::unique_ptr<Model> model = loader.tryLoad(path.toLocalFile());
-
-  if (model)
-  {
-    m_model.setModel(std::move(model));
-  }
+  m_model.load(path.toLocalFile());
 }
@@ -11,6 +11,9 @@ Item {
     property bool hasLoadedModel: q_3dmodel.filePath !== ""
     property real separatorSize: 4
 
+    focus: true
+    Keys.onEscapePressed: q_3dmodel.cancelLoading()
+
     AppViewport {
         id: mainViewport
         x: 0
@@ -38,6 +41,7 @@ Item {
             controller: OrbitalCameraController {
                 //target: q_3dmodel.modelCenter
                 target: q_3dmodel.boundingBox ? q_3dmodel.boundingBox.center : Qt.vector3d(0, 0, 0)
+                coalesceInput: true
             }
         }
     }
@@ -72,4 +76,15 @@ Item {
         color: "white"
         font.pixelSize: 14
     }
+
+    Text {
+        id: loadingText
+        anchors.margins: 8
+        anchors.left: parent.left
+        anchors.bottom: cameraPosText.top
+        visible: q_3dmodel.loading
+        text: "Loading... " + Math.round(q_3dmodel.loadingProgress * 100) + "% (press Escape to cancel)"
+        color: "white"
+        font.pixelSize: 14
+    }
 }
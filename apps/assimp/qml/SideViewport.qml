@@ -10,6 +10,7 @@ AppViewport {
 
     drawWorldFrame: true
     drawCameraOrientationAxes: false
+    cached: true
 
     camera: Camera {
         controller: BboxSideCameraController {
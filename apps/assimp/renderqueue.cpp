@@ -0,0 +1,105 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "renderqueue.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+void RenderQueue::clear()
+{
+  m_items.clear();
+}
+
+void RenderQueue::push(uint64_t key, uint32_t index)
+{
+  m_items.push_back(Item{ key, index });
+}
+
+/**
+ * @brief sorts the items by increasing key
+ *
+ * This is a least-significant-digit radix sort on bytes, which is stable:
+ * items with the same key stay in the order in which they were pushed.
+ * Passes on bytes that are the same for all items are skipped.
+ */
+void RenderQueue::sort()
+{
+  constexpr int Passes = sizeof(uint64_t);
+
+  if (m_items.size() < 2)
+  {
+    return;
+  }
+
+  std::array<std::array<uint32_t, 256>, Passes> histograms = {};
+
+  for (const Item& item : m_items)
+  {
+    for (int pass = 0; pass < Passes; ++pass)
+    {
+      ++histograms[pass][(item.key >> (8 * pass)) & 0xFF];
+    }
+  }
+
+  m_buffer.resize(m_items.size());
+
+  for (int pass = 0; pass < Passes; ++pass)
+  {
+    std::array<uint32_t, 256>& histogram = histograms[pass];
+    const int shift = 8 * pass;
+
+    if (histogram[(m_items.front().key >> shift) & 0xFF] == m_items.size())
+    {
+      continue;
+    }
+
+    uint32_t offset = 0;
+
+    for (uint32_t& count : histogram)
+    {
+      const uint32_t n = count;
+      count = offset;
+      offset += n;
+    }
+
+    for (const Item& item : m_items)
+    {
+      m_buffer[histogram[(item.key >> shift) & 0xFF]++] = item;
+    }
+
+    std::swap(m_items, m_buffer);
+  }
+}
+
+/**
+ * @brief builds a sort key
+ * @param program   identifier of the shader program
+ * @param material  identifier of the material
+ * @param texture   identifier of the texture
+ * @param vao       identifier of the vertex array object
+ * @param depth     view-space distance to the camera, used to draw front-to-back
+ *
+ * Identifiers use 12 bits each and are clamped: items whose identifiers exceed
+ * this range are still drawn correctly, they are just not grouped as well.
+ * The depth uses the upper 16 bits of its floating-point representation,
+ * which preserves the ordering of positive values; negative depths are clamped to zero.
+ */
+uint64_t RenderQueue::makeKey(uint32_t program, uint32_t material, uint32_t texture, uint32_t vao, float depth)
+{
+  auto field = [](uint32_t id) -> uint64_t {
+    return std::min<uint32_t>(id, 0xFFF);
+  };
+
+  depth = std::max(depth, 0.f);
+  uint32_t depth_bits;
+  std::memcpy(&depth_bits, &depth, sizeof(depth_bits));
+
+  return (field(program) << 52)
+    | (field(material) << 40)
+    | (field(texture) << 28)
+    | (field(vao) << 16)
+    | (depth_bits >> 16);
+}
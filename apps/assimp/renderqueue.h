@@ -0,0 +1,60 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief a list of draw items ordered by a 64-bit sort key
+ *
+ * Items are pushed in traversal order and sorted with a radix sort so that
+ * items sharing the same OpenGL state end up next to each other.
+ * The key is built with makeKey(): the most significant fields are those
+ * that are the most expensive to change.
+ *
+ * The storage is kept between frames to avoid reallocations.
+ */
+class RenderQueue
+{
+public:
+  struct Item
+  {
+    uint64_t key;
+    uint32_t index; ///< index of the draw in a list owned by the user of the queue
+  };
+
+  bool empty() const;
+  size_t size() const;
+
+  void clear();
+  void push(uint64_t key, uint32_t index);
+
+  void sort();
+
+  const std::vector<Item>& items() const;
+
+  static uint64_t makeKey(uint32_t program, uint32_t material, uint32_t texture, uint32_t vao, float depth);
+
+private:
+  std::vector<Item> m_items;
+  std::vector<Item> m_buffer;
+};
+
+inline bool RenderQueue::empty() const
+{
+  return m_items.empty();
+}
+
+inline size_t RenderQueue::size() const
+{
+  return m_items.size();
+}
+
+inline const std::vector<RenderQueue::Item>& RenderQueue::items() const
+{
+  return m_items;
+}
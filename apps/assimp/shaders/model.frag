@@ -13,8 +13,13 @@ in vec3 v_normal;
 #endif
 
 #if defined(MATERIAL_FLAT_COLOR)
+#if defined(MULTI_DRAW_INDIRECT)
+flat in vec3 v_flat_color;
+#define flat_color v_flat_color
+#else
 uniform vec3 flat_color;
 #endif
+#endif
 
 #if defined(MATERIAL_TEXTURE)
 uniform sampler2D texture_diffuse;
@@ -11,10 +11,34 @@ layout(location = 3) in vec2 uv;
 #endif
 
 #if defined(MESH_HAS_NORMALS)
+#if defined(MESH_COMPACT)
+// octahedral encoding
+layout(location = 4) in vec2 normal;
+#else
 layout(location = 4) in vec3 normal;
 #endif
+#endif
 
+#if defined(MULTI_DRAW_INDIRECT) || defined(MESH_INSTANCED)
+// per-instance data
+layout(location = 5) in mat4 model_matrix;
+#if defined(MULTI_DRAW_INDIRECT) && defined(MATERIAL_FLAT_COLOR)
+layout(location = 9) in vec3 instance_color;
+#endif
+#if defined(MULTI_DRAW_INDIRECT) && defined(MESH_COMPACT)
+layout(location = 10) in vec3 position_origin;
+layout(location = 11) in vec3 position_scale;
+#endif
+#else
 uniform mat4 model_matrix;
+#endif
+
+#if defined(MESH_COMPACT) && !defined(MULTI_DRAW_INDIRECT)
+// the positions are quantized relative to the bounding box of the mesh
+uniform vec3 position_origin;
+uniform vec3 position_scale;
+#endif
+
 uniform mat4 view_matrix;
 uniform mat4 projection_matrix;
 
@@ -30,9 +54,28 @@ out vec2 v_uv;
 out vec3 v_normal;
 #endif
 
+#if defined(MULTI_DRAW_INDIRECT) && defined(MATERIAL_FLAT_COLOR)
+flat out vec3 v_flat_color;
+#endif
+
+#if defined(MESH_COMPACT) && defined(MESH_HAS_NORMALS)
+vec3 decode_octahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+#endif
+
 void main()
 {
+#if defined(MESH_COMPACT)
+    vec4 model_pos = vec4(position_origin + position_scale * position, 1.0);
+#else
     vec4 model_pos = vec4(position, 1.0);
+#endif
     gl_Position = projection_matrix * view_matrix * model_matrix * model_pos;
 
 #if defined(MESH_HAS_COLORS)
@@ -43,11 +86,19 @@ void main()
     v_uv = uv;
 #endif
 
+#if defined(MULTI_DRAW_INDIRECT) && defined(MATERIAL_FLAT_COLOR)
+    v_flat_color = instance_color;
+#endif
+
 #if defined(MESH_HAS_NORMALS)
     // The model's normals need to be transformed, but the transform's
     // scale need to be taken into account ; hence this non-trivial
     // formula.
     // See https://learnopengl.com/Lighting/Basic-Lighting
+#if defined(MESH_COMPACT)
+    v_normal = mat3(transpose(inverse(model_matrix))) * decode_octahedral(normal);
+#else
     v_normal = mat3(transpose(inverse(model_matrix))) * normal;
 #endif
+#endif
 }
@@ -0,0 +1,91 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "texturedecoding.h"
+
+#include <QImageReader>
+
+#include <algorithm>
+#include <cstdint>
+
+/**
+ * @brief flips an image vertically, in place
+ *
+ * Unlike QImage::mirrored(), this does not allocate a copy of the image.
+ */
+void flip_vertically(QImage& image)
+{
+  const int bytes_per_line = image.bytesPerLine();
+
+  for (int top(0), bottom(image.height() - 1); top < bottom; ++top, --bottom)
+  {
+    std::swap_ranges(image.scanLine(top), image.scanLine(top) + bytes_per_line, image.scanLine(bottom));
+  }
+}
+
+/**
+ * @brief computes the next mipmap level of an RGBA8888 image
+ *
+ * Each texel is the average of a 2x2 block of the input; when a dimension
+ * is odd, the last row or column is repeated.
+ */
+QImage downsample(const QImage& image)
+{
+  const int w = std::max(image.width() / 2, 1);
+  const int h = std::max(image.height() / 2, 1);
+
+  QImage result{ w, h, QImage::Format_RGBA8888 };
+
+  for (int y(0); y < h; ++y)
+  {
+    const uint8_t* row0 = image.constScanLine(std::min(2 * y, image.height() - 1));
+    const uint8_t* row1 = image.constScanLine(std::min(2 * y + 1, image.height() - 1));
+    uint8_t* out = result.scanLine(y);
+
+    for (int x(0); x < w; ++x)
+    {
+      const int x0 = 4 * std::min(2 * x, image.width() - 1);
+      const int x1 = 4 * std::min(2 * x + 1, image.width() - 1);
+
+      for (int c(0); c < 4; ++c)
+      {
+        out[4 * x + c] = static_cast<uint8_t>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+      }
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief decodes an image file and generates its mipmaps
+ * @param filepath  the path of the image
+ * @return the decoded image, or null if the file could not be read
+ *
+ * This function does not use OpenGL and is meant to be called from
+ * worker threads.
+ */
+std::shared_ptr<DecodedTexture> decode_texture(const QString& filepath)
+{
+  QImageReader reader{ filepath };
+  QImage image = reader.read();
+
+  if (image.isNull())
+  {
+    return nullptr;
+  }
+
+  image = std::move(image).convertToFormat(QImage::Format_RGBA8888);
+  flip_vertically(image);
+
+  auto result = std::make_shared<DecodedTexture>();
+  result->levels.push_back(std::move(image));
+
+  while (result->levels.back().width() > 1 || result->levels.back().height() > 1)
+  {
+    result->levels.push_back(downsample(result->levels.back()));
+  }
+
+  return result;
+}
@@ -0,0 +1,29 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include <QImage>
+#include <QString>
+
+#include <memory>
+#include <vector>
+
+/**
+ * @brief an image decoded for being uploaded in a texture
+ *
+ * The levels are in the RGBA8888 format, flipped vertically so that the
+ * first row is the bottom of the image as expected by OpenGL;
+ * levels[0] is the full-size image and each following level is half the
+ * size of the previous one, down to 1x1.
+ */
+struct DecodedTexture
+{
+  std::vector<QImage> levels;
+};
+
+void flip_vertically(QImage& image);
+QImage downsample(const QImage& image);
+
+std::shared_ptr<DecodedTexture> decode_texture(const QString& filepath);
@@ -7,8 +7,13 @@
 #include "heightfieldmodel.h"
 
 #include <algorithm>
+#include <tuple>
 
-std::pair<std::vector<QVector3D>, std::vector<int>> generate_mesh(QSize mesh_size)
+// the lines of the mesh are grouped by tiles of TileSize x TileSize cells
+// so that tiles outside of the view frustum can be skipped when drawing.
+constexpr int TileSize = 16;
+
+std::tuple<std::vector<QVector3D>, std::vector<int>, std::vector<HeightFieldMesh::Tile>> generate_mesh(QSize mesh_size)
 {
   std::vector<QVector3D> vertices;
   vertices.resize((mesh_size.width() + 1) * (mesh_size.height() + 1));
@@ -38,33 +43,50 @@ std::pair<std::vector<QVector3D>, std::vector<int>> generate_mesh(QSize mesh_siz
     indices[w++] = index;
   };
 
-  // horizontal (i.e. x-oriented) lines
-  for (size_t i(0); i <= mesh_size.height(); i++)
-  {
-    int index = i;
+  auto vertex_index = [&mesh_size](int i, int j) {
+    return i * (mesh_size.height() + 1) + j;
+  };
 
-    for (size_t j(0); j < mesh_size.width(); j++)
-    {
-      write_index(index);
-      index += (mesh_size.height() + 1);
-      write_index(index);
-    }
-  }
+  std::vector<HeightFieldMesh::Tile> tiles;
 
-  // vertical (i.e. y-oriented) lines
-  for (size_t i(0); i <= mesh_size.width(); i++)
+  for (int tx(0); tx < mesh_size.width(); tx += TileSize)
   {
-    int index = (mesh_size.height() + 1) * i;
-
-    for (size_t j(0); j < mesh_size.height(); j++)
+    for (int ty(0); ty < mesh_size.height(); ty += TileSize)
     {
-      write_index(index);
-      ++index;
-      write_index(index);
+      HeightFieldMesh::Tile tile;
+      tile.cells = QRect(tx, ty, std::min(TileSize, mesh_size.width() - tx), std::min(TileSize, mesh_size.height() - ty));
+      tile.first_index = static_cast<int>(w);
+
+      // the lines on the right and top borders of the mesh belong to the last tiles
+      const int last_col = tile.cells.right() + 1 == mesh_size.width() ? mesh_size.width() : tile.cells.right();
+      const int last_row = tile.cells.bottom() + 1 == mesh_size.height() ? mesh_size.height() : tile.cells.bottom();
+
+      // horizontal (i.e. x-oriented) lines
+      for (int j(tile.cells.top()); j <= last_row; j++)
+      {
+        for (int i(tile.cells.left()); i <= tile.cells.right(); i++)
+        {
+          write_index(vertex_index(i, j));
+          write_index(vertex_index(i + 1, j));
+        }
+      }
+
+      // vertical (i.e. y-oriented) lines
+      for (int i(tile.cells.left()); i <= last_col; i++)
+      {
+        for (int j(tile.cells.top()); j <= tile.cells.bottom(); j++)
+        {
+          write_index(vertex_index(i, j));
+          write_index(vertex_index(i, j + 1));
+        }
+      }
+
+      tile.index_count = static_cast<int>(w) - tile.first_index;
+      tiles.push_back(tile);
     }
   }
 
-  return { vertices, indices };
+  return { vertices, indices, tiles };
 }
 
 HeightFieldMesh::HeightFieldMesh()
@@ -80,21 +102,22 @@ HeightFieldMesh::HeightFieldMesh()
   m_mesh_dirty = true;
   m_mesh_resolution = 1.f;
   m_mesh_color = QColor("lime");
-  m_zvalues = std::vector<float>(100, 0.f);
-  /*m_zvalues[11] = 0.1f;
-  m_zvalues[12] = 0.2f;
-  m_zvalues[13] = 0.3f;*/
-  for (size_t i(0); i < m_zvalues.size(); ++i)
+  auto zvalues = std::vector<float>(100, 0.f);
+  /*zvalues[11] = 0.1f;
+  zvalues[12] = 0.2f;
+  zvalues[13] = 0.3f;*/
+  for (size_t i(0); i < zvalues.size(); ++i)
   {
-    m_zvalues[i] = (std::cos(i * 0.1f) + 1) * 0.5;
+    zvalues[i] = (std::cos(i * 0.1f) + 1) * 0.5;
   }
 
-  std::fill(m_zvalues.begin() + m_zvalues.size() / 3, m_zvalues.begin() + 2 * m_zvalues.size() / 3, -1.f);
+  std::fill(zvalues.begin() + zvalues.size() / 3, zvalues.begin() + 2 * zvalues.size() / 3, -1.f);
 
-  //for (size_t i(m_zvalues.size()/2); i < m_zvalues.size(); ++i)
+  //for (size_t i(zvalues.size()/2); i < zvalues.size(); ++i)
   //{
-  //  m_zvalues[i] = 1.f;
+  //  zvalues[i] = 1.f;
   //}
+  m_zvalues = std::make_shared<const std::vector<float>>(std::move(zvalues));
   m_zvalues_dirty = true;
 }
 
@@ -111,7 +134,8 @@ void HeightFieldMesh::synchronize(const HeightFieldModel& model)
 
     if (model.heightmapRevision() != m_heightmap_revision)
     {
-      m_zvalues = hmo.heightmap().zBuffer();
+      // the buffer is shared, not copied, as it is immutable
+      m_zvalues = hmo.heightmap().sharedZBuffer();
       m_zvalues_dirty = true;
 
       m_heightmap_rows = hmo.rows();
@@ -149,6 +173,11 @@ void HeightFieldMesh::draw(OpenGLFunctions* gl, const QMatrix4x4& projectionMatr
 
   QOpenGLVertexArrayObject& vao = get_vao(gl);
 
+  if (!cull_tiles(projectionMatrix * viewMatrix))
+  {
+    return;
+  }
+
   vao.bind();
 
   QOpenGLShaderProgram& shader_program = get_shader_program();
@@ -170,7 +199,14 @@ void HeightFieldMesh::draw(OpenGLFunctions* gl, const QMatrix4x4& projectionMatr
   shader_program.setUniformValue("heightmap_altmin", m_heightmap_altmin);
   shader_program.setUniformValue("heightmap_altmax", m_heightmap_altmax);
   
-  gl->glDrawElements(GL_LINES, m_mesh_nbindices, GL_UNSIGNED_INT, nullptr);
+  if (m_draw_counts.size() == 1)
+  {
+    gl->glDrawElements(GL_LINES, m_draw_counts.front(), GL_UNSIGNED_INT, m_draw_offsets.front());
+  }
+  else
+  {
+    gl->glMultiDrawElements(GL_LINES, m_draw_counts.data(), GL_UNSIGNED_INT, m_draw_offsets.data(), static_cast<GLsizei>(m_draw_counts.size()));
+  }
 
   shader_program.release();
 
@@ -198,8 +234,9 @@ QOpenGLVertexArrayObject& HeightFieldMesh::get_vao(OpenGLFunctions* gl)
   m_vao->bind();
 
   {
-    auto [vertex_data, index_data] = generate_mesh(m_mesh_size);
+    auto [vertex_data, index_data, tiles] = generate_mesh(m_mesh_size);
     m_mesh_nbindices = (int)index_data.size();
+    m_tiles = std::move(tiles);
 
     {
       m_vertex_buffer = std::make_unique<QOpenGLBuffer>(QOpenGLBuffer::VertexBuffer);
@@ -241,7 +278,7 @@ QOpenGLVertexArrayObject& HeightFieldMesh::get_vao(OpenGLFunctions* gl)
 
     m_texture_buffer->bind();
     m_texture_buffer->setUsagePattern(QOpenGLBuffer::StaticDraw);
-    m_texture_buffer->allocate(m_zvalues.data(), static_cast<int>(m_zvalues.size() * sizeof(float)));
+    m_texture_buffer->allocate(m_zvalues->data(), static_cast<int>(m_zvalues->size() * sizeof(float)));
     m_texture_buffer->release();
 
     m_texture = std::make_unique<QOpenGLTexture>(QOpenGLTexture::Target::TargetBuffer);
@@ -272,8 +309,9 @@ void HeightFieldMesh::udpate_buffers()
 
   if (m_mesh_dirty)
   {
-    auto [vertex_data, index_data] = generate_mesh(m_mesh_size);
+    auto [vertex_data, index_data, tiles] = generate_mesh(m_mesh_size);
     m_mesh_nbindices = (int)index_data.size();
+    m_tiles = std::move(tiles);
 
     m_vertex_buffer->bind();
     m_vertex_buffer->allocate(vertex_data.data(), static_cast<int>(vertex_data.size() * sizeof(QVector3D)));
@@ -289,13 +327,69 @@ void HeightFieldMesh::udpate_buffers()
   if (m_zvalues_dirty)
   {
     m_texture_buffer->bind();
-    m_texture_buffer->allocate(m_zvalues.data(), static_cast<int>(m_zvalues.size() * sizeof(float)));
+    m_texture_buffer->allocate(m_zvalues->data(), static_cast<int>(m_zvalues->size() * sizeof(float)));
     m_texture_buffer->release();
 
     m_zvalues_dirty = false;
   }
 }
 
+/**
+ * @brief computes the ranges of indices of the tiles that are inside the view frustum
+ * @param viewProjectionMatrix  the view-projection matrix
+ * @return whether at least one tile is visible
+ */
+bool HeightFieldMesh::cull_tiles(const QMatrix4x4& viewProjectionMatrix)
+{
+  // the altitude of a vertex is computed in the vertex shader from a
+  // normalized value in [-1, 1] (negative values being holes)
+  const float alt_range = m_heightmap_altmax - m_heightmap_altmin;
+  const float zmin = std::min({ m_heightmap_altmin, m_heightmap_altmax, m_heightmap_altmin - alt_range });
+  const float zmax = std::max({ m_heightmap_altmin, m_heightmap_altmax, m_heightmap_altmin - alt_range });
+
+  m_tile_boxes.clear();
+  m_tile_boxes.reserve(m_tiles.size());
+
+  for (const Tile& tile : m_tiles)
+  {
+    const QVector2D a = QVector2D(m_mesh_origin) + m_mesh_resolution * QVector2D(tile.cells.left() - 0.5f * m_mesh_size.width(), tile.cells.top() - 0.5f * m_mesh_size.height());
+    const QVector2D b = a + m_mesh_resolution * QVector2D(tile.cells.width(), tile.cells.height());
+
+    m_tile_boxes.append(QVector3D(std::min(a.x(), b.x()), std::min(a.y(), b.y()), zmin),
+      QVector3D(std::max(a.x(), b.x()), std::max(a.y(), b.y()), zmax));
+  }
+
+  FrustumPlanes frustum{ viewProjectionMatrix };
+  frustum.cullBoxes(m_tile_boxes, m_tile_visibility);
+
+  m_draw_counts.clear();
+  m_draw_offsets.clear();
+
+  for (size_t i(0); i < m_tiles.size(); ++i)
+  {
+    if (!m_tile_visibility.test(i))
+    {
+      continue;
+    }
+
+    const Tile& tile = m_tiles.at(i);
+
+    // tiles are contiguous in the index buffer, so consecutive visible tiles
+    // are merged into a single range
+    if (i > 0 && m_tile_visibility.test(i - 1))
+    {
+      m_draw_counts.back() += tile.index_count;
+    }
+    else
+    {
+      m_draw_counts.push_back(tile.index_count);
+      m_draw_offsets.push_back(reinterpret_cast<const GLvoid*>(tile.first_index * sizeof(int)));
+    }
+  }
+
+  return !m_draw_counts.empty();
+}
+
 QOpenGLShaderProgram& HeightFieldMesh::get_shader_program()
 {
   if (m_shader_program)
@@ -10,6 +10,9 @@
 #include <QOpenGLTexture>
 #include <QOpenGLVertexArrayObject>
 #include <QOpenGLFunctions_3_3_Core>
+#include <QRect>
+
+#include "qmlgl/frustumplanes.h"
 
 
 class HeightFieldModel;
@@ -28,10 +31,21 @@ public:
 
   void releaseResources();
 
+  /**
+   * @brief a group of cells of the mesh whose lines are contiguous in the index buffer
+   */
+  struct Tile
+  {
+    QRect cells;
+    int first_index = 0;
+    int index_count = 0;
+  };
+
 protected:
   QOpenGLVertexArrayObject& get_vao(OpenGLFunctions* gl);
   void udpate_buffers();
   QOpenGLShaderProgram& get_shader_program();
+  bool cull_tiles(const QMatrix4x4& viewProjectionMatrix);
 
 private:
   int m_heightmap_revision = 0;
@@ -48,10 +62,15 @@ private:
   float m_mesh_resolution = 1.f;
   QColor m_mesh_color = QColor("lime");
   QColor m_mesh_outside_color = QColor("deepskyblue");
-  std::vector<float> m_zvalues;
+  std::shared_ptr<const std::vector<float>> m_zvalues;
   bool m_zvalues_dirty = false;
 
   int m_mesh_nbindices = 0;
+  std::vector<Tile> m_tiles;
+  BoundingBoxArray m_tile_boxes;
+  VisibilityMask m_tile_visibility;
+  std::vector<GLsizei> m_draw_counts;
+  std::vector<const GLvoid*> m_draw_offsets;
 
 private:
   std::unique_ptr<QOpenGLVertexArrayObject> m_vao;
@@ -9,6 +9,7 @@
 #include <QVector3D>
 
 #include <algorithm>
+#include <memory>
 #include <optional>
 #include <vector>
 
@@ -20,6 +21,7 @@ public:
   HeightMap(HeightMap&&) = default;
 
   const std::vector<float>& zBuffer() const;
+  const std::shared_ptr<const std::vector<float>>& sharedZBuffer() const;
   int rows() const;
   int cols() const;
 
@@ -50,7 +52,9 @@ public:
   HeightMap& operator=(HeightMap&&) = default;
 
 private:
-  std::vector<float> m_z_values;
+  // the buffer is never modified once created, so that it can be
+  // shared with the render thread without copying it
+  std::shared_ptr<const std::vector<float>> m_z_values;
   int m_cols = 0;
   float m_alt_min = -1;
   float m_alt_max = 1;
@@ -59,13 +63,18 @@ private:
 };
 
 inline HeightMap::HeightMap()
-  : m_z_values(size_t(1), -1.f),
+  : m_z_values(std::make_shared<const std::vector<float>>(size_t(1), -1.f)),
   m_cols(1)
 {
 
 }
 
 inline const std::vector<float>& HeightMap::zBuffer() const
+{
+  return *m_z_values;
+}
+
+inline const std::shared_ptr<const std::vector<float>>& HeightMap::sharedZBuffer() const
 {
   return m_z_values;
 }
@@ -82,14 +91,14 @@ inline int HeightMap::cols() const
 
 inline void HeightMap::fill(std::vector<float> zvalues, int nbcols)
 {
-  m_z_values = std::move(zvalues);
+  m_z_values = std::make_shared<const std::vector<float>>(std::move(zvalues));
   m_cols = nbcols;
 }
 
 template<typename F>
 inline void HeightMap::fill(int nbrows, int nbcols, F&& fun)
 {
-  m_z_values.resize(nbrows * nbcols);
+  std::vector<float> zvalues(nbrows * nbcols);
 
   size_t i = 0;
 
@@ -97,9 +106,11 @@ inline void HeightMap::fill(int nbrows, int nbcols, F&& fun)
   {
     for (int y(0); y < nbrows; ++y)
     {
-      m_z_values[i++] = fun(x, y);
+      zvalues[i++] = fun(x, y);
     }
   }
+
+  m_z_values = std::make_shared<const std::vector<float>>(std::move(zvalues));
 }
 
 inline float HeightMap::altMin() const
@@ -137,7 +148,7 @@ inline float HeightMap::normalizedAltitudeAt(int row, int col) const
   }
   else
   {
-    return m_z_values.at(col * rows() + row);
+    return m_z_values->at(col * rows() + row);
   }
 }
 
@@ -22,6 +22,11 @@ void HeightMapScene::synchronize(Window* window)
   if (model)
   {
     m_mesh.synchronize(*model);
+
+    if (window->isSceneObjectDirty(model))
+    {
+      incrementSceneRevision();
+    }
   }
 }
 
@@ -37,6 +42,6 @@ void HeightMapScene::renderViewport(Window* window, const AppViewportRenderData&
 
   if (view.draw_camera_orienation_axes)
   {
-    m_frameaxes.drawCameraOrientationAxes(this, view.rect, windowData().window_size, view.view_matrix);
+    m_frameaxes.drawCameraOrientationAxes(this, view.rect, renderTargetSize(), view.view_matrix);
   }
 }
@@ -5,12 +5,14 @@
 #include "heightmapscene.h"
 
 #include "appcommon/appwindow.h"
+#include "appcommon/offscreen.h"
 
 #include "heightfieldmodel.h"
 #include "heightmapcontroller.h"
 #include "heightmapimage.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
 
 #include <QQmlEngine>
 
@@ -20,7 +22,14 @@ int main(int argc, char *argv[])
 
   auto* model = new HeightFieldModel();
 
-  AppWindow w{ OpenGLSceneFactory::factoryFor<HeightMapScene>() };
+  QCommandLineParser parser;
+  parser.addHelpOption();
+  add_offscreen_options(parser);
+  parser.process(app);
+
+  const OffscreenOptions offscreen = offscreen_options(parser);
+
+  AppWindow w{ OpenGLSceneFactory::factoryFor<HeightMapScene>(), offscreen.enabled ? Window::Offscreen : Window::OnScreen };
 
   model->setParent(&w);
 
@@ -30,10 +39,24 @@ int main(int argc, char *argv[])
   qmlRegisterType<HeightMapImage>("HeightMap", 1, 0, "HeightMapImage");
   qmlRegisterUncreatableType<HeightFieldModel>("HeightMap", 1, 0, "HeightFieldModel", "HeightFieldModel is exposed as a singleton");
 
+  w.setRenderOnDemand(true);
+  QObject::connect(model, &HeightFieldModel::heightmapRevisionChanged, &w, &Window::requestSceneUpdate);
+  QObject::connect(model, &HeightFieldModel::originChanged, &w, &Window::requestSceneUpdate);
+  QObject::connect(model, &HeightFieldModel::sizeChanged, &w, &Window::requestSceneUpdate);
+  QObject::connect(model, &HeightFieldModel::resolutionChanged, &w, &Window::requestSceneUpdate);
+  QObject::connect(model, &HeightFieldModel::colorChanged, &w, &Window::requestSceneUpdate);
+  QObject::connect(model, &HeightFieldModel::outsideColorChanged, &w, &Window::requestSceneUpdate);
+
   w.exposeQObjectToQml(model, "heightfield_model");
   w.exposeQObjectToQml(&controller, "heightmap_controller");
 
   w.setSource(QUrl("qrc:/qml/MainWindow.qml"));
+
+  if (offscreen.enabled)
+  {
+    return run_offscreen(w, offscreen);
+  }
+
   w.show();
 
   return app.exec();
@@ -19,6 +19,7 @@ Item {
         camera: Camera {
             controller: OrbitalCameraController {
                 target: Qt.vector3d(0, 0, 0.3)
+                coalesceInput: true
             }
         }
     }
@@ -5,15 +5,31 @@
 #include "tetrahedronscene.h"
 
 #include "appcommon/appwindow.h"
+#include "appcommon/offscreen.h"
 
+#include <QCommandLineParser>
 #include <QGuiApplication>
 
 int main(int argc, char *argv[])
 {
   QGuiApplication app{ argc, argv };
 
-  AppWindow w{ OpenGLSceneFactory::factoryFor<TetrahedronScene>() };
+  QCommandLineParser parser;
+  parser.addHelpOption();
+  add_offscreen_options(parser);
+  parser.process(app);
+
+  const OffscreenOptions offscreen = offscreen_options(parser);
+
+  AppWindow w{ OpenGLSceneFactory::factoryFor<TetrahedronScene>(), offscreen.enabled ? Window::Offscreen : Window::OnScreen };
+  w.setRenderOnDemand(true);
   w.setSource(QUrl("qrc:/qml/MainWindow.qml"));
+
+  if (offscreen.enabled)
+  {
+    return run_offscreen(w, offscreen);
+  }
+
   w.show();
 
   return app.exec();
@@ -25,6 +25,6 @@ void TetrahedronScene::renderViewport(Window* window, const AppViewportRenderDat
 
   if (view.draw_camera_orienation_axes)
   {
-    m_frameaxes.drawCameraOrientationAxes(this, view.rect, windowData().window_size, view.view_matrix);
+    m_frameaxes.drawCameraOrientationAxes(this, view.rect, renderTargetSize(), view.view_matrix);
   }
 }
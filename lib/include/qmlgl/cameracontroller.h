@@ -8,6 +8,7 @@
 #include <QObject>
 
 #include <QElapsedTimer>
+#include <QPointer>
 
 #include <QQuaternion>
 #include <QVector3D>
@@ -18,17 +19,32 @@
 #include <QWheelEvent>
 
 class Camera;
+class Window;
 
 /**
  * @brief base class for controlling a camera through user inputs
  *
  * This is a base class that does not respond to user inputs.
  * Actual event handling is implemented differently by various subclasses.
+ *
+ * Continuous movements (e.g. while a key is held down) are started with
+ * startMovement(); update() is then called once per frame of the Window
+ * in which the camera is displayed, with the time elapsed since the previous
+ * frame. If the camera is not displayed in a Window, a timer is used instead.
+ * The window is notified of every frame during which the camera moves
+ * (see Window::notifyInteraction()).
+ *
+ * If coalesceInput is true, subclasses accumulate the effect of the input events
+ * and apply it in processPendingInput(), which is called once per frame just
+ * before the scene is synchronized. This reduces the latency between the input
+ * and the frame in which it is visible, and results in a single camera update
+ * per frame.
  */
 class CameraController : public QObject
 {
   Q_OBJECT
   Q_PROPERTY(Camera* camera READ camera NOTIFY cameraChanged)
+  Q_PROPERTY(bool coalesceInput READ coalesceInput WRITE setCoalesceInput NOTIFY coalesceInputChanged)
 public:
   explicit CameraController(QObject* parent = nullptr);
 
@@ -37,6 +53,9 @@ public:
   Camera* camera() const;
   virtual void setCamera(Camera* cam);
 
+  bool coalesceInput() const;
+  void setCoalesceInput(bool on = true);
+
   virtual void mousePressEvent(QMouseEvent* e);
   virtual void mouseMoveEvent(QMouseEvent* e);
   virtual void mouseReleaseEvent(QMouseEvent* e);
@@ -50,17 +69,35 @@ public:
 
 Q_SIGNALS:
   void cameraChanged();
+  void coalesceInputChanged();
 
 protected:
   void startMovement();
   virtual void update(qint64 elapsed);
   void endMovement();
+  bool isMoving() const;
+
+  void scheduleInput();
+  virtual void processPendingInput();
+
   void timerEvent(QTimerEvent* ev) override;
 
+private:
+  friend class Window;
+  void advanceFrame();
+  Window* window() const;
+  void requestFrames();
+  void stopFrames();
+
 private:
   Camera* m_camera = nullptr;
+  bool m_coalesce_input = false;
+  bool m_moving = false;
+  bool m_input_pending = false;
+  QPointer<Window> m_window;
   int m_movement_timerid = -1;
   QElapsedTimer m_movement_elapsedtimer;
+  qint64 m_movement_time = 0;
 };
 
 inline Camera* CameraController::camera() const
@@ -68,4 +105,14 @@ inline Camera* CameraController::camera() const
   return m_camera;
 }
 
+inline bool CameraController::coalesceInput() const
+{
+  return m_coalesce_input;
+}
+
+inline bool CameraController::isMoving() const
+{
+  return m_moving;
+}
+
 #endif // CAMERACONTROLLER_H
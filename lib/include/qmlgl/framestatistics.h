@@ -0,0 +1,104 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef FRAMESTATISTICS_H
+#define FRAMESTATISTICS_H
+
+#include "dllexportimport.h"
+
+#include <QObject>
+
+/**
+ * @brief statistics about one stage of the frame, in milliseconds
+ *
+ * Percentiles are computed over a rolling window of recent frames.
+ */
+struct FrameStageStatistics
+{
+  Q_GADGET
+  Q_PROPERTY(double last MEMBER last)
+  Q_PROPERTY(double p50 MEMBER p50)
+  Q_PROPERTY(double p95 MEMBER p95)
+  Q_PROPERTY(double p99 MEMBER p99)
+public:
+  double last = 0;
+  double p50 = 0;
+  double p95 = 0;
+  double p99 = 0;
+};
+
+Q_DECLARE_METATYPE(FrameStageStatistics)
+
+/**
+ * @brief raw struct holding a snapshot of the frame statistics
+ */
+struct FrameStatisticsSnapshot
+{
+  FrameStageStatistics sync;
+  FrameStageStatistics render;
+  FrameStageStatistics gpu;
+  FrameStageStatistics swap;
+  FrameStageStatistics frame;
+  bool gpu_timing_available = false;
+  qint64 frame_count = 0;
+};
+
+/**
+ * @brief exposes the frame timings of a Window to QML
+ *
+ * Timings are measured in the render thread for each of the following stages:
+ * - sync: time during which the main thread is blocked (OpenGLScene::synchronize() and QML sync)
+ * - render: cpu time spent in OpenGLScene::render()
+ * - gpu: gpu time spent executing the commands issued by OpenGLScene::render()
+ * - swap: time between the end of the rendering of the QML scene and the buffer swap
+ * - frame: interval between two consecutive presented frames
+ *
+ * The statistics are published to this object (which lives in the main thread)
+ * at most once every updateInterval() milliseconds, so that QML bindings
+ * are not re-evaluated on every frame.
+ *
+ * @sa Window::frameStatistics().
+ */
+class QMLGL_API FrameStatistics : public QObject
+{
+  Q_OBJECT
+  Q_PROPERTY(FrameStageStatistics sync READ sync NOTIFY updated)
+  Q_PROPERTY(FrameStageStatistics render READ render NOTIFY updated)
+  Q_PROPERTY(FrameStageStatistics gpu READ gpu NOTIFY updated)
+  Q_PROPERTY(FrameStageStatistics swap READ swap NOTIFY updated)
+  Q_PROPERTY(FrameStageStatistics frame READ frame NOTIFY updated)
+  Q_PROPERTY(double fps READ fps NOTIFY updated)
+  Q_PROPERTY(bool gpuTimingAvailable READ gpuTimingAvailable NOTIFY updated)
+  Q_PROPERTY(qint64 frameCount READ frameCount NOTIFY updated)
+  Q_PROPERTY(int updateInterval READ updateInterval WRITE setUpdateInterval NOTIFY updateIntervalChanged)
+public:
+  explicit FrameStatistics(QObject* parent = nullptr);
+  ~FrameStatistics();
+
+  const FrameStageStatistics& sync() const;
+  const FrameStageStatistics& render() const;
+  const FrameStageStatistics& gpu() const;
+  const FrameStageStatistics& swap() const;
+  const FrameStageStatistics& frame() const;
+
+  double fps() const;
+  bool gpuTimingAvailable() const;
+  qint64 frameCount() const;
+
+  int updateInterval() const;
+  void setUpdateInterval(int ms);
+
+  const FrameStatisticsSnapshot& snapshot() const;
+  void setSnapshot(const FrameStatisticsSnapshot& snapshot);
+
+Q_SIGNALS:
+  void updated();
+  void updateIntervalChanged();
+
+private:
+  FrameStatisticsSnapshot m_snapshot;
+  int m_update_interval = 250;
+};
+
+#endif // FRAMESTATISTICS_H
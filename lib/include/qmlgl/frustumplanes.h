@@ -0,0 +1,178 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef FRUSTUMPLANES_H
+#define FRUSTUMPLANES_H
+
+#include "dllexportimport.h"
+
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QVector4D>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+struct ViewportRenderData;
+
+/**
+ * @brief an array of axis-aligned bounding boxes stored as a structure of arrays
+ *
+ * Boxes are stored by their center and half-extents, which is the
+ * representation used by the culling kernels.
+ */
+struct QMLGL_API BoundingBoxArray
+{
+  std::vector<float> center_x;
+  std::vector<float> center_y;
+  std::vector<float> center_z;
+  std::vector<float> extent_x;
+  std::vector<float> extent_y;
+  std::vector<float> extent_z;
+
+  size_t size() const;
+  void clear();
+  void reserve(size_t n);
+  void append(const QVector3D& min, const QVector3D& max);
+};
+
+/**
+ * @brief an array of bounding spheres stored as a structure of arrays
+ */
+struct QMLGL_API BoundingSphereArray
+{
+  std::vector<float> center_x;
+  std::vector<float> center_y;
+  std::vector<float> center_z;
+  std::vector<float> radius;
+
+  size_t size() const;
+  void clear();
+  void reserve(size_t n);
+  void append(const QVector3D& center, float r);
+};
+
+/**
+ * @brief a bitmask storing the result of a visibility test
+ *
+ * Bit i is set if the i-th element is (potentially) visible.
+ */
+class QMLGL_API VisibilityMask
+{
+public:
+  VisibilityMask() = default;
+
+  size_t size() const;
+  void reset(size_t n);
+
+  bool test(size_t i) const;
+  void set(size_t i, bool on = true);
+
+  size_t count() const;
+  bool all() const;
+  bool none() const;
+
+  uint32_t* data();
+  const uint32_t* data() const;
+
+private:
+  size_t m_size = 0;
+  std::vector<uint32_t> m_words;
+};
+
+/**
+ * @brief the six planes of a view frustum
+ *
+ * The planes are extracted from a view-projection matrix (Gribb-Hartmann method)
+ * and can be used to test whether objects, given in the space in which
+ * the matrix is applied (usually world coordinates), are inside the frustum.
+ *
+ * Each plane is stored as (a, b, c, d) with a normalized normal (a, b, c)
+ * pointing towards the inside of the frustum.
+ *
+ * The tests are conservative: an object that intersects the frustum is always
+ * reported as visible, but an object lying just outside one of its corners may
+ * also be reported as visible.
+ */
+class QMLGL_API FrustumPlanes
+{
+public:
+  FrustumPlanes();
+  explicit FrustumPlanes(const QMatrix4x4& viewProjectionMatrix);
+
+  static FrustumPlanes fromRenderData(const ViewportRenderData& viewport);
+
+  enum Plane
+  {
+    Left,
+    Right,
+    Bottom,
+    Top,
+    Near,
+    Far,
+  };
+
+  const QVector4D& plane(Plane p) const;
+  const std::array<QVector4D, 6>& planes() const;
+
+  bool intersectsBox(const QVector3D& min, const QVector3D& max) const;
+  bool intersectsSphere(const QVector3D& center, float radius) const;
+
+  void cullBoxes(const BoundingBoxArray& boxes, VisibilityMask& visibility) const;
+  void cullSpheres(const BoundingSphereArray& spheres, VisibilityMask& visibility) const;
+
+private:
+  std::array<QVector4D, 6> m_planes;
+};
+
+inline size_t BoundingBoxArray::size() const
+{
+  return center_x.size();
+}
+
+inline size_t BoundingSphereArray::size() const
+{
+  return center_x.size();
+}
+
+inline size_t VisibilityMask::size() const
+{
+  return m_size;
+}
+
+inline bool VisibilityMask::test(size_t i) const
+{
+  return (m_words[i / 32] >> (i % 32)) & 1;
+}
+
+inline void VisibilityMask::set(size_t i, bool on)
+{
+  if (on)
+    m_words[i / 32] |= (uint32_t(1) << (i % 32));
+  else
+    m_words[i / 32] &= ~(uint32_t(1) << (i % 32));
+}
+
+inline uint32_t* VisibilityMask::data()
+{
+  return m_words.data();
+}
+
+inline const uint32_t* VisibilityMask::data() const
+{
+  return m_words.data();
+}
+
+inline const QVector4D& FrustumPlanes::plane(Plane p) const
+{
+  return m_planes[p];
+}
+
+inline const std::array<QVector4D, 6>& FrustumPlanes::planes() const
+{
+  return m_planes;
+}
+
+#endif // FRUSTUMPLANES_H
@@ -0,0 +1,146 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef GPURESOURCEMANAGER_H
+#define GPURESOURCEMANAGER_H
+
+#include "dllexportimport.h"
+
+#include <QString>
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <type_traits>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief a cache of OpenGL resources shared between the users of a Window
+ *
+ * Resources (buffers, textures, programs...) are identified by a 64-bit key,
+ * typically a hash of the data they were created from (see hash()), so that
+ * identical resources are only created once.
+ *
+ * Resources are reference-counted with std::shared_ptr: the manager holds
+ * one reference and users hold the others.
+ * The memory used by each resource is declared when it is inserted.
+ * When the total exceeds the budget, collect() destroys the least recently
+ * used resources that are no longer referenced by any user.
+ * Unreferenced resources are otherwise kept, which makes it possible to reuse
+ * them if the same data are loaded again.
+ *
+ * All functions of this class must be called from the render thread.
+ */
+class QMLGL_API GpuResourceManager
+{
+public:
+  using Key = uint64_t;
+
+  static constexpr Key HashSeed = 14695981039346656037ull;
+
+  GpuResourceManager();
+  GpuResourceManager(const GpuResourceManager&) = delete;
+  ~GpuResourceManager();
+
+  static Key hash(const void* data, size_t size, Key seed = HashSeed);
+  static Key hash(const QString& str, Key seed = HashSeed);
+  template<typename T>
+  static Key hash(const std::vector<T>& data, Key seed = HashSeed);
+
+  template<typename T>
+  std::shared_ptr<T> find(Key key);
+
+  template<typename T>
+  void insert(Key key, const std::shared_ptr<T>& resource, size_t bytes);
+
+  size_t budget() const;
+  void setBudget(size_t bytes);
+
+  size_t memoryUsage() const;
+  size_t size() const;
+
+  size_t collect();
+  void clear();
+
+  GpuResourceManager& operator=(const GpuResourceManager&) = delete;
+
+protected:
+  std::shared_ptr<void> findResource(Key key, std::type_index type);
+  void insertResource(Key key, std::type_index type, std::shared_ptr<void> resource, size_t bytes);
+
+private:
+  struct Entry
+  {
+    std::type_index type;
+    std::shared_ptr<void> resource;
+    size_t bytes;
+    std::list<Key>::iterator lru_position;
+  };
+
+  std::unordered_map<Key, Entry> m_entries;
+  std::list<Key> m_lru; // most recently used first
+  size_t m_budget = size_t(512) * 1024 * 1024;
+  size_t m_memory_usage = 0;
+};
+
+/**
+ * @brief computes the hash of the content of a vector
+ *
+ * The type of the elements must be trivially copyable.
+ * The size of the vector is part of the hash.
+ */
+template<typename T>
+inline GpuResourceManager::Key GpuResourceManager::hash(const std::vector<T>& data, Key seed)
+{
+  static_assert(std::is_trivially_copyable<T>::value, "elements must be trivially copyable");
+  const uint64_t n = data.size();
+  return hash(data.data(), data.size() * sizeof(T), hash(&n, sizeof(n), seed));
+}
+
+/**
+ * @brief returns the resource associated with a key
+ * @param key  the key
+ *
+ * Returns null if there is no such resource, or if the resource
+ * associated with the key is not of type T.
+ * The resource is marked as used.
+ */
+template<typename T>
+inline std::shared_ptr<T> GpuResourceManager::find(Key key)
+{
+  return std::static_pointer_cast<T>(findResource(key, std::type_index(typeid(T))));
+}
+
+/**
+ * @brief inserts a resource into the manager
+ * @param key       the key of the resource
+ * @param resource  the resource
+ * @param bytes     an estimate of the GPU memory used by the resource
+ *
+ * If a resource is already associated with the key, it is replaced.
+ */
+template<typename T>
+inline void GpuResourceManager::insert(Key key, const std::shared_ptr<T>& resource, size_t bytes)
+{
+  insertResource(key, std::type_index(typeid(T)), resource, bytes);
+}
+
+inline size_t GpuResourceManager::budget() const
+{
+  return m_budget;
+}
+
+inline size_t GpuResourceManager::memoryUsage() const
+{
+  return m_memory_usage;
+}
+
+inline size_t GpuResourceManager::size() const
+{
+  return m_entries.size();
+}
+
+#endif // GPURESOURCEMANAGER_H
@@ -0,0 +1,75 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef RENDERTASKQUEUE_H
+#define RENDERTASKQUEUE_H
+
+#include "dllexportimport.h"
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief a queue of tasks to be executed in the render thread
+ *
+ * Tasks can be enqueued from any thread; they are executed by the Window
+ * in the render thread, with the OpenGL context current, before the scene
+ * is rendered.
+ * Only a limited amount of time is spent executing tasks for each frame
+ * (see Window::renderTaskBudget()), remaining tasks are executed
+ * during the next frames.
+ * This is typically used for creating OpenGL resources and uploading data
+ * progressively, without causing frame drops.
+ *
+ * Tasks with a higher priority are executed first; tasks with the same
+ * priority are executed in the order they were enqueued.
+ */
+class QMLGL_API RenderTaskQueue
+{
+public:
+  using Task = std::function<void()>;
+
+  enum Priority
+  {
+    LowPriority = -1,
+    NormalPriority = 0,
+    HighPriority = 1,
+  };
+
+  RenderTaskQueue() = default;
+  RenderTaskQueue(const RenderTaskQueue&) = delete;
+  ~RenderTaskQueue();
+
+  void enqueue(Task task, int priority = NormalPriority);
+
+  bool empty() const;
+  size_t size() const;
+
+  size_t execute(double budget);
+  void clear();
+
+  void setTaskEnqueuedCallback(std::function<void()> callback);
+
+  RenderTaskQueue& operator=(const RenderTaskQueue&) = delete;
+
+private:
+  struct Entry
+  {
+    int priority;
+    uint64_t sequence;
+    Task task;
+  };
+
+  static bool compare(const Entry& lhs, const Entry& rhs);
+
+private:
+  mutable std::mutex m_mutex;
+  std::vector<Entry> m_tasks;
+  uint64_t m_next_sequence = 0;
+  std::function<void()> m_task_enqueued_callback;
+};
+
+#endif // RENDERTASKQUEUE_H
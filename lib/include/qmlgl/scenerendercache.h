@@ -0,0 +1,59 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef SCENERENDERCACHE_H
+#define SCENERENDERCACHE_H
+
+#include "dllexportimport.h"
+
+#include <QRect>
+#include <QSize>
+
+#include <memory>
+
+class QOpenGLContext;
+class QOpenGLFramebufferObject;
+class QOpenGLTextureBlitter;
+
+/**
+ * @brief holds the last rendered image of an OpenGLScene
+ *
+ * The scene is rendered into a (possibly multisampled) framebuffer object
+ * which is then resolved into a texture.
+ * This texture can be drawn in the window as many times as needed without
+ * rendering the scene again.
+ *
+ * This class is used by Window when render-on-demand is enabled, but can
+ * also be used by scenes to cache the rendering of a single viewport.
+ *
+ * All functions of this class must be called from the render thread
+ * with the OpenGL context current.
+ */
+class QMLGL_API SceneRenderCache
+{
+public:
+  SceneRenderCache();
+  ~SceneRenderCache();
+
+  QSize size() const;
+  bool hasContent(const QSize& size) const;
+  void invalidate();
+
+  void bind(const QSize& size, int samples);
+  void resolve();
+
+  void draw(QOpenGLContext* context);
+  void draw(QOpenGLContext* context, const QRect& viewport);
+
+  void releaseResources();
+
+private:
+  std::unique_ptr<QOpenGLFramebufferObject> m_render_fbo;
+  std::unique_ptr<QOpenGLFramebufferObject> m_resolve_fbo;
+  std::unique_ptr<QOpenGLTextureBlitter> m_blitter;
+  int m_samples = 0;
+  bool m_has_content = false;
+};
+
+#endif // SCENERENDERCACHE_H
@@ -0,0 +1,115 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <array>
+#include <atomic>
+
+/**
+ * @brief a lock-free triple buffer for exchanging snapshots between two threads
+ * @tparam T  the type of the snapshots
+ *
+ * The producer fills writeBuffer() and calls publish(); the consumer calls
+ * update() and then reads readBuffer().
+ * Neither side ever waits for the other: publishing and picking up a snapshot
+ * only swap buffer indices, the snapshots themselves are never copied.
+ *
+ * The producer always gets a buffer that is not being read; its content is
+ * the one of an older snapshot so that its allocations can be reused.
+ * If the producer publishes several snapshots before the consumer calls update(),
+ * only the most recent one is seen by the consumer.
+ *
+ * There must be at most one producer and one consumer at any given time.
+ */
+template<typename T>
+class TripleBuffer
+{
+public:
+  TripleBuffer() = default;
+  TripleBuffer(const TripleBuffer&) = delete;
+
+  T& writeBuffer();
+  void publish();
+
+  bool update();
+  const T& readBuffer() const;
+
+  bool hasNewSnapshot() const;
+
+  TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+private:
+  // the middle buffer index is stored in the low bits,
+  // the flag indicates that it holds a snapshot not yet seen by the consumer
+  static constexpr int IndexMask = 0x3;
+  static constexpr int FreshFlag = 0x4;
+
+  std::array<T, 3> m_buffers;
+  int m_write_index = 0;
+  std::atomic<int> m_middle{ 1 };
+  int m_read_index = 2;
+};
+
+/**
+ * @brief returns the buffer in which the producer writes the next snapshot
+ */
+template<typename T>
+inline T& TripleBuffer<T>::writeBuffer()
+{
+  return m_buffers[m_write_index];
+}
+
+/**
+ * @brief makes the content of writeBuffer() available to the consumer
+ *
+ * After this call, writeBuffer() refers to another buffer.
+ */
+template<typename T>
+inline void TripleBuffer<T>::publish()
+{
+  const int previous = m_middle.exchange(m_write_index | FreshFlag, std::memory_order_acq_rel);
+  m_write_index = previous & IndexMask;
+}
+
+/**
+ * @brief picks up the most recently published snapshot
+ * @return whether a new snapshot was available
+ *
+ * If no snapshot was published since the last call, readBuffer()
+ * keeps referring to the same snapshot.
+ */
+template<typename T>
+inline bool TripleBuffer<T>::update()
+{
+  if (!hasNewSnapshot())
+  {
+    return false;
+  }
+
+  const int previous = m_middle.exchange(m_read_index, std::memory_order_acq_rel);
+  m_read_index = previous & IndexMask;
+  return true;
+}
+
+/**
+ * @brief returns the snapshot picked up by the last call to update()
+ */
+template<typename T>
+inline const T& TripleBuffer<T>::readBuffer() const
+{
+  return m_buffers[m_read_index];
+}
+
+/**
+ * @brief returns whether a snapshot was published and not yet picked up
+ */
+template<typename T>
+inline bool TripleBuffer<T>::hasNewSnapshot() const
+{
+  return m_middle.load(std::memory_order_acquire) & FreshFlag;
+}
+
+#endif // TRIPLEBUFFER_H
@@ -7,20 +7,38 @@
 
 #include "dllexportimport.h"
 
+#include "framestatistics.h"
 #include "scene.h"
 
 #include <QQuickWindow>
 
 #include <QColor>
+#include <QImage>
 #include <QList>
+#include <QPointer>
 #include <QQmlError>
+#include <QRect>
+#include <QTimer>
 #include <QUrl>
 
+#include <memory>
+#include <vector>
+
+class QOffscreenSurface;
+class QOpenGLContext;
+class QOpenGLFramebufferObject;
 class QOpenGLFunctions;
 class QQmlComponent;
 class QQmlContext;
 class QQuickItem;
+class QQuickRenderControl;
 
+class CameraController;
+class DynamicResolution;
+class FrameProfiler;
+class GpuResourceManager;
+class RenderTaskQueue;
+class SceneRenderCache;
 class Viewport;
 
 /**
@@ -29,6 +47,13 @@ class Viewport;
  * This class is abstract.
  * User should derive from this class and reimplement the createOpenGLScene() function
  * which is called when the OpenGLScene must be created.
+ *
+ * A window can also be created in Offscreen mode, in which case no native window
+ * is created: the QML and OpenGL scenes are rendered into a framebuffer object
+ * using a QQuickRenderControl and frames are produced explicitly
+ * with renderOffscreenFrames().
+ * This is useful for running the scene headless (e.g. for benchmarks or
+ * image-regression tests).
  */
 class QMLGL_API Window : public QQuickWindow
 {
@@ -36,10 +61,30 @@ class QMLGL_API Window : public QQuickWindow
   Q_PROPERTY(QUrl source READ source WRITE setSource NOTIFY sourceChanged)
   Q_PROPERTY(Status status READ status NOTIFY statusChanged)
   Q_PROPERTY(QColor clearColor READ clearColor WRITE setClearColor NOTIFY clearColorChanged)
+  Q_PROPERTY(FrameStatistics* frameStatistics READ frameStatistics CONSTANT)
+  Q_PROPERTY(bool renderOnDemand READ renderOnDemand WRITE setRenderOnDemand NOTIFY renderOnDemandChanged)
+  Q_PROPERTY(bool dynamicResolution READ dynamicResolution WRITE setDynamicResolution NOTIFY dynamicResolutionChanged)
+  Q_PROPERTY(double targetFrameTime READ targetFrameTime WRITE setTargetFrameTime NOTIFY targetFrameTimeChanged)
+  Q_PROPERTY(double minimumResolutionScale READ minimumResolutionScale WRITE setMinimumResolutionScale NOTIFY minimumResolutionScaleChanged)
+  Q_PROPERTY(int resolutionRestoreDelay READ resolutionRestoreDelay WRITE setResolutionRestoreDelay NOTIFY resolutionRestoreDelayChanged)
+  Q_PROPERTY(double renderTaskBudget READ renderTaskBudget WRITE setRenderTaskBudget NOTIFY renderTaskBudgetChanged)
+  Q_PROPERTY(qint64 gpuMemoryBudget READ gpuMemoryBudget WRITE setGpuMemoryBudget NOTIFY gpuMemoryBudgetChanged)
 public:
-  Window();
+  /**
+   * @brief specifies where the window is rendered
+   */
+  enum RenderMode
+  {
+    OnScreen,  ///< the window is rendered on screen by the Qt Quick render loop
+    Offscreen, ///< the window is rendered into a framebuffer object with a QQuickRenderControl
+  };
+  Q_ENUM(RenderMode)
+
+  explicit Window(RenderMode mode = OnScreen);
   ~Window();
 
+  RenderMode renderMode() const;
+
   enum Status
   {
     Null,
@@ -66,20 +111,81 @@ public:
 
   OpenGLScene* glScene() const;
 
+  FrameStatistics* frameStatistics() const;
+
+  bool renderOnDemand() const;
+  void setRenderOnDemand(bool on = true);
+
+  void markViewportDirty(Viewport* v);
+  void markSceneObjectDirty(QObject* obj);
+
+  bool isSceneDirty() const;
+  bool isViewportDirty(const Viewport* v) const;
+  bool isSceneObjectDirty(const QObject* obj) const;
+
+  bool dynamicResolution() const;
+  void setDynamicResolution(bool on = true);
+
+  double targetFrameTime() const;
+  void setTargetFrameTime(double ms);
+
+  double minimumResolutionScale() const;
+  void setMinimumResolutionScale(double scale);
+
+  int resolutionRestoreDelay() const;
+  void setResolutionRestoreDelay(int ms);
+
+  void notifyInteraction();
+
+  double resolutionScale() const;
+  QSize sceneFramebufferSize() const;
+
+  RenderTaskQueue* renderTaskQueue() const;
+  bool hasPendingRenderTasks() const;
+
+  double renderTaskBudget() const;
+  void setRenderTaskBudget(double ms);
+
+  GpuResourceManager* gpuResourceManager() const;
+
+  qint64 gpuMemoryBudget() const;
+  void setGpuMemoryBudget(qint64 bytes);
+
+  void addAnimatedController(CameraController* controller);
+  void removeAnimatedController(CameraController* controller);
+
+  bool renderOffscreenFrames(int count = 1);
+  QImage grabOffscreenFrame();
+
+public Q_SLOTS:
+  void requestSceneUpdate();
+
 signals:
   void statusChanged();
   void sourceChanged();
   void clearColorChanged();
+  void renderOnDemandChanged();
+  void dynamicResolutionChanged();
+  void targetFrameTimeChanged();
+  void minimumResolutionScaleChanged();
+  void resolutionRestoreDelayChanged();
+  void renderTaskBudgetChanged();
+  void gpuMemoryBudgetChanged();
   void glSceneDestroyed();
 
 protected Q_SLOTS:
+  void onAfterAnimating();
   void onSceneGraphInitialized();
   void onSceneGraphInvalidated();
   void onBeforeSynchronizing();
+  void onAfterSynchronizing();
   void onBeforeRendering();
+  void onAfterRendering();
+  void onFrameSwapped();
 
 protected:
   virtual std::unique_ptr<OpenGLScene> createOpenGLScene() = 0;
+  virtual void publishRenderData();
 
 protected:
   void resizeEvent(QResizeEvent* ev) override;
@@ -92,9 +198,18 @@ protected:
   void addViewport(Viewport* v);
   void removeViewport(Viewport* v);
 
+  void scheduleSceneUpdate();
+
 private:
   void onQmlComponentLoadingComplete();
   void resizeRootObjectToView();
+  bool checkViewportsLayout();
+  void advanceAnimatedControllers();
+  void onInteractionEnded();
+  void renderScene();
+  void executeRenderTasks();
+  Window(QQuickRenderControl* renderControl, RenderMode mode);
+  bool initializeOffscreenRendering();
 
 private:
   Status m_status = Status::Null;
@@ -106,6 +221,45 @@ private:
   QQmlEngine* m_qml_engine = nullptr;
   std::vector<Viewport*> m_viewports;
   std::unique_ptr<OpenGLScene> m_gl_scene;
+  FrameStatistics* m_frame_statistics = nullptr;
+  std::unique_ptr<FrameProfiler> m_frame_profiler;
+  bool m_render_on_demand = false;
+  bool m_scene_update_scheduled = false;
+  bool m_scene_dirty = true;
+  std::vector<Viewport*> m_dirty_viewports;
+  std::vector<QObject*> m_dirty_scene_objects;
+
+  struct ViewportLayout
+  {
+    const Viewport* viewport;
+    QRect rect;
+    qreal z;
+    bool visible;
+  };
+
+  std::vector<ViewportLayout> m_viewports_layout;
+  bool m_render_scene = true;
+  std::unique_ptr<SceneRenderCache> m_scene_cache;
+  RenderMode m_render_mode = OnScreen;
+  std::unique_ptr<QQuickRenderControl> m_render_control;
+  std::unique_ptr<QOpenGLContext> m_offscreen_context;
+  std::unique_ptr<QOffscreenSurface> m_offscreen_surface;
+  std::unique_ptr<QOpenGLFramebufferObject> m_offscreen_fbo;
+  std::vector<QPointer<CameraController>> m_animated_controllers;
+  bool m_dynamic_resolution = false;
+  double m_target_frame_time = 1000. / 60.;
+  double m_minimum_resolution_scale = 0.5;
+  bool m_interacting = false;
+  QTimer m_resolution_restore_timer;
+  std::unique_ptr<DynamicResolution> m_resolution_controller;
+  bool m_frame_interacting = false;
+  double m_frame_resolution_scale = 1.;
+  std::unique_ptr<RenderTaskQueue> m_render_task_queue;
+  double m_render_task_budget = 4.;
+  double m_frame_render_task_budget = 4.;
+  std::unique_ptr<GpuResourceManager> m_gpu_resources;
+  qint64 m_gpu_memory_budget = qint64(512) * 1024 * 1024;
+  QSize m_scene_framebuffer_size;
 };
 
 #endif // WINDOW_H
@@ -5,6 +5,8 @@
 #include "cameracontroller.h"
 
 #include "qmlgl/camera.h"
+#include "qmlgl/viewport.h"
+#include "qmlgl/window.h"
 
 #include <QTimerEvent>
 
@@ -23,11 +25,41 @@ void CameraController::setCamera(Camera* cam)
 {
   if (m_camera != cam)
   {
+    // the camera may be displayed in another window
+    stopFrames();
+
     m_camera = cam;
+
+    if (m_camera && (m_moving || m_input_pending))
+    {
+      requestFrames();
+    }
+
     Q_EMIT cameraChanged();
   }
 }
 
+/**
+ * @brief sets whether input events are applied once per frame
+ *
+ * @sa processPendingInput().
+ */
+void CameraController::setCoalesceInput(bool on)
+{
+  if (m_coalesce_input != on)
+  {
+    m_coalesce_input = on;
+
+    if (!m_coalesce_input && m_input_pending)
+    {
+      m_input_pending = false;
+      processPendingInput();
+    }
+
+    Q_EMIT coalesceInputChanged();
+  }
+}
+
 void CameraController::mousePressEvent(QMouseEvent* e)
 {
 
@@ -63,15 +95,26 @@ void CameraController::wheelEvent(QWheelEvent* e)
 
 }
 
+/**
+ * @brief starts a continuous movement of the camera
+ *
+ * update() is called once per frame until endMovement() is called.
+ */
 void CameraController::startMovement()
 {
-  if (m_movement_timerid == -1)
+  if (!m_moving)
   {
-    m_movement_timerid = startTimer(16);
+    m_moving = true;
     m_movement_elapsedtimer.restart();
+    m_movement_time = 0;
+    requestFrames();
   }
 }
 
+/**
+ * @brief advances the movement of the camera
+ * @param elapsed  time elapsed since the previous call, in milliseconds
+ */
 void CameraController::update(qint64 /* elapsed */)
 {
 
@@ -79,22 +122,135 @@ void CameraController::update(qint64 /* elapsed */)
 
 void CameraController::endMovement()
 {
-  if (m_movement_timerid != -1)
+  m_moving = false;
+
+  if (!m_input_pending)
   {
-    killTimer(m_movement_timerid);
-    m_movement_timerid = -1;
+    stopFrames();
   }
 }
 
+/**
+ * @brief requests the pending input to be applied
+ *
+ * If coalesceInput is false, or if the camera is not displayed in a Window,
+ * processPendingInput() is called immediately; otherwise it is called
+ * on the next frame.
+ */
+void CameraController::scheduleInput()
+{
+  Window* w = window();
+
+  if (!coalesceInput() || !w)
+  {
+    if (w)
+    {
+      w->notifyInteraction();
+    }
+
+    processPendingInput();
+    return;
+  }
+
+  if (!m_input_pending)
+  {
+    m_input_pending = true;
+    requestFrames();
+  }
+}
+
+/**
+ * @brief applies the effect of the input events received since the last call
+ *
+ * Subclasses that accumulate input events should reimplement this function.
+ * The default implementation does nothing.
+ *
+ * @sa scheduleInput().
+ */
+void CameraController::processPendingInput()
+{
+
+}
+
 void CameraController::timerEvent(QTimerEvent* ev)
 {
   if (ev->timerId() == m_movement_timerid)
   {
-    update(m_movement_elapsedtimer.elapsed());
+    advanceFrame();
+  }
+}
 
-    if (m_movement_timerid != -1)
-    {
-      m_movement_elapsedtimer.restart();
-    }
+void CameraController::advanceFrame()
+{
+  if (!camera())
+  {
+    m_moving = false;
+    m_input_pending = false;
+    stopFrames();
+    return;
+  }
+
+  if (m_window && (m_moving || m_input_pending))
+  {
+    m_window->notifyInteraction();
+  }
+
+  if (m_input_pending)
+  {
+    m_input_pending = false;
+    processPendingInput();
+  }
+
+  if (m_moving)
+  {
+    // the elapsed time is measured from the start of the movement so that
+    // the rounding to milliseconds does not accumulate over the frames
+    const qint64 now = m_movement_elapsedtimer.elapsed();
+    const qint64 elapsed = now - m_movement_time;
+    m_movement_time = now;
+    update(elapsed);
+  }
+
+  if (!m_moving && !m_input_pending)
+  {
+    stopFrames();
+  }
+}
+
+Window* CameraController::window() const
+{
+  if (!camera() || !camera()->viewport())
+  {
+    return nullptr;
+  }
+
+  return qobject_cast<Window*>(camera()->viewport()->window());
+}
+
+void CameraController::requestFrames()
+{
+  if (Window* w = window())
+  {
+    m_window = w;
+    m_window->addAnimatedController(this);
+  }
+  else if (m_movement_timerid == -1)
+  {
+    m_movement_timerid = startTimer(16);
+  }
+}
+
+void CameraController::stopFrames()
+{
+  if (m_window)
+  {
+    m_window->removeAnimatedController(this);
+    m_window = nullptr;
+  }
+
+  if (m_movement_timerid != -1)
+  {
+    killTimer(m_movement_timerid);
+    m_movement_timerid = -1;
   }
 }
@@ -0,0 +1,47 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "dynamicresolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+static constexpr double ScaleStep = 1. / 16.;
+
+void DynamicResolution::setTargetFrameTime(double ms)
+{
+  m_target_frame_time = std::max(ms, 1.);
+}
+
+void DynamicResolution::setMinimumScale(double scale)
+{
+  m_minimum_scale = std::clamp(scale, ScaleStep, 1.);
+  m_scale = std::max(m_scale, m_minimum_scale);
+}
+
+/**
+ * @brief adjusts the scale given the time taken to render a frame
+ * @param frameTime  the time it took to render the last frame, in milliseconds
+ *
+ * Only a fraction of the correction is applied for each frame, which
+ * smooths out the variations of the frame time.
+ */
+void DynamicResolution::adapt(double frameTime)
+{
+  if (frameTime <= 0.)
+  {
+    return;
+  }
+
+  const double ideal = m_scale * std::sqrt(m_target_frame_time / frameTime);
+  const double next = m_scale + 0.5 * (ideal - m_scale);
+
+  // hysteresis: the scale only changes if the difference is at least one step
+  if (std::abs(next - m_scale) >= ScaleStep)
+  {
+    m_scale = std::round(next / ScaleStep) * ScaleStep;
+  }
+
+  m_scale = std::clamp(m_scale, m_minimum_scale, 1.);
+}
@@ -0,0 +1,56 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef DYNAMICRESOLUTION_H
+#define DYNAMICRESOLUTION_H
+
+/**
+ * @brief computes the resolution at which the scene is rendered during interactions
+ *
+ * The cost of rendering the scene is assumed to be proportional to the number
+ * of pixels, i.e. to the square of the scale.
+ * After each frame, the scale is adjusted so that the measured frame time
+ * gets closer to the target frame time.
+ *
+ * The scale is changed by steps so that the framebuffer is not reallocated
+ * for every frame.
+ *
+ * All functions of this class must be called from the render thread.
+ */
+class DynamicResolution
+{
+public:
+  DynamicResolution() = default;
+
+  double targetFrameTime() const;
+  void setTargetFrameTime(double ms);
+
+  double minimumScale() const;
+  void setMinimumScale(double scale);
+
+  double scale() const;
+  void adapt(double frameTime);
+
+private:
+  double m_target_frame_time = 1000. / 60.;
+  double m_minimum_scale = 0.5;
+  double m_scale = 1.;
+};
+
+inline double DynamicResolution::targetFrameTime() const
+{
+  return m_target_frame_time;
+}
+
+inline double DynamicResolution::minimumScale() const
+{
+  return m_minimum_scale;
+}
+
+inline double DynamicResolution::scale() const
+{
+  return m_scale;
+}
+
+#endif // DYNAMICRESOLUTION_H
@@ -0,0 +1,276 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "frameprofiler.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLTimerQuery>
+
+#include <algorithm>
+
+RollingSamples::RollingSamples(size_t capacity) :
+  m_samples(capacity, 0.)
+{
+
+}
+
+void RollingSamples::push(double value)
+{
+  m_samples[m_next] = value;
+  m_next = (m_next + 1) % m_samples.size();
+  m_count = std::min(m_count + 1, m_samples.size());
+}
+
+bool RollingSamples::empty() const
+{
+  return m_count == 0;
+}
+
+double RollingSamples::last() const
+{
+  return empty() ? 0. : m_samples[(m_next + m_samples.size() - 1) % m_samples.size()];
+}
+
+FrameStageStatistics RollingSamples::statistics() const
+{
+  FrameStageStatistics result;
+
+  if (empty())
+  {
+    return result;
+  }
+
+  result.last = last();
+
+  m_scratch.assign(m_samples.begin(), m_samples.begin() + m_count);
+
+  auto percentile = [this](double p) -> double {
+    auto nth = m_scratch.begin() + static_cast<ptrdiff_t>(p * (m_scratch.size() - 1));
+    std::nth_element(m_scratch.begin(), nth, m_scratch.end());
+    return *nth;
+  };
+
+  result.p99 = percentile(0.99);
+  result.p95 = percentile(0.95);
+  result.p50 = percentile(0.50);
+
+  return result;
+}
+
+FrameProfiler::FrameProfiler(FrameStatistics* statistics) :
+  m_statistics(statistics)
+{
+  m_clock.start();
+}
+
+FrameProfiler::~FrameProfiler()
+{
+
+}
+
+void FrameProfiler::setUpdateInterval(int ms)
+{
+  m_update_interval = ms;
+}
+
+void FrameProfiler::beginSync()
+{
+  m_sync_start = m_clock.nsecsElapsed();
+}
+
+void FrameProfiler::endSync()
+{
+  m_sync_time = (m_clock.nsecsElapsed() - m_sync_start) * 1e-6;
+}
+
+void FrameProfiler::beginRender()
+{
+  if (!m_gpu_queries_initialized)
+  {
+    m_gpu_queries_initialized = true;
+
+    QOpenGLContext* ctx = QOpenGLContext::currentContext();
+
+    if (ctx && !ctx->isOpenGLES())
+    {
+      m_gpu_timing_available = true;
+
+      for (GpuQuery& q : m_gpu_queries)
+      {
+        q.query = std::make_unique<QOpenGLTimerQuery>();
+
+        if (!q.query->create())
+        {
+          m_gpu_timing_available = false;
+          break;
+        }
+      }
+
+      if (!m_gpu_timing_available)
+      {
+        for (GpuQuery& q : m_gpu_queries)
+        {
+          q.query.reset();
+        }
+      }
+    }
+  }
+
+  if (m_gpu_timing_available)
+  {
+    pollGpuQueries();
+
+    GpuQuery& q = m_gpu_queries[m_next_gpu_query];
+
+    // If the GPU is more than a few frames behind, we simply skip the measure
+    // for this frame rather than stalling the pipeline.
+    if (!q.pending)
+    {
+      q.query->begin();
+      m_active_gpu_query = &q;
+      m_next_gpu_query = (m_next_gpu_query + 1) % m_gpu_queries.size();
+    }
+  }
+
+  m_render_start = m_clock.nsecsElapsed();
+}
+
+void FrameProfiler::endRender()
+{
+  m_render_time = (m_clock.nsecsElapsed() - m_render_start) * 1e-6;
+
+  if (m_active_gpu_query)
+  {
+    m_active_gpu_query->query->end();
+    m_active_gpu_query->pending = true;
+    m_active_gpu_query = nullptr;
+  }
+}
+
+/**
+ * @brief records that the scene was not rendered during this frame
+ */
+void FrameProfiler::skipRender()
+{
+  m_render_time = 0;
+}
+
+/**
+ * @brief returns the CPU time spent in the last call to OpenGLScene::render(), in milliseconds
+ */
+double FrameProfiler::lastRenderTime() const
+{
+  return m_render_time;
+}
+
+/**
+ * @brief returns the most recent GPU time measured, in milliseconds
+ *
+ * This returns a negative value if no GPU timing is available.
+ * Because of the latency of the timer queries, the measure corresponds
+ * to a frame that was rendered a few frames ago.
+ */
+double FrameProfiler::lastGpuTime() const
+{
+  return m_gpu_samples.empty() ? -1. : m_gpu_samples.last();
+}
+
+void FrameProfiler::afterRendering()
+{
+  m_rendering_end = m_clock.nsecsElapsed();
+}
+
+/**
+ * @brief records the timings of the frame that has just been presented
+ *
+ * This is called when the frame has been swapped, or directly after
+ * rendering if there is no swap (e.g. when rendering offscreen).
+ */
+void FrameProfiler::endFrame()
+{
+  const qint64 now = m_clock.nsecsElapsed();
+
+  m_sync_samples.push(m_sync_time);
+  m_render_samples.push(m_render_time);
+  m_swap_samples.push(m_rendering_end >= 0 ? (now - m_rendering_end) * 1e-6 : 0.);
+
+  if (m_last_frame_end >= 0)
+  {
+    m_frame_samples.push((now - m_last_frame_end) * 1e-6);
+  }
+
+  m_last_frame_end = now;
+  m_rendering_end = -1;
+  ++m_frame_count;
+
+  if (m_last_publish < 0 || (now - m_last_publish) >= m_update_interval * qint64(1000000))
+  {
+    m_last_publish = now;
+    publish();
+  }
+}
+
+/**
+ * @brief releases the OpenGL timer queries
+ *
+ * The OpenGL context must be current.
+ */
+void FrameProfiler::releaseResources()
+{
+  for (GpuQuery& q : m_gpu_queries)
+  {
+    q.query.reset();
+    q.pending = false;
+  }
+
+  m_active_gpu_query = nullptr;
+  m_next_gpu_query = 0;
+  m_gpu_queries_initialized = false;
+  m_gpu_timing_available = false;
+}
+
+void FrameProfiler::pollGpuQueries()
+{
+  // Queries complete in the order they were issued, starting
+  // with the oldest one, which is the next one to be reused.
+  for (size_t i(0); i < m_gpu_queries.size(); ++i)
+  {
+    GpuQuery& q = m_gpu_queries[(m_next_gpu_query + i) % m_gpu_queries.size()];
+
+    if (!q.pending)
+    {
+      continue;
+    }
+
+    if (!q.query->isResultAvailable())
+    {
+      break;
+    }
+
+    m_gpu_samples.push(q.query->waitForResult() * 1e-6);
+    q.pending = false;
+  }
+}
+
+void FrameProfiler::publish()
+{
+  if (!m_statistics)
+  {
+    return;
+  }
+
+  FrameStatisticsSnapshot snapshot;
+  snapshot.sync = m_sync_samples.statistics();
+  snapshot.render = m_render_samples.statistics();
+  snapshot.gpu = m_gpu_samples.statistics();
+  snapshot.swap = m_swap_samples.statistics();
+  snapshot.frame = m_frame_samples.statistics();
+  snapshot.gpu_timing_available = m_gpu_timing_available;
+  snapshot.frame_count = m_frame_count;
+
+  // The statistics object lives in the main thread.
+  FrameStatistics* target = m_statistics.data();
+  QMetaObject::invokeMethod(
+    target, [target, snapshot]() { target->setSnapshot(snapshot); }, Qt::QueuedConnection);
+}
@@ -0,0 +1,106 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef FRAMEPROFILER_H
+#define FRAMEPROFILER_H
+
+#include "framestatistics.h"
+
+#include <QElapsedTimer>
+#include <QPointer>
+
+#include <array>
+#include <memory>
+#include <vector>
+
+class QOpenGLTimerQuery;
+
+/**
+ * @brief a fixed-size ring buffer of timing samples
+ */
+class RollingSamples
+{
+public:
+  explicit RollingSamples(size_t capacity = 240);
+
+  void push(double value);
+  bool empty() const;
+  double last() const;
+
+  FrameStageStatistics statistics() const;
+
+private:
+  std::vector<double> m_samples;
+  size_t m_next = 0;
+  size_t m_count = 0;
+  mutable std::vector<double> m_scratch;
+};
+
+/**
+ * @brief measures the timings of the frames rendered by a Window
+ *
+ * All functions of this class must be called from the render thread.
+ * GPU timings are obtained with a ring of OpenGL timer queries that are
+ * polled without ever waiting for the GPU; results are therefore
+ * recorded a few frames after they were issued.
+ */
+class FrameProfiler
+{
+public:
+  explicit FrameProfiler(FrameStatistics* statistics);
+  ~FrameProfiler();
+
+  void setUpdateInterval(int ms);
+
+  void beginSync();
+  void endSync();
+
+  void beginRender();
+  void endRender();
+  void skipRender();
+
+  void afterRendering();
+  void endFrame();
+
+  double lastRenderTime() const;
+  double lastGpuTime() const;
+
+  void releaseResources();
+
+protected:
+  void pollGpuQueries();
+  void publish();
+
+private:
+  QPointer<FrameStatistics> m_statistics;
+  int m_update_interval = 250;
+  QElapsedTimer m_clock;
+  qint64 m_sync_start = 0;
+  qint64 m_render_start = 0;
+  qint64 m_rendering_end = -1;
+  qint64 m_last_frame_end = -1;
+  qint64 m_last_publish = -1;
+  qint64 m_frame_count = 0;
+  double m_sync_time = 0;
+  double m_render_time = 0;
+  RollingSamples m_sync_samples;
+  RollingSamples m_render_samples;
+  RollingSamples m_gpu_samples;
+  RollingSamples m_swap_samples;
+  RollingSamples m_frame_samples;
+
+  struct GpuQuery
+  {
+    std::unique_ptr<QOpenGLTimerQuery> query;
+    bool pending = false;
+  };
+
+  std::array<GpuQuery, 4> m_gpu_queries;
+  size_t m_next_gpu_query = 0;
+  GpuQuery* m_active_gpu_query = nullptr;
+  bool m_gpu_queries_initialized = false;
+  bool m_gpu_timing_available = false;
+};
+
+#endif // FRAMEPROFILER_H
@@ -0,0 +1,97 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "framestatistics.h"
+
+#include <algorithm>
+
+FrameStatistics::FrameStatistics(QObject* parent) : QObject(parent)
+{
+
+}
+
+FrameStatistics::~FrameStatistics()
+{
+
+}
+
+const FrameStageStatistics& FrameStatistics::sync() const
+{
+  return m_snapshot.sync;
+}
+
+const FrameStageStatistics& FrameStatistics::render() const
+{
+  return m_snapshot.render;
+}
+
+const FrameStageStatistics& FrameStatistics::gpu() const
+{
+  return m_snapshot.gpu;
+}
+
+const FrameStageStatistics& FrameStatistics::swap() const
+{
+  return m_snapshot.swap;
+}
+
+const FrameStageStatistics& FrameStatistics::frame() const
+{
+  return m_snapshot.frame;
+}
+
+/**
+ * @brief returns the number of frames per second, computed from the median frame interval
+ */
+double FrameStatistics::fps() const
+{
+  return frame().p50 > 0 ? 1000. / frame().p50 : 0.;
+}
+
+/**
+ * @brief returns whether gpu timings are available
+ *
+ * GPU timings rely on OpenGL timer queries, which may not be supported
+ * by the OpenGL implementation.
+ */
+bool FrameStatistics::gpuTimingAvailable() const
+{
+  return m_snapshot.gpu_timing_available;
+}
+
+qint64 FrameStatistics::frameCount() const
+{
+  return m_snapshot.frame_count;
+}
+
+int FrameStatistics::updateInterval() const
+{
+  return m_update_interval;
+}
+
+/**
+ * @brief sets the minimum interval between two updates of the statistics
+ * @param ms  the interval in milliseconds
+ */
+void FrameStatistics::setUpdateInterval(int ms)
+{
+  ms = std::max(ms, 0);
+
+  if (m_update_interval != ms)
+  {
+    m_update_interval = ms;
+    Q_EMIT updateIntervalChanged();
+  }
+}
+
+const FrameStatisticsSnapshot& FrameStatistics::snapshot() const
+{
+  return m_snapshot;
+}
+
+void FrameStatistics::setSnapshot(const FrameStatisticsSnapshot& snapshot)
+{
+  m_snapshot = snapshot;
+  Q_EMIT updated();
+}
@@ -0,0 +1,429 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "qmlgl/frustumplanes.h"
+
+#include "qmlgl/viewportrenderdata.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define QMLGL_CULLING_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define QMLGL_CULLING_SSE
+#endif
+
+void BoundingBoxArray::clear()
+{
+  center_x.clear();
+  center_y.clear();
+  center_z.clear();
+  extent_x.clear();
+  extent_y.clear();
+  extent_z.clear();
+}
+
+void BoundingBoxArray::reserve(size_t n)
+{
+  center_x.reserve(n);
+  center_y.reserve(n);
+  center_z.reserve(n);
+  extent_x.reserve(n);
+  extent_y.reserve(n);
+  extent_z.reserve(n);
+}
+
+/**
+ * @brief appends a box given by its min and max corners
+ */
+void BoundingBoxArray::append(const QVector3D& min, const QVector3D& max)
+{
+  const QVector3D c = 0.5f * (min + max);
+  const QVector3D e = 0.5f * (max - min);
+  center_x.push_back(c.x());
+  center_y.push_back(c.y());
+  center_z.push_back(c.z());
+  extent_x.push_back(e.x());
+  extent_y.push_back(e.y());
+  extent_z.push_back(e.z());
+}
+
+void BoundingSphereArray::clear()
+{
+  center_x.clear();
+  center_y.clear();
+  center_z.clear();
+  radius.clear();
+}
+
+void BoundingSphereArray::reserve(size_t n)
+{
+  center_x.reserve(n);
+  center_y.reserve(n);
+  center_z.reserve(n);
+  radius.reserve(n);
+}
+
+void BoundingSphereArray::append(const QVector3D& center, float r)
+{
+  center_x.push_back(center.x());
+  center_y.push_back(center.y());
+  center_z.push_back(center.z());
+  radius.push_back(r);
+}
+
+/**
+ * @brief resizes the mask and clears all the bits
+ */
+void VisibilityMask::reset(size_t n)
+{
+  m_size = n;
+  m_words.assign((n + 31) / 32, 0);
+}
+
+/**
+ * @brief returns the number of bits that are set
+ */
+size_t VisibilityMask::count() const
+{
+  size_t n = 0;
+
+  for (uint32_t w : m_words)
+  {
+    for (; w != 0; w &= w - 1)
+    {
+      ++n;
+    }
+  }
+
+  return n;
+}
+
+bool VisibilityMask::all() const
+{
+  return count() == size();
+}
+
+bool VisibilityMask::none() const
+{
+  return std::all_of(m_words.begin(), m_words.end(), [](uint32_t w) { return w == 0; });
+}
+
+FrustumPlanes::FrustumPlanes()
+{
+  // a frustum that contains everything
+  m_planes.fill(QVector4D(0, 0, 0, 1));
+}
+
+/**
+ * @brief extracts the frustum planes from a view-projection matrix
+ * @param viewProjectionMatrix  the product of the projection and view matrices
+ *
+ * If the matrix also includes a model matrix, the planes are expressed
+ * in the model's local coordinates.
+ */
+FrustumPlanes::FrustumPlanes(const QMatrix4x4& viewProjectionMatrix)
+{
+  const QVector4D r0 = viewProjectionMatrix.row(0);
+  const QVector4D r1 = viewProjectionMatrix.row(1);
+  const QVector4D r2 = viewProjectionMatrix.row(2);
+  const QVector4D r3 = viewProjectionMatrix.row(3);
+
+  m_planes[Left] = r3 + r0;
+  m_planes[Right] = r3 - r0;
+  m_planes[Bottom] = r3 + r1;
+  m_planes[Top] = r3 - r1;
+  m_planes[Near] = r3 + r2;
+  m_planes[Far] = r3 - r2;
+
+  for (QVector4D& p : m_planes)
+  {
+    const float len = p.toVector3D().length();
+
+    if (len > 0)
+    {
+      p /= len;
+    }
+  }
+}
+
+/**
+ * @brief returns the frustum planes of a viewport in world coordinates
+ */
+FrustumPlanes FrustumPlanes::fromRenderData(const ViewportRenderData& viewport)
+{
+  return FrustumPlanes(viewport.projection_matrix * viewport.view_matrix);
+}
+
+/**
+ * @brief tests whether an axis-aligned box intersects the frustum
+ */
+bool FrustumPlanes::intersectsBox(const QVector3D& min, const QVector3D& max) const
+{
+  const QVector3D c = 0.5f * (min + max);
+  const QVector3D e = 0.5f * (max - min);
+
+  for (const QVector4D& p : m_planes)
+  {
+    const float d = p.x() * c.x() + p.y() * c.y() + p.z() * c.z() + p.w();
+    const float r = std::abs(p.x()) * e.x() + std::abs(p.y()) * e.y() + std::abs(p.z()) * e.z();
+
+    if (d + r < 0)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * @brief tests whether a sphere intersects the frustum
+ */
+bool FrustumPlanes::intersectsSphere(const QVector3D& center, float radius) const
+{
+  for (const QVector4D& p : m_planes)
+  {
+    const float d = p.x() * center.x() + p.y() * center.y() + p.z() * center.z() + p.w();
+
+    if (d + radius < 0)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+namespace
+{
+
+// returns a mask with the 'n' lowest bits set, for the elements [first, first + n)
+// that are inside the frustum, 'n' being at most 32; the boxes are processed
+// by packs of 4 or 8 when SIMD instructions are available.
+
+uint32_t cull_boxes_scalar(const std::array<QVector4D, 6>& planes, const BoundingBoxArray& boxes, size_t first, size_t n)
+{
+  uint32_t bits = 0;
+
+  for (size_t i(0); i < n; ++i)
+  {
+    const size_t k = first + i;
+    bool visible = true;
+
+    for (const QVector4D& p : planes)
+    {
+      const float d = p.x() * boxes.center_x[k] + p.y() * boxes.center_y[k] + p.z() * boxes.center_z[k] + p.w();
+      const float r = std::abs(p.x()) * boxes.extent_x[k] + std::abs(p.y()) * boxes.extent_y[k] + std::abs(p.z()) * boxes.extent_z[k];
+      visible = visible && (d + r >= 0);
+    }
+
+    bits |= uint32_t(visible) << i;
+  }
+
+  return bits;
+}
+
+uint32_t cull_spheres_scalar(const std::array<QVector4D, 6>& planes, const BoundingSphereArray& spheres, size_t first, size_t n)
+{
+  uint32_t bits = 0;
+
+  for (size_t i(0); i < n; ++i)
+  {
+    const size_t k = first + i;
+    bool visible = true;
+
+    for (const QVector4D& p : planes)
+    {
+      const float d = p.x() * spheres.center_x[k] + p.y() * spheres.center_y[k] + p.z() * spheres.center_z[k] + p.w();
+      visible = visible && (d + spheres.radius[k] >= 0);
+    }
+
+    bits |= uint32_t(visible) << i;
+  }
+
+  return bits;
+}
+
+#if defined(QMLGL_CULLING_AVX)
+
+constexpr size_t SimdWidth = 8;
+
+uint32_t cull_boxes_simd(const std::array<QVector4D, 6>& planes, const BoundingBoxArray& boxes, size_t k)
+{
+  const __m256 cx = _mm256_loadu_ps(boxes.center_x.data() + k);
+  const __m256 cy = _mm256_loadu_ps(boxes.center_y.data() + k);
+  const __m256 cz = _mm256_loadu_ps(boxes.center_z.data() + k);
+  const __m256 ex = _mm256_loadu_ps(boxes.extent_x.data() + k);
+  const __m256 ey = _mm256_loadu_ps(boxes.extent_y.data() + k);
+  const __m256 ez = _mm256_loadu_ps(boxes.extent_z.data() + k);
+  const __m256 zero = _mm256_setzero_ps();
+
+  __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+  for (const QVector4D& p : planes)
+  {
+    __m256 d = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(p.x()), cx), _mm256_set1_ps(p.w()));
+    d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(p.y()), cy));
+    d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(p.z()), cz));
+
+    __m256 r = _mm256_mul_ps(_mm256_set1_ps(std::abs(p.x())), ex);
+    r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_set1_ps(std::abs(p.y())), ey));
+    r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_set1_ps(std::abs(p.z())), ez));
+
+    visible = _mm256_and_ps(visible, _mm256_cmp_ps(_mm256_add_ps(d, r), zero, _CMP_GE_OQ));
+  }
+
+  return static_cast<uint32_t>(_mm256_movemask_ps(visible));
+}
+
+uint32_t cull_spheres_simd(const std::array<QVector4D, 6>& planes, const BoundingSphereArray& spheres, size_t k)
+{
+  const __m256 cx = _mm256_loadu_ps(spheres.center_x.data() + k);
+  const __m256 cy = _mm256_loadu_ps(spheres.center_y.data() + k);
+  const __m256 cz = _mm256_loadu_ps(spheres.center_z.data() + k);
+  const __m256 radius = _mm256_loadu_ps(spheres.radius.data() + k);
+  const __m256 zero = _mm256_setzero_ps();
+
+  __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+  for (const QVector4D& p : planes)
+  {
+    __m256 d = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(p.x()), cx), _mm256_set1_ps(p.w()));
+    d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(p.y()), cy));
+    d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(p.z()), cz));
+
+    visible = _mm256_and_ps(visible, _mm256_cmp_ps(_mm256_add_ps(d, radius), zero, _CMP_GE_OQ));
+  }
+
+  return static_cast<uint32_t>(_mm256_movemask_ps(visible));
+}
+
+#elif defined(QMLGL_CULLING_SSE)
+
+constexpr size_t SimdWidth = 4;
+
+uint32_t cull_boxes_simd(const std::array<QVector4D, 6>& planes, const BoundingBoxArray& boxes, size_t k)
+{
+  const __m128 cx = _mm_loadu_ps(boxes.center_x.data() + k);
+  const __m128 cy = _mm_loadu_ps(boxes.center_y.data() + k);
+  const __m128 cz = _mm_loadu_ps(boxes.center_z.data() + k);
+  const __m128 ex = _mm_loadu_ps(boxes.extent_x.data() + k);
+  const __m128 ey = _mm_loadu_ps(boxes.extent_y.data() + k);
+  const __m128 ez = _mm_loadu_ps(boxes.extent_z.data() + k);
+  const __m128 zero = _mm_setzero_ps();
+
+  __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+  for (const QVector4D& p : planes)
+  {
+    __m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.x()), cx), _mm_set1_ps(p.w()));
+    d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p.y()), cy));
+    d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p.z()), cz));
+
+    __m128 r = _mm_mul_ps(_mm_set1_ps(std::abs(p.x())), ex);
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(std::abs(p.y())), ey));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(std::abs(p.z())), ez));
+
+    visible = _mm_and_ps(visible, _mm_cmpge_ps(_mm_add_ps(d, r), zero));
+  }
+
+  return static_cast<uint32_t>(_mm_movemask_ps(visible));
+}
+
+uint32_t cull_spheres_simd(const std::array<QVector4D, 6>& planes, const BoundingSphereArray& spheres, size_t k)
+{
+  const __m128 cx = _mm_loadu_ps(spheres.center_x.data() + k);
+  const __m128 cy = _mm_loadu_ps(spheres.center_y.data() + k);
+  const __m128 cz = _mm_loadu_ps(spheres.center_z.data() + k);
+  const __m128 radius = _mm_loadu_ps(spheres.radius.data() + k);
+  const __m128 zero = _mm_setzero_ps();
+
+  __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+  for (const QVector4D& p : planes)
+  {
+    __m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.x()), cx), _mm_set1_ps(p.w()));
+    d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p.y()), cy));
+    d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p.z()), cz));
+
+    visible = _mm_and_ps(visible, _mm_cmpge_ps(_mm_add_ps(d, radius), zero));
+  }
+
+  return static_cast<uint32_t>(_mm_movemask_ps(visible));
+}
+
+#endif
+
+template<typename Array, typename SimdKernel, typename ScalarKernel>
+void cull(const std::array<QVector4D, 6>& planes, const Array& elements, VisibilityMask& visibility,
+  SimdKernel&& simd_kernel, ScalarKernel&& scalar_kernel)
+{
+  const size_t n = elements.size();
+  visibility.reset(n);
+  uint32_t* words = visibility.data();
+
+  size_t i = 0;
+
+#if defined(QMLGL_CULLING_AVX) || defined(QMLGL_CULLING_SSE)
+  // SimdWidth divides 32, so a pack never straddles two words
+  for (; i + SimdWidth <= n; i += SimdWidth)
+  {
+    words[i / 32] |= simd_kernel(planes, elements, i) << (i % 32);
+  }
+#else
+  Q_UNUSED(simd_kernel);
+#endif
+
+  // the scalar kernel returns at most 32 bits, it is called once per word
+  while (i < n)
+  {
+    const size_t count = std::min<size_t>(32 - i % 32, n - i);
+    words[i / 32] |= scalar_kernel(planes, elements, i, count) << (i % 32);
+    i += count;
+  }
+}
+
+} // namespace
+
+/**
+ * @brief tests an array of boxes against the frustum
+ * @param boxes       the boxes
+ * @param visibility  receives the result of the test
+ *
+ * This is equivalent to calling intersectsBox() for each box, but
+ * several boxes are tested at once using SSE or AVX instructions
+ * when they are enabled at compile time.
+ */
+void FrustumPlanes::cullBoxes(const BoundingBoxArray& boxes, VisibilityMask& visibility) const
+{
+#if defined(QMLGL_CULLING_AVX) || defined(QMLGL_CULLING_SSE)
+  auto simd_kernel = cull_boxes_simd;
+#else
+  auto simd_kernel = nullptr;
+#endif
+
+  cull(m_planes, boxes, visibility, simd_kernel, cull_boxes_scalar);
+}
+
+/**
+ * @brief tests an array of spheres against the frustum
+ * @param spheres     the spheres
+ * @param visibility  receives the result of the test
+ *
+ * @sa cullBoxes().
+ */
+void FrustumPlanes::cullSpheres(const BoundingSphereArray& spheres, VisibilityMask& visibility) const
+{
+#if defined(QMLGL_CULLING_AVX) || defined(QMLGL_CULLING_SSE)
+  auto simd_kernel = cull_spheres_simd;
+#else
+  auto simd_kernel = nullptr;
+#endif
+
+  cull(m_planes, spheres, visibility, simd_kernel, cull_spheres_scalar);
+}
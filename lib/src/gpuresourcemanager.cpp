@@ -0,0 +1,134 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "qmlgl/gpuresourcemanager.h"
+
+GpuResourceManager::GpuResourceManager()
+{
+
+}
+
+GpuResourceManager::~GpuResourceManager()
+{
+  clear();
+}
+
+/**
+ * @brief computes the FNV-1a hash of a block of memory
+ * @param data  the data
+ * @param size  the size of the data, in bytes
+ * @param seed  the initial value, used for combining hashes
+ */
+GpuResourceManager::Key GpuResourceManager::hash(const void* data, size_t size, Key seed)
+{
+  constexpr Key prime = 1099511628211ull;
+
+  const auto* bytes = static_cast<const unsigned char*>(data);
+  Key h = seed;
+
+  for (size_t i(0); i < size; ++i)
+  {
+    h ^= bytes[i];
+    h *= prime;
+  }
+
+  return h;
+}
+
+/**
+ * @brief computes the hash of a string
+ */
+GpuResourceManager::Key GpuResourceManager::hash(const QString& str, Key seed)
+{
+  return hash(str.constData(), str.size() * sizeof(QChar), seed);
+}
+
+/**
+ * @brief sets the amount of memory above which unused resources are destroyed
+ * @param bytes  the budget, in bytes
+ *
+ * The budget is enforced by collect().
+ */
+void GpuResourceManager::setBudget(size_t bytes)
+{
+  m_budget = bytes;
+}
+
+/**
+ * @brief destroys unused resources until the memory usage is within the budget
+ * @return the number of resources that were destroyed
+ *
+ * Resources are destroyed starting with the least recently used one.
+ * Resources that are still referenced outside the manager are never
+ * destroyed, so the memory usage may remain above the budget.
+ *
+ * The OpenGL context must be current.
+ */
+size_t GpuResourceManager::collect()
+{
+  size_t count = 0;
+
+  for (auto it = m_lru.end(); it != m_lru.begin() && m_memory_usage > m_budget; )
+  {
+    --it;
+
+    auto entry = m_entries.find(*it);
+
+    if (entry->second.resource.use_count() > 1)
+    {
+      continue;
+    }
+
+    m_memory_usage -= entry->second.bytes;
+    m_entries.erase(entry);
+    it = m_lru.erase(it);
+    ++count;
+  }
+
+  return count;
+}
+
+/**
+ * @brief releases all the resources held by the manager
+ *
+ * Resources still referenced outside the manager are destroyed
+ * when their last reference is released.
+ * The OpenGL context must be current.
+ */
+void GpuResourceManager::clear()
+{
+  m_entries.clear();
+  m_lru.clear();
+  m_memory_usage = 0;
+}
+
+std::shared_ptr<void> GpuResourceManager::findResource(Key key, std::type_index type)
+{
+  auto it = m_entries.find(key);
+
+  if (it == m_entries.end() || it->second.type != type)
+  {
+    return nullptr;
+  }
+
+  m_lru.splice(m_lru.begin(), m_lru, it->second.lru_position);
+
+  return it->second.resource;
+}
+
+void GpuResourceManager::insertResource(Key key, std::type_index type, std::shared_ptr<void> resource, size_t bytes)
+{
+  auto it = m_entries.find(key);
+
+  if (it != m_entries.end())
+  {
+    m_memory_usage -= it->second.bytes;
+    m_lru.erase(it->second.lru_position);
+    m_entries.erase(it);
+  }
+
+  m_lru.push_front(key);
+  m_entries.emplace(key, Entry{ type, std::move(resource), bytes, m_lru.begin() });
+  m_memory_usage += bytes;
+}
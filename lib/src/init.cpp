@@ -6,6 +6,7 @@
 
 #include "camera.h"
 #include "cameracontroller.h"
+#include "framestatistics.h"
 #include "viewfrustum.h"
 #include "viewport.h"
 
@@ -20,6 +21,7 @@ namespace qmlgl
  * This makes the following types available in the QmlGL module:
  * - Camera
  * - CameraController
+ * - FrameStatistics (uncreatable)
  * - ViewFrustum
  * - Viewport
  *
@@ -34,6 +36,8 @@ void init()
 
   qmlRegisterType<Camera>("QmlGL", 1, 0, "Camera");
   qmlRegisterType<CameraController>("QmlGL", 1, 0, "CameraController");
+  qRegisterMetaType<FrameStageStatistics>();
+  qmlRegisterUncreatableType<FrameStatistics>("QmlGL", 1, 0, "FrameStatistics", "FrameStatistics is provided by the Window");
   qmlRegisterType<ViewFrustum>("QmlGL", 1, 0, "ViewFrustum");
   qmlRegisterType<Viewport>("QmlGL", 1, 0, "Viewport");
 
@@ -0,0 +1,145 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "qmlgl/rendertaskqueue.h"
+
+#include <QElapsedTimer>
+
+#include <algorithm>
+
+RenderTaskQueue::~RenderTaskQueue()
+{
+
+}
+
+/**
+ * @brief adds a task to the queue
+ * @param task      the task
+ * @param priority  the priority of the task
+ *
+ * This function is thread-safe.
+ */
+void RenderTaskQueue::enqueue(Task task, int priority)
+{
+  std::function<void()> callback;
+
+  {
+    std::lock_guard<std::mutex> lock{ m_mutex };
+    m_tasks.push_back(Entry{ priority, m_next_sequence++, std::move(task) });
+    std::push_heap(m_tasks.begin(), m_tasks.end(), &RenderTaskQueue::compare);
+    callback = m_task_enqueued_callback;
+  }
+
+  if (callback)
+  {
+    callback();
+  }
+}
+
+/**
+ * @brief returns whether there are no tasks waiting to be executed
+ *
+ * This function is thread-safe.
+ */
+bool RenderTaskQueue::empty() const
+{
+  std::lock_guard<std::mutex> lock{ m_mutex };
+  return m_tasks.empty();
+}
+
+/**
+ * @brief returns the number of tasks waiting to be executed
+ *
+ * This function is thread-safe.
+ */
+size_t RenderTaskQueue::size() const
+{
+  std::lock_guard<std::mutex> lock{ m_mutex };
+  return m_tasks.size();
+}
+
+/**
+ * @brief executes tasks until the queue is empty or the budget is exhausted
+ * @param budget  the time budget, in milliseconds
+ * @return the number of tasks that were executed
+ *
+ * At least one task is executed if the queue is not empty, so that
+ * the queue always makes progress even with tasks exceeding the budget.
+ * Tasks are executed without holding the lock, they may therefore
+ * enqueue other tasks.
+ */
+size_t RenderTaskQueue::execute(double budget)
+{
+  QElapsedTimer timer;
+  timer.start();
+
+  size_t count = 0;
+
+  for (;;)
+  {
+    Task task;
+
+    {
+      std::lock_guard<std::mutex> lock{ m_mutex };
+
+      if (m_tasks.empty())
+      {
+        break;
+      }
+
+      std::pop_heap(m_tasks.begin(), m_tasks.end(), &RenderTaskQueue::compare);
+      task = std::move(m_tasks.back().task);
+      m_tasks.pop_back();
+    }
+
+    task();
+    ++count;
+
+    if (timer.nsecsElapsed() * 1e-6 >= budget)
+    {
+      break;
+    }
+  }
+
+  return count;
+}
+
+/**
+ * @brief removes all the tasks from the queue without executing them
+ */
+void RenderTaskQueue::clear()
+{
+  std::vector<Entry> tasks;
+
+  {
+    std::lock_guard<std::mutex> lock{ m_mutex };
+    std::swap(tasks, m_tasks);
+  }
+
+  // the tasks are destroyed without holding the lock
+}
+
+/**
+ * @brief sets a function to be called whenever a task is enqueued
+ *
+ * The callback is invoked in the thread that enqueued the task.
+ * This is used by Window to request a new frame.
+ */
+void RenderTaskQueue::setTaskEnqueuedCallback(std::function<void()> callback)
+{
+  std::lock_guard<std::mutex> lock{ m_mutex };
+  m_task_enqueued_callback = std::move(callback);
+}
+
+bool RenderTaskQueue::compare(const Entry& lhs, const Entry& rhs)
+{
+  // std::push_heap() builds a max-heap: the "largest" entry is the
+  // one with the highest priority, then the lowest sequence number
+  if (lhs.priority != rhs.priority)
+  {
+    return lhs.priority < rhs.priority;
+  }
+
+  return lhs.sequence > rhs.sequence;
+}
@@ -0,0 +1,158 @@
+// Copyright (C) 2024 Vincent Chambrin
+// This file is part of the 'qmlgl' project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "qmlgl/scenerendercache.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLFunctions>
+#include <QOpenGLTextureBlitter>
+
+#include <algorithm>
+
+SceneRenderCache::SceneRenderCache()
+{
+
+}
+
+SceneRenderCache::~SceneRenderCache()
+{
+
+}
+
+/**
+ * @brief returns the size of the framebuffer, in pixels
+ */
+QSize SceneRenderCache::size() const
+{
+  return m_render_fbo ? m_render_fbo->size() : QSize();
+}
+
+/**
+ * @brief returns whether the cache holds an image of the given size
+ * @param size  size in device pixels
+ */
+bool SceneRenderCache::hasContent(const QSize& size) const
+{
+  return m_has_content && m_render_fbo && m_render_fbo->size() == size;
+}
+
+/**
+ * @brief marks the content of the cache as outdated
+ */
+void SceneRenderCache::invalidate()
+{
+  m_has_content = false;
+}
+
+/**
+ * @brief binds the framebuffer object in which the scene is to be rendered
+ * @param size     size in device pixels
+ * @param samples  number of samples per pixel
+ *
+ * The framebuffer objects are (re)created if needed.
+ */
+void SceneRenderCache::bind(const QSize& size, int samples)
+{
+  samples = std::max(samples, 0);
+
+  if (!m_render_fbo || m_render_fbo->size() != size || m_samples != samples)
+  {
+    m_samples = samples;
+    m_resolve_fbo.reset();
+
+    QOpenGLFramebufferObjectFormat format;
+    format.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+    format.setSamples(samples);
+    m_render_fbo = std::make_unique<QOpenGLFramebufferObject>(size, format);
+
+    if (samples > 0)
+    {
+      m_resolve_fbo = std::make_unique<QOpenGLFramebufferObject>(size);
+    }
+
+    // the cache may be drawn in a region larger than its size (e.g. with dynamic resolution)
+    QOpenGLFramebufferObject* fbo = m_resolve_fbo ? m_resolve_fbo.get() : m_render_fbo.get();
+    QOpenGLFunctions* gl = QOpenGLContext::currentContext()->functions();
+    gl->glBindTexture(GL_TEXTURE_2D, fbo->texture());
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    gl->glBindTexture(GL_TEXTURE_2D, 0);
+  }
+
+  m_has_content = false;
+  m_render_fbo->bind();
+}
+
+/**
+ * @brief resolves the multisampled framebuffer into a texture
+ *
+ * This must be called after the scene has been rendered.
+ */
+void SceneRenderCache::resolve()
+{
+  if (m_resolve_fbo)
+  {
+    QOpenGLFramebufferObject::blitFramebuffer(m_resolve_fbo.get(), m_render_fbo.get());
+  }
+
+  m_has_content = true;
+}
+
+/**
+ * @brief draws the content of the cache in the currently bound framebuffer
+ * @param context  the current OpenGL context
+ */
+void SceneRenderCache::draw(QOpenGLContext* context)
+{
+  draw(context, QRect(QPoint(0, 0), size()));
+}
+
+/**
+ * @brief draws the content of the cache in a region of the currently bound framebuffer
+ * @param context   the current OpenGL context
+ * @param viewport  the region, in OpenGL window coordinates (origin at the bottom left)
+ *
+ * The content is stretched to fill the region.
+ */
+void SceneRenderCache::draw(QOpenGLContext* context, const QRect& viewport)
+{
+  if (!m_has_content)
+  {
+    return;
+  }
+
+  if (!m_blitter)
+  {
+    m_blitter = std::make_unique<QOpenGLTextureBlitter>();
+    m_blitter->create();
+  }
+
+  QOpenGLFramebufferObject* fbo = m_resolve_fbo ? m_resolve_fbo.get() : m_render_fbo.get();
+
+  QOpenGLFunctions* gl = context->functions();
+  gl->glViewport(viewport.x(), viewport.y(), viewport.width(), viewport.height());
+  gl->glDisable(GL_DEPTH_TEST);
+  gl->glDisable(GL_SCISSOR_TEST);
+  gl->glDisable(GL_BLEND);
+
+  const QRect rect{ QPoint(0, 0), viewport.size() };
+
+  m_blitter->bind();
+  m_blitter->blit(fbo->texture(), QOpenGLTextureBlitter::targetTransform(rect, rect), QOpenGLTextureBlitter::OriginBottomLeft);
+  m_blitter->release();
+}
+
+/**
+ * @brief releases the OpenGL resources
+ *
+ * The OpenGL context must be current.
+ */
+void SceneRenderCache::releaseResources()
+{
+  m_blitter.reset();
+  m_resolve_fbo.reset();
+  m_render_fbo.reset();
+  m_has_content = false;
+}
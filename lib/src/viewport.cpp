@@ -44,6 +44,9 @@ void Viewport::setCamera(Camera* cam)
       connect(m_camera, &Camera::projectionMatrixChanged, this, &Viewport::update);
       m_camera->setViewport(this);
     }
+
+    // the viewport now shows another view, or nothing
+    update();
   }
 }
 
@@ -71,6 +74,7 @@ void Viewport::setClearColor(const QColor& color)
   {
     m_clear_color = color;
     Q_EMIT clearColorChanged();
+    update();
   }
 }
 
@@ -96,9 +100,19 @@ ViewportRenderData Viewport::renderData() const
   return r;
 }
 
+/**
+ * \brief requests the viewport to be rendered again
+ *
+ * The request is forwarded to the Window which coalesces all the
+ * requests received during a frame into a single update.
+ */
 void Viewport::update()
 {
-  if (window())
+  if (m_window)
+  {
+    m_window->markViewportDirty(this);
+  }
+  else if (window())
   {
     window()->update();
   }
@@ -1,24 +1,48 @@
 #include "window.h"
 
+#include "cameracontroller.h"
+#include "dynamicresolution.h"
+#include "frameprofiler.h"
+#include "framestatistics.h"
+#include "gpuresourcemanager.h"
 #include "init.h"
+#include "rendertaskqueue.h"
 #include "scene.h"
+#include "scenerendercache.h"
 #include "viewport.h"
 
+#include <QOffscreenSurface>
 #include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
 #include <QOpenGLFunctions>
 #include <QSurfaceFormat>
 
+#include <QCoreApplication>
+
 #include <QQmlComponent>
 #include <QQmlContext>
 #include <QQmlEngine>
 #include <QQuickItem>
+#include <QQuickRenderControl>
 
 #include <QRunnable>
 
 #include <algorithm>
 
-Window::Window()
-  : m_clear_color(51, 51, 51)
+/**
+ * @brief constructs a window
+ * @param mode  whether the window is rendered on screen or offscreen
+ */
+Window::Window(RenderMode mode)
+  : Window(mode == Offscreen ? new QQuickRenderControl() : nullptr, mode)
+{
+
+}
+
+Window::Window(QQuickRenderControl* renderControl, RenderMode mode) : QQuickWindow(renderControl),
+  m_clear_color(51, 51, 51),
+  m_render_mode(mode),
+  m_render_control(renderControl)
 {
   // we are rendering OpenGL so we need OpenGLSurface.
   setSurfaceType(QSurface::OpenGLSurface);
@@ -38,8 +62,27 @@ Window::Window()
   // we would do the clear manually before rendering OpenGL.
   setClearBeforeRendering(false);
 
-  // warning: calling create() will trigger a QResizeEvent
-  create();
+  if (m_render_mode == OnScreen)
+  {
+    // warning: calling create() will trigger a QResizeEvent
+    create();
+  }
+  else
+  {
+    m_offscreen_context = std::make_unique<QOpenGLContext>();
+    m_offscreen_context->setFormat(format);
+
+    if (m_offscreen_context->create())
+    {
+      m_offscreen_surface = std::make_unique<QOffscreenSurface>();
+      m_offscreen_surface->setFormat(m_offscreen_context->format());
+      m_offscreen_surface->create();
+    }
+    else
+    {
+      qWarning() << "Window: could not create an OpenGL context for offscreen rendering";
+    }
+  }
 
   m_qml_engine = new QQmlEngine(this);
 
@@ -50,34 +93,82 @@ Window::Window()
 
   qmlgl::init();
 
+  m_frame_statistics = new FrameStatistics(this);
+  m_frame_profiler = std::make_unique<FrameProfiler>(m_frame_statistics);
+  m_scene_cache = std::make_unique<SceneRenderCache>();
+  m_resolution_controller = std::make_unique<DynamicResolution>();
+  m_render_task_queue = std::make_unique<RenderTaskQueue>();
+  m_gpu_resources = std::make_unique<GpuResourceManager>();
+
+  // tasks may be enqueued from any thread, a frame is requested
+  // in the main thread so that they get executed
+  m_render_task_queue->setTaskEnqueuedCallback([this]() {
+    QMetaObject::invokeMethod(this, &Window::scheduleSceneUpdate, Qt::QueuedConnection);
+  });
+
+  m_resolution_restore_timer.setSingleShot(true);
+  m_resolution_restore_timer.setInterval(250);
+  connect(&m_resolution_restore_timer, &QTimer::timeout, this, &Window::onInteractionEnded);
+
+  connect(this, &QQuickWindow::afterAnimating, this, &Window::onAfterAnimating, Qt::DirectConnection);
   connect(this, &QQuickWindow::sceneGraphInitialized, this, &Window::onSceneGraphInitialized, Qt::DirectConnection);
   connect(this, &QQuickWindow::sceneGraphInvalidated, this, &Window::onSceneGraphInvalidated, Qt::DirectConnection);
   connect(this, &QQuickWindow::beforeSynchronizing, this, &Window::onBeforeSynchronizing, Qt::DirectConnection);
+  connect(this, &QQuickWindow::afterSynchronizing, this, &Window::onAfterSynchronizing, Qt::DirectConnection);
   connect(this, &QQuickWindow::beforeRendering, this, &Window::onBeforeRendering, Qt::DirectConnection);
+  connect(this, &QQuickWindow::afterRendering, this, &Window::onAfterRendering, Qt::DirectConnection);
+  connect(this, &QQuickWindow::frameSwapped, this, &Window::onFrameSwapped, Qt::DirectConnection);
 }
 
 Window::~Window()
 {
   destroyUi();
 
-  if (m_gl_scene)
+  if (m_render_control)
+  {
+    // the scene graph is invalidated by the render control,
+    // which in turn destroys the GL scene
+    const bool current = m_offscreen_surface && m_offscreen_context->makeCurrent(m_offscreen_surface.get());
+
+    m_render_control.reset();
+    m_gl_scene.reset();
+    m_gpu_resources.reset();
+    m_offscreen_fbo.reset();
+
+    if (current)
+    {
+      m_offscreen_context->doneCurrent();
+    }
+  }
+  else if (m_gl_scene)
   {
     // Cannot destroy the GL scene here as OpenGL context may
     // live in a different thread.
 
+    // The resources shared by the scene are destroyed after it.
     struct DeleteSceneJob : QRunnable
     {
       OpenGLScene* m_scene;
-      explicit DeleteSceneJob(OpenGLScene* s) : m_scene(s) { }
-      void run() override { delete m_scene; }
+      GpuResourceManager* m_resources;
+      DeleteSceneJob(OpenGLScene* s, GpuResourceManager* r) : m_scene(s), m_resources(r) { }
+      void run() override { delete m_scene; delete m_resources; }
     };
-    scheduleRenderJob(new DeleteSceneJob(m_gl_scene.release()), BeforeSynchronizingStage);
+    scheduleRenderJob(new DeleteSceneJob(m_gl_scene.release(), m_gpu_resources.release()), BeforeSynchronizingStage);
   }
 
+  disconnect(this, &QQuickWindow::afterAnimating, this, &Window::onAfterAnimating);
   disconnect(this, &QQuickWindow::sceneGraphInitialized, this, &Window::onSceneGraphInitialized);
   disconnect(this, &QQuickWindow::sceneGraphInvalidated, this, &Window::onSceneGraphInvalidated);
   disconnect(this, &QQuickWindow::beforeSynchronizing, this, &Window::onBeforeSynchronizing);
+  disconnect(this, &QQuickWindow::afterSynchronizing, this, &Window::onAfterSynchronizing);
   disconnect(this, &QQuickWindow::beforeRendering, this, &Window::onBeforeRendering);
+  disconnect(this, &QQuickWindow::afterRendering, this, &Window::onAfterRendering);
+  disconnect(this, &QQuickWindow::frameSwapped, this, &Window::onFrameSwapped);
+}
+
+Window::RenderMode Window::renderMode() const
+{
+  return m_render_mode;
 }
 
 Window::Status Window::status() const
@@ -215,7 +306,7 @@ void Window::addViewport(Viewport* v)
 {
   m_viewports.push_back(v);
 
-  update();
+  markViewportDirty(v);
 }
 
 void Window::removeViewport(Viewport* v)
@@ -226,7 +317,9 @@ void Window::removeViewport(Viewport* v)
   {
     m_viewports.erase(it);
 
-    update();
+    m_dirty_viewports.erase(std::remove(m_dirty_viewports.begin(), m_dirty_viewports.end(), v), m_dirty_viewports.end());
+    m_scene_dirty = true;
+    scheduleSceneUpdate();
   }
 }
 
@@ -246,7 +339,8 @@ void Window::setClearColor(const QColor& c)
   {
     m_clear_color = c;
     Q_EMIT clearColorChanged();
-    update();
+    m_scene_dirty = true;
+    scheduleSceneUpdate();
   }
 }
 
@@ -255,6 +349,570 @@ OpenGLScene* Window::glScene() const
   return m_gl_scene.get();
 }
 
+/**
+ * @brief returns the object holding the frame timings of the window
+ *
+ * The returned object lives in the main thread and can be used
+ * in QML (e.g. through the \c Window.window attached property)
+ * to display an overlay with the frame statistics.
+ */
+FrameStatistics* Window::frameStatistics() const
+{
+  return m_frame_statistics;
+}
+
+/**
+ * @brief returns whether the scene is only rendered when it has changed
+ */
+bool Window::renderOnDemand() const
+{
+  return m_render_on_demand;
+}
+
+/**
+ * @brief sets whether the scene is rendered only when it changed
+ * @param on
+ *
+ * By default, OpenGLScene::render() is called for every frame of the window,
+ * including frames that are only caused by changes in the QML scene
+ * (e.g. an animation in the user interface).
+ *
+ * If render-on-demand is enabled, the scene is rendered into an offscreen
+ * framebuffer that is drawn under the QML scene for every frame; and
+ * OpenGLScene::synchronize() and OpenGLScene::render() are only called
+ * when the scene has been marked as dirty.
+ * Any change that affects the rendering of the scene must then be reported
+ * with markViewportDirty(), markSceneObjectDirty() or requestSceneUpdate().
+ *
+ * Changes to the cameras, viewports and clear color are tracked automatically.
+ */
+void Window::setRenderOnDemand(bool on)
+{
+  if (m_render_on_demand != on)
+  {
+    m_render_on_demand = on;
+    m_scene_dirty = true;
+    Q_EMIT renderOnDemandChanged();
+    scheduleSceneUpdate();
+  }
+}
+
+/**
+ * @brief marks a viewport as needing to be rendered again
+ * @param v  the viewport
+ *
+ * This function is called by Viewport::update().
+ * Multiple calls during the same frame only result in a single frame request.
+ */
+void Window::markViewportDirty(Viewport* v)
+{
+  if (std::find(m_dirty_viewports.begin(), m_dirty_viewports.end(), v) == m_dirty_viewports.end())
+  {
+    m_dirty_viewports.push_back(v);
+  }
+
+  m_scene_dirty = true;
+  scheduleSceneUpdate();
+}
+
+/**
+ * @brief marks an object of the scene as having changed
+ * @param obj  the object
+ *
+ * The scene can query which objects changed with isSceneObjectDirty()
+ * during OpenGLScene::synchronize().
+ * Multiple calls during the same frame only result in a single frame request.
+ */
+void Window::markSceneObjectDirty(QObject* obj)
+{
+  if (obj && std::find(m_dirty_scene_objects.begin(), m_dirty_scene_objects.end(), obj) == m_dirty_scene_objects.end())
+  {
+    m_dirty_scene_objects.push_back(obj);
+  }
+
+  m_scene_dirty = true;
+  scheduleSceneUpdate();
+}
+
+/**
+ * @brief returns whether the scene needs to be rendered again
+ *
+ * The dirty state is reset after each synchronization of the scene.
+ */
+bool Window::isSceneDirty() const
+{
+  return m_scene_dirty;
+}
+
+/**
+ * @brief returns whether a viewport was marked as dirty since the last frame
+ *
+ * This function is meant to be called from OpenGLScene::synchronize().
+ */
+bool Window::isViewportDirty(const Viewport* v) const
+{
+  return std::find(m_dirty_viewports.begin(), m_dirty_viewports.end(), v) != m_dirty_viewports.end();
+}
+
+/**
+ * @brief returns whether an object was marked as dirty since the last frame
+ *
+ * This function is meant to be called from OpenGLScene::synchronize().
+ */
+bool Window::isSceneObjectDirty(const QObject* obj) const
+{
+  return std::find(m_dirty_scene_objects.begin(), m_dirty_scene_objects.end(), obj) != m_dirty_scene_objects.end();
+}
+
+/**
+ * @brief requests the scene to be rendered again
+ *
+ * This slot can be connected to the signals of the objects that are rendered
+ * by the OpenGLScene; in which case the sender is marked as dirty.
+ */
+void Window::requestSceneUpdate()
+{
+  markSceneObjectDirty(sender());
+}
+
+/**
+ * @brief requests a new frame, unless one has already been requested
+ */
+void Window::scheduleSceneUpdate()
+{
+  if (!m_scene_update_scheduled)
+  {
+    m_scene_update_scheduled = true;
+    update();
+  }
+}
+
+/**
+ * @brief returns whether the resolution of the scene is reduced during interactions
+ */
+bool Window::dynamicResolution() const
+{
+  return m_dynamic_resolution;
+}
+
+/**
+ * @brief sets whether the resolution of the scene is reduced during interactions
+ * @param on
+ *
+ * When dynamic resolution is enabled, the scene is rendered without
+ * multisampling into a framebuffer whose resolution is adjusted for every
+ * frame in order to meet targetFrameTime() while the user is interacting
+ * with the scene (see notifyInteraction()).
+ * This framebuffer is then upscaled to the window.
+ *
+ * The scene is rendered again at full resolution, with multisampling,
+ * once there has been no interaction for resolutionRestoreDelay() milliseconds.
+ *
+ * Scenes must use sceneFramebufferSize() rather than the size of the window
+ * to compute their OpenGL viewports.
+ */
+void Window::setDynamicResolution(bool on)
+{
+  if (m_dynamic_resolution != on)
+  {
+    m_dynamic_resolution = on;
+
+    if (!m_dynamic_resolution && m_interacting)
+    {
+      m_resolution_restore_timer.stop();
+      onInteractionEnded();
+    }
+
+    Q_EMIT dynamicResolutionChanged();
+  }
+}
+
+/**
+ * @brief returns the frame time targeted by the dynamic resolution, in milliseconds
+ */
+double Window::targetFrameTime() const
+{
+  return m_target_frame_time;
+}
+
+void Window::setTargetFrameTime(double ms)
+{
+  ms = std::max(ms, 1.);
+
+  if (m_target_frame_time != ms)
+  {
+    m_target_frame_time = ms;
+    Q_EMIT targetFrameTimeChanged();
+  }
+}
+
+/**
+ * @brief returns the lowest resolution scale used by the dynamic resolution
+ *
+ * Defaults to 0.5, i.e. a quarter of the pixels of the window.
+ */
+double Window::minimumResolutionScale() const
+{
+  return m_minimum_resolution_scale;
+}
+
+void Window::setMinimumResolutionScale(double scale)
+{
+  scale = std::clamp(scale, 0.1, 1.);
+
+  if (m_minimum_resolution_scale != scale)
+  {
+    m_minimum_resolution_scale = scale;
+    Q_EMIT minimumResolutionScaleChanged();
+  }
+}
+
+/**
+ * @brief returns the delay after the last interaction before full resolution is restored, in milliseconds
+ */
+int Window::resolutionRestoreDelay() const
+{
+  return m_resolution_restore_timer.interval();
+}
+
+void Window::setResolutionRestoreDelay(int ms)
+{
+  ms = std::max(ms, 0);
+
+  if (m_resolution_restore_timer.interval() != ms)
+  {
+    m_resolution_restore_timer.setInterval(ms);
+    Q_EMIT resolutionRestoreDelayChanged();
+  }
+}
+
+/**
+ * @brief notifies that the user is interacting with the scene
+ *
+ * This function is called by the camera controllers for every frame
+ * during which the camera is moved.
+ * It does nothing if dynamic resolution is disabled.
+ *
+ * @sa setDynamicResolution().
+ */
+void Window::notifyInteraction()
+{
+  if (!m_dynamic_resolution)
+  {
+    return;
+  }
+
+  m_resolution_restore_timer.start();
+
+  if (!m_interacting)
+  {
+    m_interacting = true;
+    m_scene_dirty = true;
+    scheduleSceneUpdate();
+  }
+}
+
+void Window::onInteractionEnded()
+{
+  m_interacting = false;
+
+  // the scene must be rendered again at full resolution
+  m_scene_dirty = true;
+  scheduleSceneUpdate();
+}
+
+/**
+ * @brief returns the resolution scale of the frame being rendered
+ *
+ * This is 1 unless dynamic resolution is enabled and the user is
+ * interacting with the scene.
+ * This function must be called from the render thread.
+ */
+double Window::resolutionScale() const
+{
+  return m_frame_resolution_scale;
+}
+
+/**
+ * @brief returns the size, in pixels, of the framebuffer in which the scene is being rendered
+ *
+ * This function must be called from the render thread, during OpenGLScene::render().
+ * The size depends on the device pixel ratio and on resolutionScale().
+ */
+QSize Window::sceneFramebufferSize() const
+{
+  return m_scene_framebuffer_size;
+}
+
+/**
+ * @brief returns the queue of tasks to be executed in the render thread
+ *
+ * This function is thread-safe, and so are the functions for enqueuing
+ * tasks in the queue.
+ * A frame is requested whenever a task is enqueued.
+ */
+RenderTaskQueue* Window::renderTaskQueue() const
+{
+  return m_render_task_queue.get();
+}
+
+/**
+ * @brief returns whether there are tasks waiting to be executed in the render thread
+ *
+ * Scenes can use this function during OpenGLScene::synchronize() to know
+ * whether resources will be created before the next call to OpenGLScene::render().
+ */
+bool Window::hasPendingRenderTasks() const
+{
+  return !m_render_task_queue->empty();
+}
+
+/**
+ * @brief returns the maximum time spent executing render tasks per frame, in milliseconds
+ */
+double Window::renderTaskBudget() const
+{
+  return m_render_task_budget;
+}
+
+/**
+ * @brief sets the maximum time spent executing render tasks per frame
+ * @param ms  the budget, in milliseconds
+ *
+ * At least one task is executed per frame, regardless of the budget.
+ */
+void Window::setRenderTaskBudget(double ms)
+{
+  ms = std::max(ms, 0.);
+
+  if (m_render_task_budget != ms)
+  {
+    m_render_task_budget = ms;
+    Q_EMIT renderTaskBudgetChanged();
+  }
+}
+
+/**
+ * @brief returns the manager of the OpenGL resources shared by the scene
+ *
+ * The manager, and the resources it holds, can only be used from the render thread.
+ * Unused resources are destroyed after each frame when the memory they use
+ * exceeds gpuMemoryBudget().
+ */
+GpuResourceManager* Window::gpuResourceManager() const
+{
+  return m_gpu_resources.get();
+}
+
+/**
+ * @brief returns the amount of GPU memory above which unused resources are destroyed, in bytes
+ *
+ * Defaults to 512 MiB.
+ */
+qint64 Window::gpuMemoryBudget() const
+{
+  return m_gpu_memory_budget;
+}
+
+void Window::setGpuMemoryBudget(qint64 bytes)
+{
+  bytes = std::max(bytes, qint64(0));
+
+  if (m_gpu_memory_budget != bytes)
+  {
+    m_gpu_memory_budget = bytes;
+    Q_EMIT gpuMemoryBudgetChanged();
+  }
+}
+
+/**
+ * @brief renders frames of an offscreen window
+ * @param count  the number of frames to render
+ * @return whether the frames could be rendered
+ *
+ * The frames are rendered one after the other, as fast as possible.
+ * The QML scene is polished, synchronized and rendered for each frame
+ * (so that the frame statistics are representative of a real frame)
+ * and the OpenGL commands are flushed at the end of each frame.
+ *
+ * This function does nothing and returns false if the window is not
+ * in Offscreen mode.
+ */
+bool Window::renderOffscreenFrames(int count)
+{
+  if (m_render_mode != Offscreen)
+  {
+    return false;
+  }
+
+  while (status() == Loading)
+  {
+    QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+  }
+
+  if (!initializeOffscreenRendering())
+  {
+    return false;
+  }
+
+  // no resize event is received by a window that has no native window
+  contentItem()->setSize(size());
+  resizeRootObjectToView();
+
+  for (int i(0); i < count; ++i)
+  {
+    m_render_control->polishItems();
+    m_render_control->sync();
+    m_render_control->render();
+
+    m_offscreen_context->functions()->glFlush();
+
+    // there is no buffer swap when rendering offscreen
+    m_frame_profiler->endFrame();
+  }
+
+  return true;
+}
+
+/**
+ * @brief returns the image of the last frame rendered offscreen
+ *
+ * Returns a null image if the window is not in Offscreen mode or if no frame
+ * has been rendered yet.
+ */
+QImage Window::grabOffscreenFrame()
+{
+  if (!m_offscreen_fbo || !m_offscreen_context->makeCurrent(m_offscreen_surface.get()))
+  {
+    return QImage();
+  }
+
+  return m_offscreen_fbo->toImage();
+}
+
+/**
+ * @brief prepares the resources needed for rendering offscreen
+ *
+ * The render control is initialized on first call (which creates the
+ * OpenGLScene) and the framebuffer object is (re)created so that it
+ * matches the size of the window.
+ */
+bool Window::initializeOffscreenRendering()
+{
+  if (!m_offscreen_surface || !m_offscreen_context->makeCurrent(m_offscreen_surface.get()))
+  {
+    return false;
+  }
+
+  if (!openglContext())
+  {
+    if (!m_render_control->initialize(m_offscreen_context.get()))
+    {
+      qWarning() << "Window: could not initialize the render control";
+      return false;
+    }
+  }
+
+  const QSize fbsize = size() * devicePixelRatio();
+
+  if (fbsize.isEmpty())
+  {
+    qWarning() << "Window: cannot render offscreen a window with an empty size";
+    return false;
+  }
+
+  if (!m_offscreen_fbo || m_offscreen_fbo->size() != fbsize)
+  {
+    QOpenGLFramebufferObjectFormat fbo_format;
+    fbo_format.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+    fbo_format.setSamples(format().samples());
+    m_offscreen_fbo = std::make_unique<QOpenGLFramebufferObject>(fbsize, fbo_format);
+    setRenderTarget(m_offscreen_fbo.get());
+    m_scene_dirty = true;
+  }
+
+  return true;
+}
+
+/**
+ * @brief publishes the data needed for rendering the next frame
+ *
+ * This function is called in the main thread after the animations have
+ * been advanced and before the render thread is asked to synchronize the scene.
+ * The default implementation does nothing.
+ *
+ * Derived classes can reimplement this function to prepare a snapshot of
+ * the data needed for rendering (e.g. with a TripleBuffer) without blocking
+ * the render thread, leaving as little work as possible for OpenGLScene::synchronize().
+ */
+void Window::publishRenderData()
+{
+
+}
+
+/**
+ * @brief steps a camera controller once per frame
+ * @param controller  the controller
+ *
+ * The controller is advanced in the main thread, after the animations
+ * and before the scene is synchronized, for every frame until
+ * removeAnimatedController() is called.
+ * Frames are requested for as long as there are controllers to advance.
+ *
+ * This function is called by CameraController::startMovement().
+ */
+void Window::addAnimatedController(CameraController* controller)
+{
+  if (std::find(m_animated_controllers.begin(), m_animated_controllers.end(), controller) == m_animated_controllers.end())
+  {
+    m_animated_controllers.push_back(controller);
+  }
+
+  update();
+}
+
+/**
+ * @brief stops stepping a camera controller
+ * @param controller  the controller
+ */
+void Window::removeAnimatedController(CameraController* controller)
+{
+  auto it = std::find(m_animated_controllers.begin(), m_animated_controllers.end(), controller);
+
+  if (it != m_animated_controllers.end())
+  {
+    m_animated_controllers.erase(it);
+  }
+}
+
+void Window::advanceAnimatedControllers()
+{
+  // controllers may be removed (or destroyed) while being advanced
+  const std::vector<QPointer<CameraController>> controllers = m_animated_controllers;
+
+  for (const QPointer<CameraController>& c : controllers)
+  {
+    if (c)
+    {
+      c->advanceFrame();
+    }
+  }
+
+  m_animated_controllers.erase(std::remove_if(m_animated_controllers.begin(), m_animated_controllers.end(),
+    [](const QPointer<CameraController>& c) { return c.isNull(); }), m_animated_controllers.end());
+
+  if (!m_animated_controllers.empty())
+  {
+    update();
+  }
+}
+
+void Window::onAfterAnimating()
+{
+  advanceAnimatedControllers();
+  publishRenderData();
+}
+
 void Window::onSceneGraphInitialized()
 {
   m_gl_scene = createOpenGLScene();
@@ -262,31 +920,204 @@ void Window::onSceneGraphInitialized()
 
 void Window::onSceneGraphInvalidated()
 {
+  m_frame_profiler->releaseResources();
+  m_scene_cache->releaseResources();
+
+  // the tasks cannot be executed without the OpenGL context
+  m_render_task_queue->clear();
+
   if (m_gl_scene)
   {
     m_gl_scene.reset();
     Q_EMIT glSceneDestroyed();
   }
+
+  m_gpu_resources->clear();
 }
 
 void Window::onBeforeSynchronizing()
 {
-  if (glScene())
+  m_frame_profiler->beginSync();
+  m_frame_profiler->setUpdateInterval(m_frame_statistics->updateInterval());
+
+  // the main thread is blocked, we can safely consume the dirty state
+  if (checkViewportsLayout())
+  {
+    m_scene_dirty = true;
+  }
+
+  m_resolution_controller->setTargetFrameTime(m_target_frame_time);
+  m_resolution_controller->setMinimumScale(m_minimum_resolution_scale);
+  m_frame_render_task_budget = m_render_task_budget;
+  m_gpu_resources->setBudget(static_cast<size_t>(m_gpu_memory_budget));
+
+  // pending render tasks will change the rendering of the scene
+  if (hasPendingRenderTasks())
+  {
+    m_scene_dirty = true;
+  }
+
+  if (m_frame_interacting != m_interacting)
+  {
+    m_frame_interacting = m_interacting;
+    m_scene_dirty = true;
+  }
+
+  m_render_scene = m_scene_dirty || !renderOnDemand();
+
+  if (glScene() && m_render_scene)
   {
     glScene()->synchronize(this);
   }
+
+  m_scene_update_scheduled = false;
+  m_scene_dirty = false;
+  m_dirty_viewports.clear();
+  m_dirty_scene_objects.clear();
+}
+
+void Window::onAfterSynchronizing()
+{
+  m_frame_profiler->endSync();
 }
 
 void Window::onBeforeRendering()
 {
-  if (glScene())
+  if (!glScene())
   {
-    glScene()->render(this);
+    return;
   }
+
+  if (m_render_scene)
+  {
+    executeRenderTasks();
+  }
+
+  const QSize fbsize = size() * devicePixelRatio();
+
+  if (!renderOnDemand() && !m_frame_interacting)
+  {
+    m_scene_cache->releaseResources();
+
+    m_frame_resolution_scale = 1.;
+    m_scene_framebuffer_size = fbsize;
+    renderScene();
+
+    return;
+  }
+
+  QOpenGLFunctions* gl = openglContext()->functions();
+
+  GLint target_fbo = 0;
+  gl->glGetIntegerv(GL_FRAMEBUFFER_BINDING, &target_fbo);
+
+  // during interactions, the scene is rendered without multisampling
+  // at a resolution that depends on the previous frame times
+  m_frame_resolution_scale = m_frame_interacting ? m_resolution_controller->scale() : 1.;
+  const QSize scene_fbsize = (QSizeF(fbsize) * m_frame_resolution_scale).toSize().expandedTo(QSize(1, 1));
+  const int samples = m_frame_interacting ? 0 : format().samples();
+
+  if (m_render_scene || !m_scene_cache->hasContent(scene_fbsize))
+  {
+    m_scene_cache->bind(scene_fbsize, samples);
+
+    m_scene_framebuffer_size = scene_fbsize;
+    renderScene();
+
+    m_scene_cache->resolve();
+
+    if (m_frame_interacting)
+    {
+      const double gpu_time = m_frame_profiler->lastGpuTime();
+      m_resolution_controller->adapt(gpu_time >= 0 ? gpu_time : m_frame_profiler->lastRenderTime());
+    }
+  }
+  else
+  {
+    m_frame_profiler->skipRender();
+  }
+
+  gl->glBindFramebuffer(GL_FRAMEBUFFER, target_fbo);
+  m_scene_cache->draw(openglContext(), QRect(QPoint(0, 0), fbsize));
+
+  resetOpenGLState();
+  gl->glBindFramebuffer(GL_FRAMEBUFFER, target_fbo);
+}
+
+void Window::renderScene()
+{
+  m_frame_profiler->beginRender();
+  glScene()->render(this);
+  m_frame_profiler->endRender();
+
+  m_gpu_resources->collect();
+}
+
+void Window::executeRenderTasks()
+{
+  QOpenGLFunctions* gl = openglContext()->functions();
+
+  GLint target_fbo = 0;
+  gl->glGetIntegerv(GL_FRAMEBUFFER_BINDING, &target_fbo);
+
+  if (m_render_task_queue->execute(m_frame_render_task_budget) > 0)
+  {
+    resetOpenGLState();
+    gl->glBindFramebuffer(GL_FRAMEBUFFER, target_fbo);
+  }
+
+  if (hasPendingRenderTasks())
+  {
+    // the remaining tasks will be executed during the next frame
+    QMetaObject::invokeMethod(this, &Window::scheduleSceneUpdate, Qt::QueuedConnection);
+  }
+}
+
+void Window::onAfterRendering()
+{
+  m_frame_profiler->afterRendering();
+}
+
+void Window::onFrameSwapped()
+{
+  m_frame_profiler->endFrame();
 }
 
 void Window::resizeEvent(QResizeEvent* ev)
 {
   QQuickWindow::resizeEvent(ev);
   resizeRootObjectToView();
+
+  m_scene_dirty = true;
+  scheduleSceneUpdate();
+}
+
+/**
+ * @brief checks whether the position, visibility or stacking order of the viewports changed
+ *
+ * Viewports can be moved by changes in the QML scene that do not
+ * concern them directly (e.g. the geometry of a parent item),
+ * so their layout is compared with the one of the previous frame.
+ */
+bool Window::checkViewportsLayout()
+{
+  bool changed = m_viewports_layout.size() != m_viewports.size();
+
+  m_viewports_layout.resize(m_viewports.size());
+
+  for (size_t i(0); i < m_viewports.size(); ++i)
+  {
+    const Viewport* v = m_viewports.at(i);
+    ViewportLayout& layout = m_viewports_layout.at(i);
+    ViewportLayout current{ v, v->sceneRect(), v->z(), v->isVisible() };
+
+    if (layout.viewport != current.viewport || layout.rect != current.rect
+      || layout.z != current.z || layout.visible != current.visible)
+    {
+      layout = current;
+      changed = true;
+    }
+  }
+
+  return changed;
 }